@@ -0,0 +1,90 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+static inline double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// xorshift64, seeded the same on every run so results are comparable
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static inline unsigned int next_random(unsigned int bound) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (unsigned int)(rng_state % bound);
+}
+
+// ================= Harness ==================
+
+// Most timed repetitions of one case
+#define BENCH_MAX_REPS 1000
+
+/*
+ * One benchmark case: setup() runs untimed before every repetition, run()
+ * is timed and does ops operations. Either may be NULL.
+ */
+typedef struct BENCH_CASE {
+  const char* name;
+  void (*setup)(void* ctx);
+  void (*run)(void* ctx);
+  void* ctx;
+  double ops;
+  int warmup;
+  int reps;
+} BenchCase_t;
+
+typedef struct BENCH_RESULT {
+  double median_ns;    // per operation
+  double p95_ns;
+  double min_ns;
+  int reps;
+} BenchResult_t;
+
+static inline int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Runs the warmup repetitions, then times each of the others on its own
+static inline BenchResult_t run_bench_case(const BenchCase_t* c) {
+  static double samples[BENCH_MAX_REPS];
+  int reps = c->reps < 1 ? 1 : c->reps > BENCH_MAX_REPS ? BENCH_MAX_REPS : c->reps;
+
+  for (int r = 0; r < c->warmup; r++) {
+    if (c->setup) c->setup(c->ctx);
+    if (c->run) c->run(c->ctx);
+  }
+  for (int r = 0; r < reps; r++) {
+    if (c->setup) c->setup(c->ctx);
+    double start = now_seconds();
+    if (c->run) c->run(c->ctx);
+    samples[r] = (now_seconds() - start) * 1e9 / (c->ops > 0 ? c->ops : 1);
+  }
+
+  qsort(samples, reps, sizeof(double), compare_doubles);
+  BenchResult_t result = {
+    .median_ns = reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2,
+    .p95_ns = samples[(int)((reps - 1) * 0.95 + 0.5)],
+    .min_ns = samples[0],
+    .reps = reps,
+  };
+  return result;
+}
+
+// One JSON line per case; params is a JSON fragment such as "\"sms\":4"
+static inline void print_bench_result(const BenchCase_t* c, const char* params, const BenchResult_t* r) {
+  printf("{\"bench\":\"%s\",%s,\"ops\":%.0f,\"reps\":%d,"
+         "\"median_ns_per_op\":%.3f,\"p95_ns_per_op\":%.3f,\"min_ns_per_op\":%.3f}\n",
+         c->name, params, c->ops, r->reps, r->median_ns, r->p95_ns, r->min_ns);
+  fflush(stdout);
+}
+
+#endif // BENCH_H
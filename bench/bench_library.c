@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "bench.h"
+#include "gpusim.h"
+
+// Calls into libgpusim as a scheduler embedding it would, on config.json,
+// then the same from THREADS threads with a context each
+#define CONFIG "config.json"
+#define REPS 1000
+#define WARMUP 10
+#define THREADS 8
+#define THREAD_ROUNDS 2000
+
+static const char occupancy_query[] =
+  "{\"op\":\"occupancy\",\"threads\":256,\"registers\":32,\"shared_mem\":4096}";
+static const char placement_query[] =
+  "{\"op\":\"placement\",\"threads\":256,\"registers\":32,\"shared_mem\":4096,\"blocks\":64}";
+
+typedef struct LIBRARY_CTX {
+  char* json;
+  size_t length;
+  GpusimContext_t* sim;
+  volatile unsigned long long sink;
+} LibraryCtx_t;
+
+static char* read_file(const char* path, size_t* length) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror("Failed to open " CONFIG);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  *length = ftell(f);
+  rewind(f);
+  char* data = malloc(*length + 1);
+  if (!data || fread(data, 1, *length, f) != *length) {
+    fprintf(stderr, "Failed to read %s\n", path);
+    exit(1);
+  }
+  data[*length] = '\0';
+  fclose(f);
+  return data;
+}
+
+// Blocks placed on every GPU, the result a caller reads back
+static unsigned long long placed_blocks(GpusimContext_t* sim) {
+  unsigned long long placed = 0;
+  GpusimGpuResult_t result = { .size = sizeof(result) };
+  for (int g = 0; g < gpusim_gpu_count(sim); g++) {
+    if (gpusim_gpu_result(sim, g, &result) == 0) placed += result.blocks_placed;
+  }
+  return placed;
+}
+
+// The whole round trip: new context, config, placement, results
+static void run_create_to_destroy(void* p) {
+  LibraryCtx_t* ctx = p;
+  GpusimContext_t* sim = gpusim_create();
+  gpusim_load_json(sim, ctx->json, ctx->length);
+  gpusim_launch(sim);
+  ctx->sink += placed_blocks(sim);
+  gpusim_destroy(sim);
+}
+
+static void run_launch(void* p) {
+  LibraryCtx_t* ctx = p;
+  gpusim_launch(ctx->sim);
+  ctx->sink += placed_blocks(ctx->sim);
+}
+
+static void run_query(void* p, const char* query, size_t length) {
+  LibraryCtx_t* ctx = p;
+  char answer[GPUSIM_MAX_ANSWER];
+  ctx->sink += gpusim_query(ctx->sim, query, length, answer, sizeof(answer));
+}
+
+static void run_occupancy_query(void* p) {
+  run_query(p, occupancy_query, sizeof(occupancy_query) - 1);
+}
+
+static void run_placement_query(void* p) {
+  run_query(p, placement_query, sizeof(placement_query) - 1);
+}
+
+static void bench(const char* name, void (*run)(void*), LibraryCtx_t* ctx) {
+  BenchCase_t c = { .name = name, .run = run, .ctx = ctx, .ops = 1, .warmup = WARMUP, .reps = REPS };
+  BenchResult_t result = run_bench_case(&c);
+  print_bench_result(&c, "\"op\":\"call\"", &result);
+}
+
+// ================= Threads ==================
+
+typedef struct THREAD_ARG {
+  const LibraryCtx_t* shared;
+  unsigned long long expected;
+  int mismatches;
+} ThreadArg_t;
+
+static void* thread_main(void* p) {
+  ThreadArg_t* arg = p;
+  GpusimContext_t* sim = gpusim_create();
+  for (int r = 0; r < THREAD_ROUNDS; r++) {
+    gpusim_load_json(sim, arg->shared->json, arg->shared->length);
+    gpusim_launch(sim);
+    if (placed_blocks(sim) != arg->expected) arg->mismatches++;
+  }
+  gpusim_destroy(sim);
+  return NULL;
+}
+
+// Every thread must see the placement of the single-threaded run
+static int bench_threads(LibraryCtx_t* ctx, unsigned long long expected) {
+  pthread_t threads[THREADS];
+  ThreadArg_t args[THREADS];
+  double start = now_seconds();
+  for (int t = 0; t < THREADS; t++) {
+    args[t] = (ThreadArg_t){ .shared = ctx, .expected = expected };
+    pthread_create(&threads[t], NULL, thread_main, &args[t]);
+  }
+  int mismatches = 0;
+  for (int t = 0; t < THREADS; t++) {
+    pthread_join(threads[t], NULL);
+    mismatches += args[t].mismatches;
+  }
+  double seconds = now_seconds() - start;
+
+  printf("{\"bench\":\"load_launch_threads\",\"threads\":%d,\"rounds\":%d,"
+         "\"ns_per_round\":%.3f,\"rounds_per_second\":%.0f,\"mismatches\":%d}\n",
+         THREADS, THREAD_ROUNDS, seconds * 1e9 / (THREADS * THREAD_ROUNDS),
+         THREADS * THREAD_ROUNDS / seconds, mismatches);
+  return mismatches;
+}
+
+int main(void) {
+  if (gpusim_abi_version() != GPUSIM_ABI_VERSION) {
+    fprintf(stderr, "libgpusim ABI %d, built against %d\n", gpusim_abi_version(), GPUSIM_ABI_VERSION);
+    return 1;
+  }
+
+  LibraryCtx_t ctx = {0};
+  ctx.json = read_file(CONFIG, &ctx.length);
+  ctx.sim = gpusim_create();
+  if (!ctx.sim || gpusim_load_json(ctx.sim, ctx.json, ctx.length) != 0) {
+    fprintf(stderr, "Failed to load %s: %s\n", CONFIG, ctx.sim ? gpusim_last_error(ctx.sim) : "no memory");
+    return 1;
+  }
+  gpusim_launch(ctx.sim);
+  unsigned long long expected = placed_blocks(ctx.sim);
+
+  bench("create_load_launch_destroy", run_create_to_destroy, &ctx);
+  bench("launch", run_launch, &ctx);
+  bench("query_occupancy", run_occupancy_query, &ctx);
+  bench("query_placement", run_placement_query, &ctx);
+  int mismatches = bench_threads(&ctx, expected);
+
+  gpusim_destroy(ctx.sim);
+  free(ctx.json);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "bench.h"
+#include "cuda_arch.h"
+#include "occupancy.h"
+
+// Size of an autotuner sweep and how many times it is evaluated
+#define SHAPES 50000
+#define ROUNDS 2000
+// Shapes cross-checked against the simulator's own placement
+#define CHECKED 5000
+
+// Fills one empty SM through canFitBlock() and returns its block count
+static unsigned int reference_blocks(Gpu_t* gpu, Block_t* block) {
+  unsigned int placed = 0;
+  while (canFitBlock(gpu, 0, block)) {
+    place_block_on_SM(gpu, 0, block);
+    placed++;
+  }
+  return placed;
+}
+
+static int check_against_simulator(const Gpu_t* limits, const OccupancyTable_t* table,
+  const unsigned int* threads, const unsigned int* regs, const unsigned int* shared) {
+  float occ[CHECKED];
+  unsigned char limit[CHECKED];
+  unsigned short blocks[CHECKED];
+  occupancy_batch(table, CHECKED, threads, regs, shared, occ, limit, blocks);
+
+  int mismatches = 0;
+  for (int i = 0; i < CHECKED; i++) {
+    Gpu_t gpu = new_GPU(limits->name, limits->global_mem_size_in_bytes,
+      limits->shared_mem_size_in_bytes_per_SM, limits->number_of_registers_per_SM,
+      limits->maximum_number_of_warps_per_SM, limits->maximum_number_of_blocks_per_SM, 1);
+    Block_t block = {
+      .kernel_name = "bench",
+      .number_of_thread = threads[i],
+      .shared_mem_used_in_bytes = shared[i],
+      .number_of_registers_used_per_thread = regs[i],
+    };
+    unsigned int expected = reference_blocks(&gpu, &block);
+    double expected_occ = calculate_occupancy_of_SM(&gpu, 0);
+    if (expected != blocks[i] || fabs(expected_occ - occ[i]) > 1e-5) {
+      mismatches++;
+    }
+    free_GPU(&gpu);
+  }
+  return mismatches;
+}
+
+int main(void) {
+  Gpu_t gpu = new_GPU("bench_gpu", 17179869184ul, 131072, 256000, 64, 32, 1);
+  OccupancyTable_t table = new_occupancy_table(&gpu);
+
+  unsigned int* threads = malloc(sizeof(unsigned int) * SHAPES);
+  unsigned int* regs = malloc(sizeof(unsigned int) * SHAPES);
+  unsigned int* shared = malloc(sizeof(unsigned int) * SHAPES);
+  float* occ = malloc(sizeof(float) * SHAPES);
+  unsigned char* limit = malloc(SHAPES);
+  if (!threads || !regs || !shared || !occ || !limit) {
+    perror("Memory allocation failed");
+    return 1;
+  }
+
+  for (int i = 0; i < SHAPES; i++) {
+    threads[i] = 32 * (1 + next_random(32));
+    regs[i] = 16 + next_random(240);
+    shared[i] = next_random(65) * 1024;
+  }
+
+  int mismatches = check_against_simulator(&gpu, &table, threads, regs, shared);
+
+  // Warm up caches and branch predictors before timing
+  for (int r = 0; r < 10; r++) {
+    occupancy_batch(&table, SHAPES, threads, regs, shared, occ, limit, NULL);
+  }
+
+  double start = now_seconds();
+  for (int r = 0; r < ROUNDS; r++) {
+    occupancy_batch(&table, SHAPES, threads, regs, shared, occ, limit, NULL);
+  }
+  double elapsed = now_seconds() - start;
+
+  double evaluations = (double)SHAPES * ROUNDS;
+  printf("{\"bench\":\"occupancy_batch\",\"shapes\":%d,\"rounds\":%d,"
+         "\"ns_per_eval\":%.3f,\"evals_per_sec\":%.0f,\"mismatches\":%d}\n",
+         SHAPES, ROUNDS, elapsed * 1e9 / evaluations, evaluations / elapsed, mismatches);
+
+  free(threads);
+  free(regs);
+  free(shared);
+  free(occ);
+  free(limit);
+  free_GPU(&gpu);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "cuda_arch.h"
+
+// Work, in SMs visited plus blocks placed, that one case aims to time in total
+#define WORK_PER_CASE 20000000.0
+#define MIN_REPS 5
+#define MAX_REPS 200
+#define WARMUP 2
+
+// H100-like SMs, so a kernel of the shape below fits 16 blocks per SM
+#define SHARED_PER_SM (228 * 1024)
+#define REGISTERS_PER_SM 65536
+#define WARPS_PER_SM 64
+#define BLOCKS_PER_SM 32
+
+// Up to fleet-sized GPUs, well within MAX_NUMBER_OF_SMS
+static const unsigned int sm_counts[] = { 4, 132, 1024, 100000 };
+static const unsigned int block_counts[] = { 1, 1000, 1000000, 10000000 };
+
+typedef struct PLACEMENT_CTX {
+  Gpu_t gpu;
+  Kernel_t kernel;
+  Block_t block;
+  volatile unsigned long long sink;   // keeps the timed results alive
+} PlacementCtx_t;
+
+static void reset(void* p) {
+  PlacementCtx_t* ctx = p;
+  reset_GPU(&ctx->gpu);
+}
+
+static void reset_and_place(void* p) {
+  PlacementCtx_t* ctx = p;
+  reset_GPU(&ctx->gpu);
+  place_kernel_blocks(&ctx->gpu, &ctx->kernel);
+}
+
+// launch_one_kernel() is this plus one printf of the result
+static void run_place(void* p) {
+  PlacementCtx_t* ctx = p;
+  ctx->sink += place_kernel_blocks(&ctx->gpu, &ctx->kernel);
+}
+
+// The cheapest observer a profiler could attach, so its case times the events alone
+static void count_event(const PlacementEvent_t* event, void* context) {
+  (void)event;
+  (*(unsigned long long*)context)++;
+}
+
+static void run_clear(void* p) {
+  PlacementCtx_t* ctx = p;
+  clear_kernel_blocks(&ctx->gpu, &ctx->kernel);
+}
+
+static void run_can_fit(void* p) {
+  PlacementCtx_t* ctx = p;
+  unsigned long long fits = 0;
+  for (unsigned int i = 0; i < ctx->gpu.number_of_SMs; i++) {
+    fits += canFitBlock(&ctx->gpu, i, &ctx->block);
+  }
+  ctx->sink += fits;
+}
+
+static void run_occupancy(void* p) {
+  PlacementCtx_t* ctx = p;
+  double total = 0.0;
+  for (unsigned int i = 0; i < ctx->gpu.number_of_SMs; i++) {
+    total += calculate_occupancy_of_SM(&ctx->gpu, i);
+  }
+  ctx->sink += (unsigned long long)total;
+}
+
+static int reps_for(double work) {
+  double reps = WORK_PER_CASE / (work > 1 ? work : 1);
+  if (reps < MIN_REPS) return MIN_REPS;
+  if (reps > MAX_REPS) return MAX_REPS;
+  return (int)reps;
+}
+
+static void bench(const char* name, void (*setup)(void*), void (*run)(void*), PlacementCtx_t* ctx,
+                  unsigned long long placed, double ops, double work, const char* unit) {
+  BenchCase_t c = {
+    .name = name,
+    .setup = setup,
+    .run = run,
+    .ctx = ctx,
+    .ops = ops,
+    .warmup = WARMUP,
+    .reps = reps_for(work),
+  };
+  BenchResult_t result = run_bench_case(&c);
+
+  char params[160];
+  snprintf(params, sizeof(params), "\"sms\":%u,\"blocks\":%u,\"placed\":%llu,\"op\":\"%s\"",
+           ctx->gpu.number_of_SMs, ctx->kernel.number_of_blocks, placed, unit);
+  print_bench_result(&c, params, &result);
+}
+
+int main(void) {
+  PlacementCtx_t ctx = {
+    .kernel = {
+      .name = "bench",
+      .threads_per_block = 128,
+      .shared_mem_used_in_bytes_per_block = 4096,
+      .registers_per_thread = 32,
+    },
+  };
+  ctx.block = (Block_t){
+    .kernel_name = ctx.kernel.name,
+    .number_of_thread = ctx.kernel.threads_per_block,
+    .shared_mem_used_in_bytes = ctx.kernel.shared_mem_used_in_bytes_per_block,
+    .number_of_registers_used_per_thread = ctx.kernel.registers_per_thread,
+  };
+
+  for (size_t s = 0; s < sizeof(sm_counts) / sizeof(sm_counts[0]); s++) {
+    ctx.gpu = new_GPU("bench_gpu", 85899345920ul, SHARED_PER_SM, REGISTERS_PER_SM,
+                      WARPS_PER_SM, BLOCKS_PER_SM, sm_counts[s]);
+
+    for (size_t b = 0; b < sizeof(block_counts) / sizeof(block_counts[0]); b++) {
+      ctx.kernel.number_of_blocks = block_counts[b];
+
+      // Blocks actually placed bound the work of a launch, not the blocks asked for
+      reset_and_place(&ctx);
+      unsigned long long placed = 0;
+      for (unsigned int i = 0; i < ctx.gpu.number_of_SMs; i++) {
+        placed += ctx.gpu.list_of_SMs[i].number_of_blocks;
+      }
+      double sms = sm_counts[s];
+      double work = sms + placed;
+      // Placement stops once the GPU is full, so time it per block placed
+      double blocks = placed ? placed : 1;
+
+      bench("place_kernel_blocks", reset, run_place, &ctx, placed, blocks, work, "placed_block");
+      unsigned long long events = 0;
+      add_placement_observer(count_event, &events);
+      bench("place_kernel_blocks_observed", reset, run_place, &ctx, placed, blocks, work, "placed_block");
+      remove_placement_observer(count_event, &events);
+      bench("clear_kernel_blocks", reset_and_place, run_clear, &ctx, placed, sms, work, "SM");
+
+      // The read-only cases see the GPU as the launch left it
+      reset_and_place(&ctx);
+      bench("canFitBlock", NULL, run_can_fit, &ctx, placed, sms, sms, "SM");
+      bench("calculate_occupancy_of_SM", NULL, run_occupancy, &ctx, placed, sms, work, "SM");
+    }
+
+    free_GPU(&ctx.gpu);
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "cuda_arch.h"
+#include "gpu_presets.h"
+
+// Shapes mixed on the SMs filled for the calculate_occupancy_of_SM() comparison
+#define SHAPES 4
+#define SMS 4096
+#define SM_ROUNDS 50
+
+int main(void) {
+  unsigned int* threads = malloc(sizeof(unsigned int) * SHAPES);
+  unsigned int* regs = malloc(sizeof(unsigned int) * SHAPES);
+  unsigned int* shared = malloc(sizeof(unsigned int) * SHAPES);
+  if (!threads || !regs || !shared) {
+    perror("Memory allocation failed");
+    return 1;
+  }
+
+  for (int i = 0; i < SHAPES; i++) {
+    threads[i] = 32 * (1 + next_random(32));
+    regs[i] = 16 + next_random(240);
+    shared[i] = next_random(49) * 1024;
+  }
+
+  int mismatches = 0;
+  const char* names[] = { "GPU_Low_resources", "GPU_mid_resources", "GPU_high_resources" };
+  unsigned int limits[][4] = {
+    {  49152,  65536, 64,  8 },
+    {  98304, 131072, 64, 16 },
+    { 131072, 256000, 64, 32 },
+  };
+
+  for (int g = 0; g < 3; g++) {
+    Gpu_t gpu = new_GPU((char*)names[g], 0, limits[g][0], limits[g][1], limits[g][2], limits[g][3], SMS);
+    const GpuPreset_t* preset = find_gpu_preset(&gpu);
+    if (!preset) {
+      fprintf(stderr, "No preset for %s\n", names[g]);
+      return 1;
+    }
+
+    // Fill every SM with a mix of shapes, then compare the SM occupancy paths
+    for (int k = 0; k < SHAPES; k++) {
+      Kernel_t kernel = {
+        .name = "bench",
+        .number_of_blocks = SMS * 4,
+        .threads_per_block = threads[k],
+        .shared_mem_used_in_bytes_per_block = shared[k] / 4,
+        .registers_per_thread = regs[k] / 4,
+      };
+      place_kernel_blocks(&gpu, &kernel);
+    }
+
+    double sum_generic = 0.0, sum_preset = 0.0;
+    double start = now_seconds();
+    for (int r = 0; r < SM_ROUNDS; r++) {
+      for (int i = 0; i < SMS; i++) sum_generic += calculate_occupancy_of_SM(&gpu, i);
+    }
+    double generic = now_seconds() - start;
+
+    start = now_seconds();
+    for (int r = 0; r < SM_ROUNDS; r++) {
+      for (int i = 0; i < SMS; i++) sum_preset += preset->calculate_occupancy_of_SM(&gpu.list_of_SMs[i]);
+    }
+    double specialized = now_seconds() - start;
+    if (sum_generic != sum_preset) mismatches++;
+
+    printf("{\"bench\":\"calculate_occupancy_of_SM\",\"gpu\":\"%s\",\"generic_ns_per_sm\":%.3f,"
+           "\"preset_ns_per_sm\":%.3f}\n",
+           preset->name, generic * 1e9 / ((double)SMS * SM_ROUNDS),
+           specialized * 1e9 / ((double)SMS * SM_ROUNDS));
+
+    free_GPU(&gpu);
+  }
+
+  printf("{\"bench\":\"presets\",\"mismatches\":%d}\n", mismatches);
+
+  free(threads);
+  free(regs);
+  free(shared);
+  return mismatches ? 1 : 0;
+}
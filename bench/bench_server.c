@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bench.h"
+#include "cuda_arch.h"
+#include "query.h"
+#include "server.h"
+
+// Load test of the query server: CLIENTS connections, each sending QUERIES
+// queries one at a time (latency), then in pipelined batches (throughput)
+#define CLIENTS 4
+#define QUERIES 20000
+#define PIPELINE 64
+#define WORKERS 4
+
+typedef struct CLIENT {
+  char socket_path[108];
+  char* queries;             // QUERIES lines
+  size_t* offsets;           // start of each line, plus the end
+  double* latency;           // seconds per query, one at a time
+  int answers_ok;
+} Client_t;
+
+static int connect_to(const char* path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    perror("Failed to connect to the query server");
+    exit(1);
+  }
+  return fd;
+}
+
+// Reads until `lines` answers arrived; returns how many are not errors
+static int read_answers(int fd, int lines) {
+  char buf[64 * 1024];
+  int seen = 0, ok = 0;
+  bool line_start = true;
+  while (seen < lines) {
+    ssize_t got = read(fd, buf, sizeof(buf));
+    if (got <= 0) {
+      if (got < 0 && errno == EINTR) continue;
+      fprintf(stderr, "Query server closed the connection early\n");
+      exit(1);
+    }
+    for (ssize_t i = 0; i < got; i++) {
+      if (line_start && buf[i] == '{') ok += strncmp(buf + i, "{\"error", 7) != 0;
+      line_start = buf[i] == '\n';
+      seen += line_start;
+    }
+  }
+  return ok;
+}
+
+static void send_all(int fd, const char* data, size_t length) {
+  while (length) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      perror("Failed to send queries");
+      exit(1);
+    }
+    data += written;
+    length -= written;
+  }
+}
+
+static void* one_at_a_time(void* arg) {
+  Client_t* client = arg;
+  int fd = connect_to(client->socket_path);
+  for (int q = 0; q < QUERIES; q++) {
+    double start = now_seconds();
+    send_all(fd, client->queries + client->offsets[q], client->offsets[q + 1] - client->offsets[q]);
+    client->answers_ok += read_answers(fd, 1);
+    client->latency[q] = now_seconds() - start;
+  }
+  close(fd);
+  return NULL;
+}
+
+static void* pipelined(void* arg) {
+  Client_t* client = arg;
+  int fd = connect_to(client->socket_path);
+  for (int q = 0; q < QUERIES; q += PIPELINE) {
+    int batch = QUERIES - q < PIPELINE ? QUERIES - q : PIPELINE;
+    send_all(fd, client->queries + client->offsets[q], client->offsets[q + batch] - client->offsets[q]);
+    read_answers(fd, batch);
+  }
+  close(fd);
+  return NULL;
+}
+
+static double run_clients(Client_t* clients, void* (*body)(void*)) {
+  pthread_t threads[CLIENTS];
+  double start = now_seconds();
+  for (int c = 0; c < CLIENTS; c++) pthread_create(&threads[c], NULL, body, &clients[c]);
+  for (int c = 0; c < CLIENTS; c++) pthread_join(threads[c], NULL);
+  return now_seconds() - start;
+}
+
+// Mostly occupancy lookups, some block size searches and small placements
+static void make_queries(Client_t* client) {
+  client->queries = malloc((size_t)QUERIES * 160);
+  client->offsets = malloc(sizeof(size_t) * (QUERIES + 1));
+  client->latency = malloc(sizeof(double) * QUERIES);
+  if (!client->queries || !client->offsets || !client->latency) {
+    perror("Memory allocation failed");
+    exit(1);
+  }
+
+  static const char* gpus[] = { "bench_small", "bench_large" };
+  size_t used = 0;
+  for (int q = 0; q < QUERIES; q++) {
+    unsigned int kind = next_random(10);
+    const char* op = kind < 7 ? "occupancy" : kind < 9 ? "best_block_size" : "placement";
+    client->offsets[q] = used;
+    used += sprintf(client->queries + used,
+      "{\"id\":%d,\"op\":\"%s\",\"gpu\":\"%s\",\"threads\":%u,\"registers\":%u,\"shared_mem\":%u,\"blocks\":%u}\n",
+      q, op, gpus[next_random(2)], 32 * (1 + next_random(32)), 16 + next_random(112),
+      next_random(33) * 1024, 1 + next_random(256));
+  }
+  client->offsets[QUERIES] = used;
+}
+
+int main(void) {
+  Gpu_t gpus[2] = {
+    new_GPU("bench_small", 8589934592ul, 65536, 65536, 64, 16, 40),
+    new_GPU("bench_large", 17179869184ul, 131072, 256000, 64, 32, 132),
+  };
+  QueryEngine_t engine;
+  if (new_query_engine(&engine, gpus, 2) != 0) return 1;
+
+  Client_t clients[CLIENTS] = {0};
+  char socket_path[108];
+  snprintf(socket_path, sizeof(socket_path), "/tmp/gpusim_bench_%d.sock", (int)getpid());
+  for (int c = 0; c < CLIENTS; c++) {
+    strcpy(clients[c].socket_path, socket_path);
+    make_queries(&clients[c]);
+  }
+
+  QueryServer_t server;
+  if (start_query_server(&server, socket_path, &engine, WORKERS) != 0) return 1;
+
+  double latency_elapsed = run_clients(clients, one_at_a_time);
+  double pipelined_elapsed = run_clients(clients, pipelined);
+  stop_query_server(&server);
+
+  double* latency = malloc(sizeof(double) * CLIENTS * QUERIES);
+  int ok = 0;
+  for (int c = 0; c < CLIENTS; c++) {
+    memcpy(latency + (size_t)c * QUERIES, clients[c].latency, sizeof(double) * QUERIES);
+    ok += clients[c].answers_ok;
+  }
+  qsort(latency, (size_t)CLIENTS * QUERIES, sizeof(double), compare_doubles);
+
+  double total = (double)CLIENTS * QUERIES;
+  printf("{\"bench\":\"query_server\",\"clients\":%d,\"workers\":%d,\"queries\":%.0f,"
+         "\"p50_us\":%.2f,\"p99_us\":%.2f,\"qps\":%.0f,\"pipelined_qps\":%.0f,\"answered\":%d}\n",
+         CLIENTS, WORKERS, total,
+         latency[(size_t)(total * 0.50)] * 1e6, latency[(size_t)(total * 0.99)] * 1e6,
+         total / latency_elapsed, total / pipelined_elapsed, ok);
+
+  for (int c = 0; c < CLIENTS; c++) {
+    free(clients[c].queries);
+    free(clients[c].offsets);
+    free(clients[c].latency);
+  }
+  free(latency);
+  free_query_engine(&engine);
+  free_GPU(&gpus[0]);
+  free_GPU(&gpus[1]);
+  return ok == (int)total ? 0 : 1;
+}
@@ -2,169 +2,746 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
 #include "cuda_arch.h"
-#include "cJSON.h"
+#include "config.h"
+#include "occupancy_tables.h"
+#include "result_cache.h"
+#include "snapshot.h"
+#include "incremental.h"
+#include "server.h"
+#include "records.h"
+#include "report.h"
+#include "heatmap.h"
+#include "diff.h"
+#include "trace.h"
+#include "stats.h"
+#include "perf_counters.h"
+#include "metrics.h"
+#include "devmem.h"
+#include "timeline.h"
 
 #define CONFIG_FILE "config.json"
 
-void load_config(const char *filename, Gpu_t **gpus, int *gpu_count, Kernel_t **kernels, int *kernel_count) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        perror("Failed to open config file");
-        exit(1);
-    }
+typedef struct OPTIONS {
+  const char* config_path;
+  bool export_tables;
+  const char* cache_path;
+  bool incremental;
+  bool watch;
+  const char* socket_path;   // serve queries instead of simulating
+  int threads;
+  bool stream;
+  bool json;
+  bool csv;
+  HtmlMode_t html;
+  bool heatmap;
+  bool trace;
+  const char* diff_before;   // compare two runs instead of simulating
+  const char* diff_after;
+  DiffThresholds_t thresholds;
+  bool stats;
+  bool stats_json;
+  bool perf;
+  const char* metrics_path;  // Prometheus textfile, rewritten while running
+  int metrics_interval;
+  int metrics_port;
+  bool set_allocator;        // --allocator overrides the config's
+  Allocator_t allocator;
+  bool timeline;
+  unsigned short graph_size;  // --graph overrides the config's
+} Options_t;
 
-    fseek(fp, 0, SEEK_END);
-    long len = ftell(fp);
-    rewind(fp);
+// Hardware counters of each phase, read only with --perf
+static PerfCounters_t perf;
 
-    char *data = malloc(len + 1);
-    if (!data) {
-        fprintf(stderr, "Memory allocation failed\n");
-        fclose(fp);
-        exit(1);
-    }
+// Running with --metrics or --metrics-port
+static MetricsExporter_t exporter;
+static bool exporting;
 
-    fread(data, 1, len, fp);
-    data[len] = '\0';
-    fclose(fp);
+static void print_usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --config=FILE   read GPUs and kernels from FILE (default " CONFIG_FILE ")\n"
+          "  --tables        write occupancy lookup tables for every GPU to results/ and exit\n"
+          "  --cache[=FILE]  reuse placements stored in FILE (default " RESULT_CACHE_FILE ")\n"
+          "  --incremental   only re-simulate what changed since the previous run\n"
+          "  --watch         re-simulate incrementally each time the config is saved\n"
+          "  --serve[=SOCK]  answer occupancy queries on a Unix socket (default " QUERY_SOCKET_FILE ")\n"
+          "  --threads=N     query server worker threads (default: one per CPU)\n"
+          "  --stream        answer JSON-lines queries from stdin on stdout\n"
+          "  --json          also write per-GPU, per-SM and per-kernel records to " RECORDS_JSON_FILE "\n"
+          "  --csv           also write the same records to results/gpus.csv, sms.csv and kernels.csv\n"
+          "  --html=MODE     report layout: full, one element per block (default), compact,\n"
+          "                  one segment per kernel on each SM, or compact,details, which\n"
+          "                  adds a per-kernel table under each SM\n"
+          "  --heatmap       also write " HEATMAP_FILE ", one canvas heatmap of every SM\n"
+          "  --trace         also write " TRACE_FILE ", a Chrome trace of the launches\n"
+          "  --diff OLD NEW  compare two results.json files or configs and exit with 1 on\n"
+          "                  lower occupancy or fewer blocks placed\n"
+          "  --max-occupancy-drop=PCT  occupancy points --diff tolerates (default 0)\n"
+          "  --max-blocks-drop=N       blocks placed --diff tolerates losing (default 0)\n"
+          "  --stats[=json]  print hot-path counters and phase times at exit, as text or\n"
+          "                  JSON (needs a build with make STATS=1)\n"
+          "  --perf          print cycles, instructions, IPC, cache and branch misses of\n"
+          "                  each phase at exit (Linux perf_event_open)\n"
+          "  --metrics=FILE  keep Prometheus metrics in FILE for node_exporter's textfile\n"
+          "                  collector, rewritten every --metrics-interval=SEC (default %d)\n"
+          "  --metrics-port=PORT  answer Prometheus scrapes on 127.0.0.1:PORT\n"
+          "  --allocator=KIND  device memory allocator of every GPU: first-fit (default),\n"
+          "                  bump or caching\n"
+          "  --timeline      print the stream timeline of every GPU: kernel and copy times\n"
+          "                  and the transfer time hidden behind compute (on by default\n"
+          "                  when kernels have copies or durations)\n"
+          "  --graph=N       submit the timeline's kernels as graphs of N, instead of one\n"
+          "                  launch call each (implies --timeline)\n",
+          program, METRICS_INTERVAL);
+}
 
-    cJSON *root = cJSON_Parse(data);
-    if (!root) {
-        fprintf(stderr, "Error parsing JSON: %s\n", cJSON_GetErrorPtr());
-        free(data);
+static void parse_args(int argc, char** argv, Options_t* options) {
+  for (int i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "--config=", 9)) {
+      options->config_path = argv[i] + 9;
+    } else if (!strcmp(argv[i], "--tables")) {
+      options->export_tables = true;
+    } else if (!strcmp(argv[i], "--cache")) {
+      options->cache_path = RESULT_CACHE_FILE;
+    } else if (!strncmp(argv[i], "--cache=", 8)) {
+      options->cache_path = argv[i] + 8;
+    } else if (!strcmp(argv[i], "--incremental")) {
+      options->incremental = true;
+    } else if (!strcmp(argv[i], "--watch")) {
+      options->watch = true;
+    } else if (!strcmp(argv[i], "--serve")) {
+      options->socket_path = QUERY_SOCKET_FILE;
+    } else if (!strncmp(argv[i], "--serve=", 8)) {
+      options->socket_path = argv[i] + 8;
+    } else if (!strncmp(argv[i], "--threads=", 10)) {
+      options->threads = atoi(argv[i] + 10);
+    } else if (!strcmp(argv[i], "--stream")) {
+      options->stream = true;
+    } else if (!strcmp(argv[i], "--json")) {
+      options->json = true;
+    } else if (!strcmp(argv[i], "--csv")) {
+      options->csv = true;
+    } else if (!strcmp(argv[i], "--diff") && i + 2 < argc) {
+      options->diff_before = argv[++i];
+      options->diff_after = argv[++i];
+    } else if (!strncmp(argv[i], "--max-occupancy-drop=", 21)) {
+      options->thresholds.occupancy = atof(argv[i] + 21) / 100.0;
+    } else if (!strncmp(argv[i], "--max-blocks-drop=", 18)) {
+      options->thresholds.blocks = strtoull(argv[i] + 18, NULL, 10);
+    } else if (!strcmp(argv[i], "--trace")) {
+      options->trace = true;
+    } else if (!strcmp(argv[i], "--stats") || !strcmp(argv[i], "--stats=json")) {
+#ifndef GPUSIM_STATS
+      fprintf(stderr, "--stats needs counters compiled in: rebuild with make clean && make STATS=1\n");
+      exit(1);
+#endif
+      options->stats = true;
+      options->stats_json = argv[i][7] == '=';
+    } else if (!strcmp(argv[i], "--perf")) {
+      options->perf = true;
+    } else if (!strncmp(argv[i], "--metrics=", 10)) {
+      options->metrics_path = argv[i] + 10;
+    } else if (!strncmp(argv[i], "--metrics-interval=", 19)) {
+      options->metrics_interval = atoi(argv[i] + 19);
+    } else if (!strncmp(argv[i], "--metrics-port=", 15)) {
+      options->metrics_port = atoi(argv[i] + 15);
+    } else if (!strncmp(argv[i], "--allocator=", 12)) {
+      if (parse_allocator(argv[i] + 12, &options->allocator) != 0) {
+        fprintf(stderr, "Unknown allocator: %s\n", argv[i] + 12);
+        print_usage(argv[0]);
         exit(1);
+      }
+      options->set_allocator = true;
+    } else if (!strcmp(argv[i], "--timeline")) {
+      options->timeline = true;
+    } else if (!strncmp(argv[i], "--graph=", 8)) {
+      int size = atoi(argv[i] + 8);
+      if (size < 1 || size > 0xffff) {
+        fprintf(stderr, "Graph size must be 1 to 65535: %s\n", argv[i] + 8);
+        exit(1);
+      }
+      options->graph_size = size;
+      options->timeline = true;
+    } else if (!strcmp(argv[i], "--heatmap")) {
+      options->heatmap = true;
+    } else if (!strncmp(argv[i], "--html=", 7)) {
+      if (parse_html_mode(argv[i] + 7, &options->html) != 0) {
+        fprintf(stderr, "Unknown report layout: %s\n", argv[i] + 7);
+        print_usage(argv[0]);
+        exit(1);
+      }
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      print_usage(argv[0]);
+      exit(1);
     }
+  }
+}
 
-    // --- GPUs ---
-    cJSON *gpu_array = cJSON_GetObjectItem(root, "gpus");
-    if (!cJSON_IsArray(gpu_array)) {
-        fprintf(stderr, "Error: 'gpus' field missing or not an array\n");
-        cJSON_Delete(root);
-        free(data);
-        exit(1);
+// Loads the config and applies the options that change its GPUs
+static int load_GPUs(const Options_t* options, Gpu_t** gpus, int* gpu_count,
+                     Kernel_t** kernels, int* kernel_count) {
+  if (load_config(options->config_path, gpus, gpu_count, kernels, kernel_count) != 0) return -1;
+  // Skipped entries would reach the reports without a name
+  drop_skipped_entries(*gpus, gpu_count, *kernels, kernel_count);
+  for (int g = 0; g < *gpu_count; g++) {
+    if (options->set_allocator) (*gpus)[g].allocator = options->allocator;
+    if (options->graph_size) (*gpus)[g].graph_size = options->graph_size;
+  }
+  return 0;
+}
+
+// Placements that can stand in for launching kernels
+typedef struct REUSE {
+  ResultCache_t* cache;             // NULL unless --cache
+  const unsigned int* state;        // previous run of this GPU, or NULL
+  size_t state_words;
+  int kernel_count;                 // leading kernels of state still valid
+} Reuse_t;
+
+// Launches every kernel on the GPU, restoring from the cache when the same
+// GPU limits and kernels were simulated before, or else restoring the
+// kernels that did not change since the previous run and launching the rest.
+// Device memory is modelled when kernels allocate it; restored kernels
+// replay their allocations. Returns the encoded placement when out_state
+// is given.
+static void simulate_GPU(Gpu_t* gpu, Kernel_t* kernels, int kernel_count,
+                         unsigned int* dropped, const Reuse_t* reuse,
+                         unsigned int** out_state, size_t* out_state_words) {
+  unsigned long long start = metrics_now_ns();
+  size_t key_words = 0, value_words = 0;
+  uint32_t* key = reuse->cache ? cache_key_of_GPU(gpu, kernels, kernel_count, &key_words) : NULL;
+  const uint32_t* value = key ? result_cache_lookup(reuse->cache, key, key_words, &value_words) : NULL;
+  bool cache_hit = value && restore_GPU_state(gpu, kernels, kernel_count, value, value_words, dropped) == 0;
+  if (key) metrics_add(cache_hit ? &metrics.cache_hits : &metrics.cache_misses, 1);
+
+  int first = 0;
+  if (cache_hit) {
+    printf("Placement taken from the result cache\n");
+    first = kernel_count;
+  } else if (reuse->state && reuse->kernel_count > 0 &&
+             restore_GPU_state(gpu, kernels, reuse->kernel_count,
+                               reuse->state, reuse->state_words, dropped) == 0) {
+    printf("Placement of %d unchanged kernels taken from the previous run\n", reuse->kernel_count);
+    first = reuse->kernel_count;
+  } else {
+    reset_GPU(gpu);
+  }
+
+  DevMemory_t memory;
+  bool model_memory = kernels_use_device_memory(kernels, kernel_count);
+  if (model_memory && init_device_memory(&memory, gpu) != 0) {
+    perror("Failed to allocate device memory blocks");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int k = 0; k < first; k++) {
+    if (model_memory && !allocate_kernel_memory(&memory, &kernels[k])) {
+      print_kernel_out_of_memory(gpu, &memory, &kernels[k]);
+    } else {
+      print_kernel_launch_result(gpu, &kernels[k], dropped[k]);
     }
+  }
+  metrics_queue_streams(kernels + first, kernel_count - first);
+  for (int k = first; k < kernel_count; k++) {
+    dropped[k] = launch_kernel_with_memory(gpu, model_memory ? &memory : NULL, &kernels[k]);
+    metrics_dequeue_stream(kernels[k].stream_id);
+  }
+  if (model_memory && memory.failed) {
+    perror("Failed to allocate device memory blocks");
+    exit(EXIT_FAILURE);
+  }
+  if (model_memory) {
+    print_device_memory(gpu, &memory);
+    free_device_memory(&memory);
+  }
 
-    *gpu_count = cJSON_GetArraySize(gpu_array);
-    *gpus = malloc(sizeof(Gpu_t) * (*gpu_count));
-    if (!*gpus) {
-        fprintf(stderr, "Memory allocation failed for GPUs\n");
-        cJSON_Delete(root);
-        free(data);
-        exit(1);
+  if ((key && !cache_hit) || out_state) {
+    size_t state_words = 0;
+    unsigned int* state = encode_GPU_state(gpu, kernels, kernel_count, dropped, &state_words);
+    if (state && key && !cache_hit) {
+      result_cache_insert(reuse->cache, key, key_words, state, state_words);
     }
+    if (out_state) {
+      *out_state = state;
+      *out_state_words = state ? state_words : 0;
+    } else {
+      free(state);
+    }
+  }
+  free(key);
+  metrics_add(&metrics.simulations, 1);
+  metrics_observe(&metrics.gpu_placement, metrics_now_ns() - start);
+}
 
-    for (int i = 0; i < *gpu_count; i++) {
-        cJSON *gpu = cJSON_GetArrayItem(gpu_array, i);
-        if (!cJSON_IsObject(gpu)) {
-            fprintf(stderr, "Warning: GPU[%d] is not a valid object, skipping\n", i);
-            continue;
-        }
+// Everything written about each GPU besides its HTML report
+typedef struct REPORTS {
+  HtmlMode_t html;
+  bool use_index;
+  ReportIndex_t index;
+  bool use_records;
+  ResultRecords_t records;
+  bool use_heatmap;
+  Heatmap_t heatmap;
+  bool use_trace;
+  Trace_t trace;
+  bool timeline;            // printed after each GPU
+} Reports_t;
+
+// Opens the index and the reports requested in options; one that cannot be
+// opened is skipped
+static void open_reports(const Options_t* options, Reports_t* reports,
+                         const Kernel_t* kernels, int kernel_count) {
+  reports->html = options->html;
+  reports->use_index = open_report_index(&reports->index, kernels, kernel_count) == 0;
+  reports->use_records = (options->json || options->csv) &&
+    open_result_records(&reports->records, options->json, options->csv) == 0;
+  reports->use_heatmap = options->heatmap && open_heatmap(&reports->heatmap) == 0;
+  reports->use_trace = options->trace && open_trace(&reports->trace) == 0;
+  reports->timeline = options->timeline || kernels_use_timeline(kernels, kernel_count);
+}
+
+// Returns -1 when any report could not be written
+static int close_reports(Reports_t* reports) {
+  int status = 0;
+  if (reports->use_index && close_report_index(&reports->index) != 0) status = -1;
+  if (reports->use_records && close_result_records(&reports->records) != 0) status = -1;
+  if (reports->use_heatmap && close_heatmap(&reports->heatmap) != 0) status = -1;
+  if (reports->use_trace && close_trace(&reports->trace) != 0) status = -1;
+  reports->use_index = reports->use_records = reports->use_heatmap = reports->use_trace = false;
+  return status;
+}
 
-        cJSON *j_name = cJSON_GetObjectItem(gpu, "name");
-        cJSON *j_mem = cJSON_GetObjectItem(gpu, "memory_bytes");
-        cJSON *j_shared = cJSON_GetObjectItem(gpu, "shared_mem_per_sm");
-        cJSON *j_regs = cJSON_GetObjectItem(gpu, "registers_per_sm");
-        cJSON *j_warps = cJSON_GetObjectItem(gpu, "max_warps_per_sm");
-        cJSON *j_blocks = cJSON_GetObjectItem(gpu, "max_blocks_per_sm");
-        cJSON *j_sms = cJSON_GetObjectItem(gpu, "num_sms");
-
-        if (!cJSON_IsString(j_name) || !cJSON_IsNumber(j_mem) || !cJSON_IsNumber(j_shared) ||
-            !cJSON_IsNumber(j_regs) || !cJSON_IsNumber(j_warps) ||
-            !cJSON_IsNumber(j_blocks) || !cJSON_IsNumber(j_sms)) {
-            fprintf(stderr, "Warning: GPU[%d] missing one or more fields, skipping\n", i);
-            continue;
+// True when a GPU whose HTML report is kept must still be added to the others
+static bool reports_need_placement(const Reports_t* reports) {
+  return reports->use_index || reports->use_records || reports->use_heatmap || reports->use_trace;
+}
+
+// The stream timeline does not depend on placement, so kept GPUs print it too
+static void print_GPU_timeline(const Reports_t* reports, Gpu_t* gpu, Kernel_t* kernels, int kernel_count) {
+  if (!reports->timeline) return;
+  TimelineStats_t timeline;
+  if (simulate_timeline(gpu, kernels, kernel_count, &timeline) != 0) {
+    perror("Failed to simulate the timeline");
+    exit(EXIT_FAILURE);
+  }
+  print_timeline(gpu, &timeline);
+}
+
+// Adds a simulated GPU to the reports that cover every GPU
+static void add_to_reports(Reports_t* reports, Gpu_t* gpu, Kernel_t* kernels, int kernel_count,
+                           const unsigned int* dropped) {
+  if (reports->use_index) add_GPU_to_report_index(&reports->index, gpu, kernels, kernel_count, dropped);
+  if (reports->use_records) write_GPU_records(&reports->records, gpu, kernels, kernel_count, dropped);
+  if (reports->use_heatmap) add_GPU_to_heatmap(&reports->heatmap, gpu);
+  if (reports->use_trace) add_GPU_to_trace(&reports->trace, gpu, kernels, kernel_count, dropped);
+}
+
+// Simulates every GPU and writes its reports, freeing each GPU once done.
+// With run states, a GPU unchanged since `previous` keeps its HTML report
+// and the placements are recorded in `current`. Returns the number of GPUs
+// simulated.
+static int run_simulation(Gpu_t* gpus, int gpu_count, Kernel_t* kernels, int kernel_count,
+                          ResultCache_t* cache, const RunState_t* previous,
+                          RunState_t* current, Reports_t* reports, bool interactive) {
+  unsigned int* dropped = calloc(kernel_count ? kernel_count : 1, sizeof(unsigned int));
+  if (!dropped) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(1);
+  }
+
+  int simulated = 0;
+  char dummy;
+  for (int g = 0; g < gpu_count; g++) {
+    Reuse_t reuse = { .cache = cache };
+    unsigned int* state = NULL;
+    size_t state_words = 0;
+    uint32_t* signature = NULL;
+    size_t signature_words = 0;
+
+    if (current) {
+      signature = signature_of_GPU(&gpus[g], kernels, kernel_count, &signature_words);
+      const GpuRecord_t* record = find_gpu_record(previous, gpus[g].name, g);
+
+      if (record && signature &&
+          same_signature(record->signature, record->signature_words, signature, signature_words) &&
+          report_exists(&gpus[g], reports->html)) {
+        printf("\n%s unchanged since the previous run, keeping its report\n", gpus[g].name);
+        // The reports covering every GPU still need its placement
+        STATS_TIMER(export);
+        perf_phase_begin(&perf, PHASE_EXPORT);
+        if (reports_need_placement(reports) &&
+            restore_GPU_state(&gpus[g], kernels, kernel_count,
+                              record->state, record->state_words, dropped) == 0) {
+          add_to_reports(reports, &gpus[g], kernels, kernel_count, dropped);
         }
+        perf_phase_end(&perf, PHASE_EXPORT);
+        STATS_PHASE_END(PHASE_EXPORT, export);
+        print_GPU_timeline(reports, &gpus[g], kernels, kernel_count);
+        copy_gpu_record(current, g, record);
+        metrics_add(&metrics.gpus_unchanged, 1);
+        free(signature);
+        free_GPU(&gpus[g]);
+        continue;
+      }
 
-        (*gpus)[i] = new_GPU(
-            j_name->valuestring,
-            (unsigned long) j_mem->valuedouble,
-            j_shared->valueint,
-            j_regs->valueint,
-            j_warps->valueint,
-            j_blocks->valueint,
-            j_sms->valueint
-        );
+      if (record && signature) {
+        reuse.state = record->state;
+        reuse.state_words = record->state_words;
+        reuse.kernel_count = first_changed_kernel(record->signature, record->signature_words,
+                                                  signature, signature_words);
+      }
     }
 
-    // --- Kernels ---
-    cJSON *kernel_array = cJSON_GetObjectItem(root, "kernels");
-    if (!cJSON_IsArray(kernel_array)) {
-        fprintf(stderr, "Error: 'kernels' field missing or not an array\n");
-        cJSON_Delete(root);
-        free(data);
-        exit(1);
+    printf("\n==============================\n");
+    printf("Launching kernels on %s\n", gpus[g].name);
+    printf("==============================\n");
+
+    STATS_TIMER(placement);
+    perf_phase_begin(&perf, PHASE_PLACEMENT);
+    simulate_GPU(&gpus[g], kernels, kernel_count, dropped, &reuse,
+                 current ? &state : NULL, &state_words);
+    print_GPU_timeline(reports, &gpus[g], kernels, kernel_count);
+    if (current) {
+      set_gpu_record(current, g, gpus[g].name, signature, signature_words, state, state_words);
     }
+    perf_phase_end(&perf, PHASE_PLACEMENT);
+    STATS_PHASE_END(PHASE_PLACEMENT, placement);
 
-    *kernel_count = cJSON_GetArraySize(kernel_array);
-    *kernels = malloc(sizeof(Kernel_t) * (*kernel_count));
-    if (!*kernels) {
-        fprintf(stderr, "Memory allocation failed for kernels\n");
-        cJSON_Delete(root);
-        free(data);
-        exit(1);
+    if (interactive) {
+      printf("\nPress ENTER to display info for %s...", gpus[g].name);
+      fflush(stdout);
+      while ((dummy = getchar()) != '\n' && dummy != EOF);
+
+      // Timed after the wait for ENTER
+      STATS_TIMER(reporting);
+      perf_phase_begin(&perf, PHASE_REPORTING);
+      print_GPU_info(&gpus[g]);
+      perf_phase_end(&perf, PHASE_REPORTING);
+      STATS_PHASE_END(PHASE_REPORTING, reporting);
     }
+    STATS_TIMER(export);
+    perf_phase_begin(&perf, PHASE_EXPORT);
+    export_GPU_report(&gpus[g], reports->html);
+    add_to_reports(reports, &gpus[g], kernels, kernel_count, dropped);
+    perf_phase_end(&perf, PHASE_EXPORT);
+    STATS_PHASE_END(PHASE_EXPORT, export);
+    free_GPU(&gpus[g]);
+    simulated++;
+  }
 
-    for (int i = 0; i < *kernel_count; i++) {
-        cJSON *k = cJSON_GetArrayItem(kernel_array, i);
-        if (!cJSON_IsObject(k)) {
-            fprintf(stderr, "Warning: Kernel[%d] is not a valid object, skipping\n", i);
-            continue;
-        }
+  free(dropped);
+  return simulated;
+}
 
-        cJSON *j_name = cJSON_GetObjectItem(k, "name");
-        cJSON *j_blocks = cJSON_GetObjectItem(k, "number_of_blocks");
-        cJSON *j_threads = cJSON_GetObjectItem(k, "threads_per_block");
-        cJSON *j_shared = cJSON_GetObjectItem(k, "shared_mem_used_in_bytes_per_block");
-        cJSON *j_regs = cJSON_GetObjectItem(k, "registers_per_thread");
-        cJSON *j_stream = cJSON_GetObjectItem(k, "stream_id");
-
-        if (!cJSON_IsString(j_name) || !cJSON_IsNumber(j_blocks) ||
-            !cJSON_IsNumber(j_threads) || !cJSON_IsNumber(j_shared) ||
-            !cJSON_IsNumber(j_regs) || !cJSON_IsNumber(j_stream)) {
-            fprintf(stderr, "Warning: Kernel[%d] missing one or more fields, skipping\n", i);
-            continue;
-        }
+static volatile sig_atomic_t stop_watching = 0;
+
+static void on_interrupt(int sig) {
+  (void)sig;
+  stop_watching = 1;
+}
+
+static double elapsed_ms(const struct timespec* since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * 1e3 + (now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+// True when the inotify events in buf include a write or rename of the file name
+static bool config_touched(const char* buf, ssize_t len, const char* name) {
+  for (const char* p = buf; p < buf + len; ) {
+    const struct inotify_event* event = (const struct inotify_event*)p;
+    if (event->len && !strcmp(event->name, name)) return true;
+    p += sizeof(struct inotify_event) + event->len;
+  }
+  return false;
+}
+
+/*
+ * Re-simulates whenever the config is saved, until interrupted. Editors
+ * often save by writing a new file and renaming it over the old one, so
+ * the directory is watched rather than the file. Events arriving within
+ * WATCH_SETTLE_MS of each other are handled as one save.
+ */
+#define WATCH_SETTLE_MS 5
 
-        (*kernels)[i].name = strdup(j_name->valuestring);
-        (*kernels)[i].number_of_blocks = j_blocks->valueint;
-        (*kernels)[i].threads_per_block = j_threads->valueint;
-        (*kernels)[i].shared_mem_used_in_bytes_per_block = j_shared->valueint;
-        (*kernels)[i].registers_per_thread = j_regs->valueint;
-        (*kernels)[i].stream_id = j_stream->valueint;
+static int watch_config(const Options_t* options, ResultCache_t* cache, RunState_t* state) {
+  // The directory holding the config, and the config's name within it
+  char dir[PATH_MAX];
+  const char* slash = strrchr(options->config_path, '/');
+  const char* name = slash ? slash + 1 : options->config_path;
+  if (slash) snprintf(dir, sizeof(dir), "%.*s", (int)(slash - options->config_path) + 1, options->config_path);
+  else strcpy(dir, ".");
+
+  int fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    perror("Failed to watch config directory");
+    if (fd >= 0) close(fd);
+    return 1;
+  }
+
+  struct sigaction action = { .sa_handler = on_interrupt };
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  printf("\nWatching %s for changes (Ctrl-C to stop)\n", options->config_path);
+  fflush(stdout);
+
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (!stop_watching) {
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len <= 0) {
+      if (len < 0 && errno == EINTR) continue;
+      perror("Failed to read config changes");
+      break;
+    }
+    if (!config_touched(buf, len, name)) continue;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (poll(&pfd, 1, WATCH_SETTLE_MS) > 0 && read(fd, buf, sizeof(buf)) > 0);
+
+    Gpu_t *gpus = NULL;
+    Kernel_t *kernels = NULL;
+    int gpu_count = 0, kernel_count = 0;
+    if (load_GPUs(options, &gpus, &gpu_count, &kernels, &kernel_count) != 0) {
+      fprintf(stderr, "Keeping the previous results until %s loads again\n", options->config_path);
+      continue;
     }
 
-    cJSON_Delete(root);
-    free(data);
+    RunState_t next;
+    if (init_run_state(&next, gpu_count) != 0) exit(1);
+    Reports_t reports;
+    open_reports(options, &reports, kernels, kernel_count);
+    int simulated = run_simulation(gpus, gpu_count, kernels, kernel_count, cache, state, &next,
+                                   &reports, false);
+    close_reports(&reports);
+    free_config(gpus, gpu_count, kernels, kernel_count);
+
+    free_run_state(state);
+    *state = next;
+    save_run_state(RUN_STATE_FILE, state);
+
+    printf("\nUpdated %d of %d GPUs in %.1f ms\n", simulated, gpu_count, elapsed_ms(&start));
+    fflush(stdout);
+  }
+
+  close(fd);
+  return 0;
 }
 
-int main() {
+// Answers queries until SIGINT or SIGTERM
+static int serve_queries(const Options_t* options, Gpu_t* gpus, int gpu_count) {
+  QueryEngine_t engine;
+  if (new_query_engine(&engine, gpus, gpu_count) != 0) return 1;
+
+  // Blocked before the threads start so they inherit the mask and only
+  // sigwait() below sees the signals
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  QueryServer_t server;
+  if ((!strncmp(options->socket_path, "results/", 8) && ensure_results_dir() != 0) ||
+      start_query_server(&server, options->socket_path, &engine, threads) != 0) {
+    free_query_engine(&engine);
+    return 1;
+  }
+  printf("Serving queries for %d GPUs on %s with %d threads (Ctrl-C to stop)\n",
+         gpu_count, options->socket_path, server.worker_count);
+  fflush(stdout);
+
+  int sig;
+  sigwait(&signals, &sig);
+
+  stop_query_server(&server);
+  free_query_engine(&engine);
+  return 0;
+}
+
+// Answers queries from stdin until it ends; the buffers are the only
+// allocations, so the per-query cost stays flat over long streams
+static int stream_queries(Gpu_t* gpus, int gpu_count) {
+  QueryEngine_t engine;
+  QueryScratch_t scratch;
+  if (new_query_engine(&engine, gpus, gpu_count) != 0) return 1;
+  if (new_query_scratch(&scratch, &engine) != 0) {
+    free_query_engine(&engine);
+    return 1;
+  }
+
+  char* in = malloc(QUERY_STREAM_BUFFER);
+  char* out = malloc(QUERY_STREAM_BUFFER);
+  int status = 1;
+  if (!in || !out) {
+    fprintf(stderr, "Memory allocation failed\n");
+  } else if (serve_query_stream(&scratch, STDIN_FILENO, STDOUT_FILENO, in, out) != 0) {
+    perror("Failed to stream queries");
+  } else {
+    status = 0;
+  }
+
+  free(in);
+  free(out);
+  free_query_scratch(&scratch);
+  free_query_engine(&engine);
+  return status;
+}
+
+// Summarizes a results.json, or simulates a config without printing
+static int summarize_run(const Options_t* options, const char* path, RunSummary_t* summary) {
+  int status = load_run_summary(path, summary);
+  if (status <= 0) return status;
+
   Gpu_t *gpus = NULL;
   Kernel_t *kernels = NULL;
   int gpu_count = 0, kernel_count = 0;
+  Options_t config = *options;
+  config.config_path = path;
+  if (load_GPUs(&config, &gpus, &gpu_count, &kernels, &kernel_count) != 0) return -1;
 
-  load_config(CONFIG_FILE, &gpus, &gpu_count, &kernels, &kernel_count);
+  unsigned int* dropped = calloc(kernel_count ? kernel_count : 1, sizeof(unsigned int));
+  status = dropped ? 0 : -1;
+  bool model_memory = kernels_use_device_memory(kernels, kernel_count);
+  for (int g = 0; g < gpu_count && status == 0; g++) {
+    DevMemory_t memory;
+    if (model_memory && init_device_memory(&memory, &gpus[g]) != 0) memory.failed = true;
+    reset_GPU(&gpus[g]);
+    for (int k = 0; k < kernel_count; k++) {
+      dropped[k] = place_kernel_with_memory(&gpus[g], model_memory ? &memory : NULL, &kernels[k]);
+    }
+    if (model_memory) {
+      bool failed = memory.failed;
+      free_device_memory(&memory);
+      if (failed) {
+        status = -1;
+        break;
+      }
+    }
+    status = add_GPU_to_summary(summary, &gpus[g], kernels, kernel_count, dropped);
+  }
+  free(dropped);
+  free_config(gpus, gpu_count, kernels, kernel_count);
+  return status;
+}
 
-  char dummy;
-  for (int g = 0; g < gpu_count; g++) {
-    printf("\n==============================\n");
-    printf("Launching kernels on %s\n", gpus[g].name);
-    printf("==============================\n");
+// Prints what changed between two runs; 1 on a regression, 2 on an error
+static int diff_runs(const Options_t* options) {
+  RunSummary_t before, after;
+  if (summarize_run(options, options->diff_before, &before) != 0) return 2;
+  if (summarize_run(options, options->diff_after, &after) != 0) {
+    free_run_summary(&before);
+    return 2;
+  }
 
-    for (int k = 0; k < kernel_count; k++) {
-      launch_one_kernel(&gpus[g], &kernels[k]);
+  printf("Comparing %s -> %s\n", options->diff_before, options->diff_after);
+  int regressions = diff_run_summaries(&before, &after, &options->thresholds, stdout);
+  free_run_summary(&before);
+  free_run_summary(&after);
+  return regressions ? 1 : 0;
+}
+
+// --stats, --perf and --metrics, after the run; out is stderr when stdout
+// carries query answers
+static void end_run(const Options_t* options, FILE* out) {
+  if (exporting) stop_metrics_exporter(&exporter);
+#ifdef GPUSIM_STATS
+  if (options->stats) print_stats(out, options->stats_json);
+#endif
+  if (options->perf) {
+    print_perf_summary(&perf, out);
+    close_perf_counters(&perf);
+  }
+}
+
+int main(int argc, char** argv) {
+  Options_t options = { .config_path = CONFIG_FILE };
+  parse_args(argc, argv, &options);
+
+  if (options.diff_before) return diff_runs(&options);
+
+  Gpu_t *gpus = NULL;
+  Kernel_t *kernels = NULL;
+  int gpu_count = 0, kernel_count = 0;
+
+  if (options.perf) open_perf_counters(&perf);
+  if (options.metrics_path || options.metrics_port) {
+    if (start_metrics_exporter(&exporter, options.metrics_path, options.metrics_interval,
+                               options.metrics_port) != 0) exit(1);
+    exporting = true;
+  }
+
+  STATS_TIMER(load);
+  perf_phase_begin(&perf, PHASE_LOAD);
+  if (load_GPUs(&options, &gpus, &gpu_count, &kernels, &kernel_count) != 0) exit(1);
+  perf_phase_end(&perf, PHASE_LOAD);
+  STATS_PHASE_END(PHASE_LOAD, load);
+
+  if (options.export_tables) {
+    int status = 0;
+    for (int g = 0; g < gpu_count; g++) {
+      if (export_occupancy_tables(&gpus[g]) != 0) status = 1;
     }
+    free_config(gpus, gpu_count, kernels, kernel_count);
+    end_run(&options, stdout);
+    return status;
+  }
 
-    printf("\nPress ENTER to display info for %s...", gpus[g].name);
-    fflush(stdout);
-    while ((dummy = getchar()) != '\n' && dummy != EOF);
+  if (options.socket_path || options.stream) {
+    int status = options.stream ? stream_queries(gpus, gpu_count) : serve_queries(&options, gpus, gpu_count);
+    free_config(gpus, gpu_count, kernels, kernel_count);
+    end_run(&options, options.stream ? stderr : stdout);
+    return status;
+  }
 
-    print_GPU_info(&gpus[g]);
-    export_GPU_to_HTML(&gpus[g]);
-    free_GPU(&gpus[g]);
+  ResultCache_t cache;
+  bool use_cache = options.cache_path && ensure_results_dir() == 0 &&
+    open_result_cache(options.cache_path, &cache) == 0;
+
+  // Watching keeps the run state in memory between saves
+  bool keep_state = options.incremental || options.watch;
+  RunState_t previous = {0}, current = {0};
+  if (keep_state) {
+    if (ensure_results_dir() != 0) exit(1);
+    load_run_state(RUN_STATE_FILE, &previous);
+    if (init_run_state(&current, gpu_count) != 0) exit(1);
   }
 
-  free(gpus);
-  free(kernels);
-  return 0;
+  Reports_t reports;
+  open_reports(&options, &reports, kernels, kernel_count);
+
+  run_simulation(gpus, gpu_count, kernels, kernel_count, use_cache ? &cache : NULL,
+                 &previous, keep_state ? &current : NULL, &reports, !options.watch);
+  free_config(gpus, gpu_count, kernels, kernel_count);
+
+  int status = 0;
+  STATS_TIMER(close);
+  perf_phase_begin(&perf, PHASE_EXPORT);
+  if (close_reports(&reports) != 0) status = 1;
+  perf_phase_end(&perf, PHASE_EXPORT);
+  STATS_PHASE_END(PHASE_EXPORT, close);
+  if (keep_state) {
+    save_run_state(RUN_STATE_FILE, &current);
+    free_run_state(&previous);
+    if (options.watch) status = watch_config(&options, use_cache ? &cache : NULL, &current);
+    free_run_state(&current);
+  }
+  if (use_cache) close_result_cache(&cache);
+  end_run(&options, stdout);
+  return status;
 }
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include "config.h"
+#include "devmem.h"
+#include "timeline.h"
+#include "cJSON.h"
+
+// Longest message passed to a ConfigLog_t
+#define CONFIG_MESSAGE 512
+
+static void report(ConfigLog_t log, void* sink, const char* format, ...) {
+    char message[CONFIG_MESSAGE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    log(sink, message);
+}
+
+// "frees" of a kernel: one name or an array of names. Leaves the kernel
+// without frees on failure.
+static int parse_frees(cJSON *j_frees, Kernel_t *kernel) {
+    if (!cJSON_IsString(j_frees) && !cJSON_IsArray(j_frees)) return -1;
+    int count = cJSON_IsString(j_frees) ? 1 : cJSON_GetArraySize(j_frees);
+    if (count > 0xffff) return -1;
+    char **frees = calloc(count ? count : 1, sizeof(char *));
+    if (!frees) return -1;
+
+    cJSON *item = cJSON_IsString(j_frees) ? j_frees : j_frees->child;
+    int i = 0;
+    for (; i < count && cJSON_IsString(item); i++, item = item->next) {
+        frees[i] = strdup(item->valuestring);
+        if (!frees[i]) break;
+    }
+    if (i < count) {
+        while (i > 0) free(frees[--i]);
+        free(frees);
+        return -1;
+    }
+
+    kernel->frees = frees;
+    kernel->free_count = count;
+    return 0;
+}
+
+// "copies" of a kernel: objects with "kind" (h2d, d2h or d2d), "bytes" and
+// optionally "after", which defaults to true for d2h only. Leaves the
+// kernel without copies on failure.
+static int parse_copies(cJSON *j_copies, Kernel_t *kernel) {
+    if (!cJSON_IsArray(j_copies)) return -1;
+    int count = cJSON_GetArraySize(j_copies);
+    if (count > 0xffff) return -1;
+    Copy_t *copies = calloc(count ? count : 1, sizeof(Copy_t));
+    if (!copies) return -1;
+
+    cJSON *item = j_copies->child;
+    for (int i = 0; i < count; i++, item = item->next) {
+        cJSON *j_kind = cJSON_GetObjectItem(item, "kind");
+        cJSON *j_bytes = cJSON_GetObjectItem(item, "bytes");
+        cJSON *j_after = cJSON_GetObjectItem(item, "after");
+        if (!cJSON_IsString(j_kind) || parse_copy_kind(j_kind->valuestring, &copies[i].kind) != 0 ||
+            !cJSON_IsNumber(j_bytes) || j_bytes->valuedouble < 0 || (j_after && !cJSON_IsBool(j_after))) {
+            free(copies);
+            return -1;
+        }
+        copies[i].bytes = (unsigned long long) j_bytes->valuedouble;
+        copies[i].after = j_after ? cJSON_IsTrue(j_after) : copies[i].kind == COPY_D2H;
+    }
+
+    kernel->copies = copies;
+    kernel->copy_count = count;
+    return 0;
+}
+
+static void log_to_stderr(void* sink, const char* message) {
+    (void)sink;
+    fprintf(stderr, "%s\n", message);
+}
+
+void free_config(Gpu_t *gpus, int gpu_count, Kernel_t *kernels, int kernel_count) {
+    for (int i = 0; i < gpu_count; i++) {
+        free_GPU(&gpus[i]);
+    }
+    for (int i = 0; i < kernel_count; i++) {
+        free_kernel(&kernels[i]);
+    }
+    free(gpus);
+    free(kernels);
+}
+
+void drop_skipped_entries(Gpu_t *gpus, int *gpu_count, Kernel_t *kernels, int *kernel_count) {
+    int kept = 0;
+    for (int g = 0; g < *gpu_count; g++) {
+        if (gpus[g].name) gpus[kept++] = gpus[g];
+    }
+    *gpu_count = kept;
+
+    kept = 0;
+    for (int k = 0; k < *kernel_count; k++) {
+        if (kernels[k].name) kernels[kept++] = kernels[k];
+    }
+    *kernel_count = kept;
+}
+
+int parse_config(const char *json, size_t length, Gpu_t **gpus, int *gpu_count,
+                 Kernel_t **kernels, int *kernel_count, ConfigLog_t log, void *sink) {
+    // The error position comes back through end rather than the parser's
+    // global, which other threads may be setting
+    const char *end = NULL;
+    cJSON *root = cJSON_ParseWithLengthOpts(json, length, &end, 0);
+    if (!root) {
+        int rest = end ? (int)(json + length - end) : 0;
+        report(log, sink, "Error parsing JSON: %.*s", rest, end ? end : "");
+        return -1;
+    }
+
+    // --- GPUs ---
+    cJSON *gpu_array = cJSON_GetObjectItem(root, "gpus");
+    if (!cJSON_IsArray(gpu_array)) {
+        report(log, sink, "Error: 'gpus' field missing or not an array");
+        cJSON_Delete(root);
+        return -1;
+    }
+
+    *gpu_count = cJSON_GetArraySize(gpu_array);
+    *gpus = calloc(*gpu_count ? *gpu_count : 1, sizeof(Gpu_t));
+    if (!*gpus) {
+        report(log, sink, "Memory allocation failed for GPUs");
+        cJSON_Delete(root);
+        return -1;
+    }
+
+    // Walked in order: cJSON_GetArrayItem() starts from the head each time
+    cJSON *gpu = gpu_array->child;
+    for (int i = 0; i < *gpu_count; i++, gpu = gpu->next) {
+        if (!cJSON_IsObject(gpu)) {
+            report(log, sink, "Warning: GPU[%d] is not a valid object, skipping", i);
+            continue;
+        }
+
+        cJSON *j_name = cJSON_GetObjectItem(gpu, "name");
+        cJSON *j_mem = cJSON_GetObjectItem(gpu, "memory_bytes");
+        cJSON *j_shared = cJSON_GetObjectItem(gpu, "shared_mem_per_sm");
+        cJSON *j_regs = cJSON_GetObjectItem(gpu, "registers_per_sm");
+        cJSON *j_warps = cJSON_GetObjectItem(gpu, "max_warps_per_sm");
+        cJSON *j_blocks = cJSON_GetObjectItem(gpu, "max_blocks_per_sm");
+        cJSON *j_sms = cJSON_GetObjectItem(gpu, "num_sms");
+
+        if (!cJSON_IsString(j_name) || !cJSON_IsNumber(j_mem) || !cJSON_IsNumber(j_shared) ||
+            !cJSON_IsNumber(j_regs) || !cJSON_IsNumber(j_warps) ||
+            !cJSON_IsNumber(j_blocks) || !cJSON_IsNumber(j_sms)) {
+            report(log, sink, "Warning: GPU[%d] missing one or more fields, skipping", i);
+            continue;
+        }
+
+        cJSON *j_allocator = cJSON_GetObjectItem(gpu, "allocator");
+        Allocator_t allocator = ALLOCATOR_FIRST_FIT;
+        if (j_allocator && (!cJSON_IsString(j_allocator) ||
+                            parse_allocator(j_allocator->valuestring, &allocator) != 0)) {
+            report(log, sink, "Warning: GPU[%d] has an unknown allocator, using first-fit", i);
+        }
+
+        if (j_sms->valuedouble < 0 || j_sms->valuedouble > MAX_NUMBER_OF_SMS) {
+            report(log, sink, "Warning: GPU[%d] needs 0 to %d SMs, skipping", i, MAX_NUMBER_OF_SMS);
+            continue;
+        }
+
+        if (init_GPU(
+            &(*gpus)[i],
+            j_name->valuestring,
+            (unsigned long) j_mem->valuedouble,
+            j_shared->valueint,
+            j_regs->valueint,
+            j_warps->valueint,
+            j_blocks->valueint,
+            j_sms->valueint
+        ) != 0) {
+            report(log, sink, "Memory allocation failed for GPU[%d]", i);
+            free_config(*gpus, *gpu_count, NULL, 0);
+            cJSON_Delete(root);
+            return -1;
+        }
+        (*gpus)[i].allocator = allocator;
+
+        // Optional copy engines and bandwidths of the timeline
+        cJSON *j_engines = cJSON_GetObjectItem(gpu, "copy_engines");
+        cJSON *j_host_bw = cJSON_GetObjectItem(gpu, "host_bandwidth_gbps");
+        cJSON *j_device_bw = cJSON_GetObjectItem(gpu, "device_bandwidth_gbps");
+        if (cJSON_IsNumber(j_engines) && j_engines->valueint > 0 && j_engines->valueint <= 0xffff) {
+            (*gpus)[i].copy_engines = j_engines->valueint;
+        }
+        if (cJSON_IsNumber(j_host_bw) && j_host_bw->valuedouble > 0) {
+            (*gpus)[i].host_bandwidth_gbps = j_host_bw->valuedouble;
+        }
+        if (cJSON_IsNumber(j_device_bw) && j_device_bw->valuedouble > 0) {
+            (*gpus)[i].device_bandwidth_gbps = j_device_bw->valuedouble;
+        }
+
+        // Optional host submission of the timeline
+        cJSON *j_launch = cJSON_GetObjectItem(gpu, "launch_us");
+        cJSON *j_depth = cJSON_GetObjectItem(gpu, "launch_queue_depth");
+        cJSON *j_graph = cJSON_GetObjectItem(gpu, "graph_size");
+        if (cJSON_IsNumber(j_launch) && j_launch->valuedouble > 0) {
+            (*gpus)[i].launch_us = j_launch->valuedouble;
+        }
+        if (cJSON_IsNumber(j_depth) && j_depth->valuedouble >= 1 && j_depth->valuedouble <= 0xffffffffu) {
+            (*gpus)[i].launch_queue_depth = (unsigned int) j_depth->valuedouble;
+        }
+        if (cJSON_IsNumber(j_graph) && j_graph->valueint > 0 && j_graph->valueint <= 0xffff) {
+            (*gpus)[i].graph_size = j_graph->valueint;
+        }
+    }
+
+    // --- Kernels ---
+    cJSON *kernel_array = cJSON_GetObjectItem(root, "kernels");
+    if (!cJSON_IsArray(kernel_array)) {
+        report(log, sink, "Error: 'kernels' field missing or not an array");
+        free_config(*gpus, *gpu_count, NULL, 0);
+        cJSON_Delete(root);
+        return -1;
+    }
+
+    *kernel_count = cJSON_GetArraySize(kernel_array);
+    *kernels = calloc(*kernel_count ? *kernel_count : 1, sizeof(Kernel_t));
+    if (!*kernels) {
+        report(log, sink, "Memory allocation failed for kernels");
+        free_config(*gpus, *gpu_count, NULL, 0);
+        cJSON_Delete(root);
+        return -1;
+    }
+
+    cJSON *k = kernel_array->child;
+    for (int i = 0; i < *kernel_count; i++, k = k->next) {
+        if (!cJSON_IsObject(k)) {
+            report(log, sink, "Warning: Kernel[%d] is not a valid object, skipping", i);
+            continue;
+        }
+
+        cJSON *j_name = cJSON_GetObjectItem(k, "name");
+        cJSON *j_blocks = cJSON_GetObjectItem(k, "number_of_blocks");
+        cJSON *j_threads = cJSON_GetObjectItem(k, "threads_per_block");
+        cJSON *j_shared = cJSON_GetObjectItem(k, "shared_mem_used_in_bytes_per_block");
+        cJSON *j_regs = cJSON_GetObjectItem(k, "registers_per_thread");
+        cJSON *j_stream = cJSON_GetObjectItem(k, "stream_id");
+
+        if (!cJSON_IsString(j_name) || !cJSON_IsNumber(j_blocks) ||
+            !cJSON_IsNumber(j_threads) || !cJSON_IsNumber(j_shared) ||
+            !cJSON_IsNumber(j_regs) || !cJSON_IsNumber(j_stream)) {
+            report(log, sink, "Warning: Kernel[%d] missing one or more fields, skipping", i);
+            continue;
+        }
+
+        (*kernels)[i].name = strdup(j_name->valuestring);
+        (*kernels)[i].number_of_blocks = j_blocks->valueint;
+        (*kernels)[i].threads_per_block = j_threads->valueint;
+        (*kernels)[i].shared_mem_used_in_bytes_per_block = j_shared->valueint;
+        (*kernels)[i].registers_per_thread = j_regs->valueint;
+        (*kernels)[i].stream_id = j_stream->valueint;
+
+        // Optional device memory footprint
+        cJSON *j_memory = cJSON_GetObjectItem(k, "memory_bytes");
+        cJSON *j_frees = cJSON_GetObjectItem(k, "frees");
+        if (cJSON_IsNumber(j_memory) && j_memory->valuedouble > 0) {
+            (*kernels)[i].memory_bytes = (unsigned long long) j_memory->valuedouble;
+        }
+        if (j_frees && parse_frees(j_frees, &(*kernels)[i]) != 0) {
+            report(log, sink, "Warning: Kernel[%d] 'frees' is not a kernel name or an array of them, ignoring it", i);
+        }
+
+        // Optional run time and copies around the launch
+        cJSON *j_duration = cJSON_GetObjectItem(k, "duration_us");
+        cJSON *j_copies = cJSON_GetObjectItem(k, "copies");
+        if (cJSON_IsNumber(j_duration) && j_duration->valuedouble > 0) {
+            (*kernels)[i].duration_us = j_duration->valuedouble;
+        }
+        if (j_copies && parse_copies(j_copies, &(*kernels)[i]) != 0) {
+            report(log, sink, "Warning: Kernel[%d] 'copies' must be an array of {kind, bytes}, ignoring it", i);
+        }
+    }
+
+    cJSON_Delete(root);
+    return 0;
+}
+
+int read_config(const char *filename, Gpu_t **gpus, int *gpu_count,
+                Kernel_t **kernels, int *kernel_count, ConfigLog_t log, void *sink) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        report(log, sink, "Failed to open config file: %s", strerror(errno));
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    rewind(fp);
+
+    char *data = malloc(len + 1);
+    if (!data) {
+        report(log, sink, "Memory allocation failed");
+        fclose(fp);
+        return -1;
+    }
+
+    fread(data, 1, len, fp);
+    data[len] = '\0';
+    fclose(fp);
+
+    int status = parse_config(data, len + 1, gpus, gpu_count, kernels, kernel_count, log, sink);
+    free(data);
+    return status;
+}
+
+int load_config(const char *filename, Gpu_t **gpus, int *gpu_count, Kernel_t **kernels, int *kernel_count) {
+    return read_config(filename, gpus, gpu_count, kernels, kernel_count, log_to_stderr, NULL);
+}
@@ -0,0 +1,37 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include "cuda_arch.h"
+
+// ================= Type Declaration ==================
+
+// Receives each warning and error about a config as one line without '\n'
+typedef void (*ConfigLog_t)(void* sink, const char* message);
+
+// ================= Function Declarations ==================
+
+/*
+ * Builds the GPUs and kernels of a config.json held in memory. Entries
+ * missing a field are reported and left zeroed (a GPU without a name),
+ * so indices still match the file. Returns 0, or -1 after reporting why
+ * the config could not be used. Nothing is shared between calls, so
+ * several threads can parse at once.
+ */
+int parse_config(const char* json, size_t length, Gpu_t** gpus, int* gpu_count,
+                 Kernel_t** kernels, int* kernel_count, ConfigLog_t log, void* sink);
+
+// parse_config() of a file
+int read_config(const char* filename, Gpu_t** gpus, int* gpu_count,
+                Kernel_t** kernels, int* kernel_count, ConfigLog_t log, void* sink);
+
+// read_config() reporting to stderr
+int load_config(const char* filename, Gpu_t** gpus, int* gpu_count, Kernel_t** kernels, int* kernel_count);
+
+// Leaves out the entries parse_config() skipped, shifting the rest down
+void drop_skipped_entries(Gpu_t* gpus, int* gpu_count, Kernel_t* kernels, int* kernel_count);
+
+// Frees GPUs that were not freed after their report, and the kernels
+void free_config(Gpu_t* gpus, int gpu_count, Kernel_t* kernels, int kernel_count);
+
+#endif // CONFIG_H
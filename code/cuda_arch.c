@@ -5,7 +5,10 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdbool.h>
+#include <time.h>
 #include "cuda_arch.h"
+#include "writer.h"
+#include "stats.h"
 
 #ifdef _WIN32
   #include <direct.h>
@@ -15,49 +18,192 @@
   #define MAKE_DIR(path) mkdir(path, 0755)
 #endif
 
-Gpu_t new_GPU(
-  char* name,
+int init_GPU(
+  Gpu_t* gpu,
+  const char* name,
   unsigned long global_mem_size_in_bytes,
   unsigned int shared_mem_size_in_bytes_per_SM,
   unsigned int number_of_registers_per_SM,
   unsigned short maximum_number_of_warps_per_SM,
   unsigned short maximum_number_of_blocks_per_SM,
-  unsigned short number_of_SMs
+  unsigned int number_of_SMs
 ){
 
-  Gpu_t gpu = {
+  *gpu = (Gpu_t){
     .name = strdup(name),
     .global_mem_size_in_bytes = global_mem_size_in_bytes,
     .shared_mem_size_in_bytes_per_SM = shared_mem_size_in_bytes_per_SM,
     .number_of_registers_per_SM = number_of_registers_per_SM,
     .maximum_number_of_warps_per_SM = maximum_number_of_warps_per_SM,
     .maximum_number_of_blocks_per_SM = maximum_number_of_blocks_per_SM,
-    .number_of_SMs = number_of_SMs,
   };
 
-  gpu.list_of_SMs = malloc(sizeof(struct SM) * gpu.number_of_SMs);
-  if (!gpu.list_of_SMs) {
-    perror("Failed to allocate SMs");
-    exit(EXIT_FAILURE);
+  // number_of_SMs counts the SMs with a block list, so free_GPU() undoes
+  // a partial allocation
+  gpu->list_of_SMs = gpu->name ? malloc(sizeof(struct SM) * (number_of_SMs ? number_of_SMs : 1)) : NULL;
+  if (!gpu->list_of_SMs) {
+    free_GPU(gpu);
+    return -1;
   }
 
-  for (int i = 0; i < gpu.number_of_SMs; i++) {
-    gpu.list_of_SMs[i].number_of_blocks = 0;
-    gpu.list_of_SMs[i].list_of_blocks = calloc(gpu.maximum_number_of_blocks_per_SM, sizeof(Block_t));
-    if (!gpu.list_of_SMs[i].list_of_blocks) {
-      perror("Failed to allocate Block");
-      exit(EXIT_FAILURE);
+  for (unsigned int i = 0; i < number_of_SMs; i++) {
+    gpu->list_of_SMs[i].number_of_blocks = 0;
+    gpu->list_of_SMs[i].list_of_blocks = calloc(gpu->maximum_number_of_blocks_per_SM, sizeof(Block_t));
+    if (!gpu->list_of_SMs[i].list_of_blocks) {
+      free_GPU(gpu);
+      return -1;
     }
+    gpu->number_of_SMs = i + 1;
+  }
+
+  // One allocation holds the four free-resource arrays, each padded so a
+  // full SM_SCAN_WIDTH load starting at the last SM stays in bounds
+  size_t stride = ((size_t)number_of_SMs + 2 * SM_SCAN_WIDTH - 1) / SM_SCAN_WIDTH * SM_SCAN_WIDTH;
+  int* resources = aligned_alloc(64, sizeof(int) * stride * 4);
+  if (!resources) {
+    free_GPU(gpu);
+    return -1;
   }
+  memset(resources, 0, sizeof(int) * stride * 4);
 
+  gpu->free_resources.free_warps = resources;
+  gpu->free_resources.free_shared_mem = resources + stride;
+  gpu->free_resources.free_registers = resources + 2 * stride;
+  gpu->free_resources.free_block_slots = resources + 3 * stride;
+
+  reset_GPU(gpu);
+
+  return 0;
+}
+
+Gpu_t new_GPU(
+  char* name,
+  unsigned long global_mem_size_in_bytes,
+  unsigned int shared_mem_size_in_bytes_per_SM,
+  unsigned int number_of_registers_per_SM,
+  unsigned short maximum_number_of_warps_per_SM,
+  unsigned short maximum_number_of_blocks_per_SM,
+  unsigned int number_of_SMs
+){
+  Gpu_t gpu;
+  if (init_GPU(&gpu, name, global_mem_size_in_bytes, shared_mem_size_in_bytes_per_SM,
+               number_of_registers_per_SM, maximum_number_of_warps_per_SM,
+               maximum_number_of_blocks_per_SM, number_of_SMs) != 0) {
+    perror("Failed to allocate GPU");
+    exit(EXIT_FAILURE);
+  }
   return gpu;
 }
 
 void free_GPU(Gpu_t* gpu){
-  for (int i = 0; i < gpu->number_of_SMs; i++) {
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
     free(gpu->list_of_SMs[i].list_of_blocks);
   }
   free(gpu->list_of_SMs);
+  free(gpu->free_resources.free_warps);
+  free(gpu->name);
+
+  // A freed GPU can be freed again
+  gpu->list_of_SMs = NULL;
+  gpu->number_of_SMs = 0;
+  gpu->name = NULL;
+  memset(&gpu->free_resources, 0, sizeof(gpu->free_resources));
+}
+
+void free_kernel(Kernel_t* kernel) {
+  for (unsigned short i = 0; i < kernel->free_count; i++) {
+    free(kernel->frees[i]);
+  }
+  free(kernel->frees);
+  free(kernel->copies);
+  free(kernel->name);
+  kernel->frees = NULL;
+  kernel->free_count = 0;
+  kernel->copies = NULL;
+  kernel->copy_count = 0;
+  kernel->name = NULL;
+}
+
+void reset_GPU(Gpu_t* gpu) {
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    gpu->list_of_SMs[i].number_of_blocks = 0;
+    gpu->free_resources.free_warps[i] = gpu->maximum_number_of_warps_per_SM;
+    gpu->free_resources.free_shared_mem[i] = gpu->shared_mem_size_in_bytes_per_SM;
+    gpu->free_resources.free_registers[i] = gpu->number_of_registers_per_SM;
+    gpu->free_resources.free_block_slots[i] = gpu->maximum_number_of_blocks_per_SM;
+  }
+}
+
+const char* limit_name(Limit_t limit) {
+  switch (limit) {
+    case LIMIT_BLOCKS:     return "blocks";
+    case LIMIT_WARPS:      return "warps";
+    case LIMIT_REGISTERS:  return "registers";
+    case LIMIT_SHARED_MEM: return "shared_mem";
+  }
+  return "unknown";
+}
+
+// ================= Placement Observers ==================
+
+typedef struct OBSERVER_ENTRY {
+  PlacementObserver_t observer;
+  void* context;
+} ObserverEntry_t;
+
+static ObserverEntry_t observers[MAX_PLACEMENT_OBSERVERS];
+int placement_observer_count = 0;
+
+int add_placement_observer(PlacementObserver_t observer, void* context) {
+  if (!observer || placement_observer_count == MAX_PLACEMENT_OBSERVERS) return -1;
+  observers[placement_observer_count++] = (ObserverEntry_t){ observer, context };
+  return 0;
+}
+
+void remove_placement_observer(PlacementObserver_t observer, void* context) {
+  for (int i = 0; i < placement_observer_count; i++) {
+    if (observers[i].observer != observer || observers[i].context != context) continue;
+    memmove(&observers[i], &observers[i + 1], (placement_observer_count - i - 1) * sizeof(observers[0]));
+    placement_observer_count--;
+    return;
+  }
+}
+
+// Out of line and cold, so the placement loops only carry the count check
+__attribute__((cold, noinline))
+static void notify_observers(PlacementEventType_t type, const Gpu_t* gpu, const Kernel_t* kernel,
+                             int sm_id, Limit_t reason, unsigned int blocks) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  PlacementEvent_t event = {
+    .type = type,
+    .timestamp_ns = ts.tv_sec * 1000000000ull + ts.tv_nsec,
+    .gpu = gpu,
+    .kernel = kernel,
+    .sm_id = sm_id,
+    .reason = reason,
+    .blocks = blocks,
+  };
+  for (int i = 0; i < placement_observer_count; i++) {
+    observers[i].observer(&event, observers[i].context);
+  }
+}
+
+// First resource the SM lacks for the block, in the order occupancy reports limits
+static Limit_t rejecting_limit(const Gpu_t* gpu, int sm_pos, const Block_t* block) {
+  const SMResources_t* res = &gpu->free_resources;
+  if (res->free_block_slots[sm_pos] < 1) return LIMIT_BLOCKS;
+  if (res->free_warps[sm_pos] < (int)((block->number_of_thread + 31) / 32)) return LIMIT_WARPS;
+  if ((unsigned int)res->free_registers[sm_pos] <
+      block->number_of_registers_used_per_thread * block->number_of_thread) return LIMIT_REGISTERS;
+  return LIMIT_SHARED_MEM;
+}
+
+__attribute__((cold, noinline))
+static void notify_rejections(const Gpu_t* gpu, const Kernel_t* kernel, const Block_t* block) {
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    notify_observers(EVENT_BLOCK_REJECTED, gpu, kernel, i, rejecting_limit(gpu, i, block), 1);
+  }
 }
 
 void clear_kernel_blocks(Gpu_t* gpu, Kernel_t* kernel) {
@@ -66,14 +212,20 @@ void clear_kernel_blocks(Gpu_t* gpu, Kernel_t* kernel) {
     return;
   }
 
-  for (int i = 0; i < gpu->number_of_SMs; i++) {
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
     SM_t* sm = &gpu->list_of_SMs[i];
     int write_index = 0;
 
+    STATS_ADD(STAT_CLEAR_SCANNED, sm->number_of_blocks);
     for (int j = 0; j < sm->number_of_blocks; j++) {
       Block_t* blk = &sm->list_of_blocks[j];
 
       if (!strcmp(blk->kernel_name, kernel->name)) {
+        gpu->free_resources.free_warps[i] += (blk->number_of_thread + 31) / 32;
+        gpu->free_resources.free_shared_mem[i] += blk->shared_mem_used_in_bytes;
+        gpu->free_resources.free_registers[i] +=
+          blk->number_of_registers_used_per_thread * blk->number_of_thread;
+        gpu->free_resources.free_block_slots[i]++;
         continue;
       }
 
@@ -83,6 +235,10 @@ void clear_kernel_blocks(Gpu_t* gpu, Kernel_t* kernel) {
       write_index++;
     }
 
+    STATS_ADD(STAT_CLEAR_REMOVED, sm->number_of_blocks - write_index);
+    if (PLACEMENT_OBSERVED() && write_index != sm->number_of_blocks) {
+      notify_observers(EVENT_KERNEL_CLEARED, gpu, kernel, i, 0, sm->number_of_blocks - write_index);
+    }
     sm->number_of_blocks = write_index;
   }
 }
@@ -107,7 +263,7 @@ void print_GPU_info(Gpu_t* gpu) {
   printf("Registers per SM:               %u\n", gpu->number_of_registers_per_SM);
   printf("Max Warps per SM:               %hu\n", gpu->maximum_number_of_warps_per_SM);
   printf("Max Blocks per SM:              %hu\n", gpu->maximum_number_of_blocks_per_SM);
-  printf("Number of SMs:                  %hu\n", gpu->number_of_SMs);
+  printf("Number of SMs:                  %u\n", gpu->number_of_SMs);
   printf("------------------------------------------------------------\n");
 
   if (!gpu->list_of_SMs) {
@@ -116,11 +272,11 @@ void print_GPU_info(Gpu_t* gpu) {
   }
 
   // Iterate over SMs
-  for (unsigned short sm_idx = 0; sm_idx < gpu->number_of_SMs; ++sm_idx) {
+  for (unsigned int sm_idx = 0; sm_idx < gpu->number_of_SMs; ++sm_idx) {
     SM_t* sm = &gpu->list_of_SMs[sm_idx];
     if (!sm) continue;
 
-    printf("\n[SM %hu]\n", sm_idx);
+    printf("\n[SM %u]\n", sm_idx);
     printf("------------------------------------------------------------\n");
     printf("Number of Active Blocks: %u / %hu (%.2f%% utilization)\n",
            sm->number_of_blocks,
@@ -158,7 +314,7 @@ void print_GPU_info(Gpu_t* gpu) {
     // Add Occupancy Info Here
     print_occupancy_of_SM(gpu, sm_idx);
 
-    printf("\n  BLOCKS IN SM %hu:\n", sm_idx);
+    printf("\n  BLOCKS IN SM %u:\n", sm_idx);
     printf("  ----------------------------------------------------------\n");
     if (!sm->list_of_blocks) {
       printf("  No blocks in this SM.\n");
@@ -182,21 +338,18 @@ void print_GPU_info(Gpu_t* gpu) {
   printf("============================================================\n\n");
 }
 
-void export_GPU_to_HTML(Gpu_t* gpu) {
-  if (!gpu) {
-    fprintf(stderr, "Error: GPU pointer is NULL.\n");
-    return;
-  }
-
-  // Ensure "results" directory exists
+int ensure_results_dir(void) {
   struct stat st = {0};
   if (stat("results", &st) == -1) {
     if (MAKE_DIR("results") != 0 && errno != EEXIST) {
       fprintf(stderr, "Error creating results/ folder: %s\n", strerror(errno));
-      return;
+      return -1;
     }
   }
+  return 0;
+}
 
+void results_path_of_GPU(Gpu_t* gpu, const char* suffix, char* out, size_t out_size) {
   // Build safe file name (replace spaces)
   char safe_name[256];
   snprintf(safe_name, sizeof(safe_name), "%s", gpu->name);
@@ -204,14 +357,27 @@ void export_GPU_to_HTML(Gpu_t* gpu) {
     if (*p == ' ') *p = '_';
   }
 
+  snprintf(out, out_size, "results/%s%s", safe_name, suffix);
+}
+
+void export_GPU_to_HTML(Gpu_t* gpu) {
+  if (!gpu) {
+    fprintf(stderr, "Error: GPU pointer is NULL.\n");
+    return;
+  }
+
+  if (ensure_results_dir() != 0) return;
+
   char filepath[512];
-  snprintf(filepath, sizeof(filepath), "results/%s.html", safe_name);
+  results_path_of_GPU(gpu, ".html", filepath, sizeof(filepath));
 
   FILE* f = fopen(filepath, "w");
   if (!f) {
     fprintf(stderr, "Error: could not open file %s for writing.\n", filepath);
     return;
   }
+  // About 400 bytes per block: buffer generously so large GPUs take few writes
+  setvbuf(f, NULL, _IOFBF, WRITER_BUFFER);
 
   // HTML Header
   fprintf(f,
@@ -226,7 +392,7 @@ void export_GPU_to_HTML(Gpu_t* gpu) {
           "<body>\n"
           "  <h1>GPU: %s</h1>\n"
           "  <div class='gpu-container'>\n"
-          "    <div class='gpu-header'>Global Memory: %.2f GB | SMs: %hu | Shared Mem/SM: %.2f KB | Registers/SM: %u</div>\n"
+          "    <div class='gpu-header'>Global Memory: %.2f GB | SMs: %u | Shared Mem/SM: %.2f KB | Registers/SM: %u</div>\n"
           "    <div class='sm-grid'>\n",
           gpu->name,
           gpu->name,
@@ -237,7 +403,7 @@ void export_GPU_to_HTML(Gpu_t* gpu) {
           );
 
   // Loop through SMs
-  for (int i = 0; i < gpu->number_of_SMs; i++) {
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
     SM_t* sm = &gpu->list_of_SMs[i];
     double occ = 0.0;
     if (gpu->maximum_number_of_warps_per_SM > 0)
@@ -253,7 +419,7 @@ void export_GPU_to_HTML(Gpu_t* gpu) {
 
     fprintf(f,
             "      <div class='sm'>\n"
-            "        <h3 class='sm_text'>SM #%d</h3>\n"
+            "        <h3 class='sm_text'>SM #%u</h3>\n"
             "        <div class='tooltip_sm'>\n"
             "          Occupancy: %.2f%%<br>\n"
             "          Blocks: %hu / %hu<br>\n"
@@ -301,12 +467,13 @@ void export_GPU_to_HTML(Gpu_t* gpu) {
           "</body>\n</html>\n"
           );
 
+  STATS_ADD(STAT_BYTES_WRITTEN, ftell(f));
   fclose(f);
   printf("HTML visualization generated: %s\n", filepath);
 }
 
 void print_occupancy_of_all_SMs(Gpu_t* gpu){
-  for (int i=0; i < gpu->number_of_SMs; i++) {
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
     print_occupancy_of_SM(gpu, i);
   }
   printf("\n");
@@ -317,7 +484,7 @@ void print_occupancy_of_SM(Gpu_t* gpu, int SM_pos){
     printf("GPU pointer is NULL.\n");
     return;
   }
-  if(SM_pos < 0 || SM_pos >= gpu->number_of_SMs){
+  if(SM_pos < 0 || (unsigned int)SM_pos >= gpu->number_of_SMs){
     printf("Invalid SM position: %d\n", SM_pos);
     return;
   }
@@ -327,7 +494,7 @@ void print_occupancy_of_SM(Gpu_t* gpu, int SM_pos){
 }
 
 double calculate_occupancy_of_SM(Gpu_t* gpu, int SM_pos) {
-  if (!gpu || SM_pos < 0 || SM_pos >= gpu->number_of_SMs) return 0.0;
+  if (!gpu || SM_pos < 0 || (unsigned int)SM_pos >= gpu->number_of_SMs) return 0.0;
   SM_t* sm = &(gpu->list_of_SMs[SM_pos]);
   if (!sm || sm->number_of_blocks == 0) return 0.0;
 
@@ -417,7 +584,8 @@ void make_stream_queues(
   for (int i = 0; i <= max_stream_id; i++) {
     if (stream_counts[i] > 0) {
       streams[idx].stream_id = i;
-      queue_kernel_init(&streams[idx].queue, stream_counts[i]);
+      // A ring queue holds one less than its capacity
+      queue_kernel_init(&streams[idx].queue, stream_counts[i] + 1);
       id_to_index[i] = idx;
       idx++;
     } else {
@@ -481,89 +649,89 @@ queue_kernel_t* ready_EE_queue(StreamQueue_t* streams, int streams_size, int num
 
 bool canFitBlock(Gpu_t* gpu, int sm_pos, Block_t* block) {
   if (!gpu || !block) return false;
-  if (sm_pos < 0 || sm_pos >= gpu->number_of_SMs) return false;
+  if (sm_pos < 0 || (unsigned int)sm_pos >= gpu->number_of_SMs) return false;
 
-  SM_t* sm = &(gpu->list_of_SMs[sm_pos]);
-
-  if (sm->number_of_blocks >= gpu->maximum_number_of_blocks_per_SM)
-    return false;
-
-  // Compute total used resources
-  unsigned long used_shared = 0, used_regs = 0, used_warps = 0;
-
-  for (unsigned short i = 0; i < sm->number_of_blocks; ++i) {
-    Block_t* b = &sm->list_of_blocks[i];
-    used_warps += (unsigned long)((b->number_of_thread + 31) / 32 );
-    used_shared += b->shared_mem_used_in_bytes;
-    used_regs   += (unsigned long)b->number_of_registers_used_per_thread * 
-      (unsigned long)b->number_of_thread;
-  }
-
-  unsigned long new_warps = used_warps + (unsigned long)((block->number_of_thread + 31) / 32 );
-  unsigned long new_shared = used_shared + (unsigned long)block->shared_mem_used_in_bytes;
-  unsigned long new_regs   = used_regs + 
-    ((unsigned long)block->number_of_registers_used_per_thread * 
-    (unsigned long)block->number_of_thread);
-
-  // Compare against SM limits
-  if (new_warps > gpu->maximum_number_of_warps_per_SM)
-    return false;
-
-  if (new_shared > gpu->shared_mem_size_in_bytes_per_SM)
-    return false;
+  // Bit 0 of the mask is the SM at sm_pos
+  return fit_mask_of_SMs(gpu, sm_pos, block) & 1u;
+}
 
-  if (new_regs > gpu->number_of_registers_per_SM)
-    return false;
+void place_block_on_SM(Gpu_t* gpu, int sm_pos, Block_t* block) {
+  SM_t* sm = &gpu->list_of_SMs[sm_pos];
+  sm->list_of_blocks[sm->number_of_blocks++] = *block;
 
-  return true;
+  gpu->free_resources.free_warps[sm_pos] -= (block->number_of_thread + 31) / 32;
+  gpu->free_resources.free_shared_mem[sm_pos] -= block->shared_mem_used_in_bytes;
+  gpu->free_resources.free_registers[sm_pos] -=
+    block->number_of_registers_used_per_thread * block->number_of_thread;
+  gpu->free_resources.free_block_slots[sm_pos]--;
 }
 
-void launch_one_kernel(Gpu_t* gpu, Kernel_t* kernel){
-  Block_t* blocks = calloc(kernel->number_of_blocks, sizeof(Block_t));
-  if (!blocks) {
-    perror("Failed to allocate blocks");
-    return;
-  }
-
-  int i;
+// Places as many blocks of the kernel as fit and returns how many did not
+unsigned int place_kernel_blocks(Gpu_t* gpu, Kernel_t* kernel) {
+  // All blocks of a kernel are identical
+  Block_t block = {
+    .kernel_name = kernel->name,
+    .number_of_thread = kernel->threads_per_block,
+    .shared_mem_used_in_bytes = kernel->shared_mem_used_in_bytes_per_block,
+    .number_of_registers_used_per_thread = kernel->registers_per_thread,
+  };
 
-  for (i = 0; i < kernel->number_of_blocks; i++) {
-    blocks[i].kernel_name = kernel->name;
-    blocks[i].number_of_thread = kernel->threads_per_block;
-    blocks[i].shared_mem_used_in_bytes = kernel->shared_mem_used_in_bytes_per_block;
-    blocks[i].number_of_registers_used_per_thread = kernel->registers_per_thread;
-  }
-  int count = 0;
-  i = 0;
+  unsigned int count = 0;
+  int i = 0;
   bool even = true, retry_flag = false;
   while (count < kernel->number_of_blocks) {
     // if we checked all even SMs we go to odd SMs and vice versa
-    if(i >= gpu->number_of_SMs){
+    if(i >= (int)gpu->number_of_SMs){
       i = (even)? 1 : 0;
       even = !even;
+      STATS_ADD(STAT_PASS_SWITCHES, 1);
 
       if(retry_flag){
-        // print a better error later, TO DO, DONT FORGET.
-        printf("%d of blocks of kernel %s did not fit in the GPU %s\n", kernel->number_of_blocks - count, kernel->name, gpu->name);
-        free(blocks);
-        return;
+        STATS_ADD(STAT_BLOCKS_PLACED, count);
+        STATS_ADD(STAT_BLOCKS_DROPPED, kernel->number_of_blocks - count);
+        if (PLACEMENT_OBSERVED()) {
+          notify_rejections(gpu, kernel, &block);
+          notify_observers(EVENT_KERNEL_DROPPED, gpu, kernel, -1, 0, kernel->number_of_blocks - count);
+        }
+        return kernel->number_of_blocks - count;
       }
-      else{
-        retry_flag = true;
-      } 
+      retry_flag = true;
+      continue;
     }
 
-    if(canFitBlock(gpu, i, &blocks[count])){
-      retry_flag = false;
-      gpu->list_of_SMs[i].list_of_blocks[gpu->list_of_SMs[i].number_of_blocks++] = blocks[count++];
+    // SMs of this pass that cannot take the block are skipped in bulk
+    int sm_pos = find_fitting_SM(gpu, i, &block);
+    if(sm_pos < 0){
+      i = gpu->number_of_SMs;
+      continue;
     }
 
-    i += 2;
+    retry_flag = false;
+    place_block_on_SM(gpu, sm_pos, &block);
+    if (PLACEMENT_OBSERVED()) notify_observers(EVENT_BLOCK_PLACED, gpu, kernel, sm_pos, 0, 1);
+    count++;
+    i = sm_pos + 2;
+  }
+
+  STATS_ADD(STAT_BLOCKS_PLACED, count);
+  if (PLACEMENT_OBSERVED()) notify_observers(EVENT_KERNEL_PLACED, gpu, kernel, -1, 0, count);
+  return 0;
+}
+
+void print_kernel_launch_result(Gpu_t* gpu, Kernel_t* kernel, unsigned int dropped){
+  if(dropped){
+    // print a better error later, TO DO, DONT FORGET.
+    printf("%u of blocks of kernel %s did not fit in the GPU %s\n", dropped, kernel->name, gpu->name);
+    return;
   }
 
-  free(blocks);
   printf("all blocks of kernel %s run succesfuly!\n", kernel->name);
+}
 
+unsigned int launch_one_kernel(Gpu_t* gpu, Kernel_t* kernel){
+  unsigned int dropped = place_kernel_blocks(gpu, kernel);
+  print_kernel_launch_result(gpu, kernel, dropped);
+  return dropped;
 }
 
 //  work in progress
@@ -3,10 +3,24 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "queue.h"
 
 // ================= Type Declaration ==================
 
+// Direction of a copy a kernel's stream makes around it (timeline.h)
+typedef enum COPY_KIND {
+  COPY_H2D,
+  COPY_D2H,
+  COPY_D2D
+} CopyKind_t;
+
+typedef struct COPY {
+  CopyKind_t kind;
+  bool after;                     // issued after the kernel rather than before
+  unsigned long long bytes;
+} Copy_t;
+
 typedef struct KERNEL {
   char* name;
 
@@ -17,6 +31,18 @@ typedef struct KERNEL {
   unsigned int registers_per_thread;
 
   unsigned short stream_id;
+
+  // Device memory allocated at launch, and earlier kernels whose
+  // allocations are freed first (devmem.h); 0 and none when not modelled
+  unsigned long long memory_bytes;
+  char** frees;
+  unsigned short free_count;
+
+  // Run time, 0 for an estimate from the blocks, and the copies made in
+  // its stream around it (timeline.h)
+  double duration_us;
+  Copy_t* copies;
+  unsigned short copy_count;
 } Kernel_t;
 
 QUEUE_DEFINE(Kernel_t, kernel)
@@ -38,21 +64,108 @@ typedef struct SM {
   Block_t* list_of_blocks;
 } SM_t;
 
+// Most SMs a GPU may have: far above any real GPU or the 100000-SM fleets
+// of bench_placement, while keeping an SM index in an int
+#define MAX_NUMBER_OF_SMS (1 << 24)
+
+// Number of SMs tested by one call to fit_mask_of_SMs()
+#define SM_SCAN_WIDTH 16
+
+// Free resources of every SM kept in parallel arrays next to list_of_SMs, so
+// the fit scan can test several SMs per instruction. Each array has
+// SM_SCAN_WIDTH - 1 extra padding entries with no free block slots, which
+// never fit a block.
+typedef struct SM_RESOURCES {
+  int* free_warps;
+  int* free_shared_mem;
+  int* free_registers;
+  int* free_block_slots;
+} SMResources_t;
+
+// Resource that stops another block from fitting on an SM
+typedef enum LIMIT {
+  LIMIT_BLOCKS,
+  LIMIT_WARPS,
+  LIMIT_REGISTERS,
+  LIMIT_SHARED_MEM
+} Limit_t;
+
+// How kernel allocations are laid out in global memory (devmem.h)
+typedef enum ALLOCATOR {
+  ALLOCATOR_FIRST_FIT,
+  ALLOCATOR_BUMP,
+  ALLOCATOR_CACHING
+} Allocator_t;
+
 typedef struct GPU {
   char* name;
 
   unsigned long global_mem_size_in_bytes;
+  Allocator_t allocator;
+
+  // Copy engines and link bandwidths of the timeline; 0 for the defaults
+  unsigned short copy_engines;
+  double host_bandwidth_gbps;     // H2D and D2H
+  double device_bandwidth_gbps;   // D2D
+  // Host submission of the timeline; 0 for the defaults, graph_size 0
+  // for launches one by one
+  double launch_us;
+  unsigned int launch_queue_depth;
+  unsigned short graph_size;
   unsigned int shared_mem_size_in_bytes_per_SM;
   unsigned int number_of_registers_per_SM;
   unsigned short maximum_number_of_warps_per_SM;
   unsigned short maximum_number_of_blocks_per_SM;
 
-  unsigned short number_of_SMs;
+  unsigned int number_of_SMs;
   SM_t* list_of_SMs;
+  SMResources_t free_resources;
 } Gpu_t;
 
+// What happened to the blocks of a kernel, as told to placement observers
+typedef enum PLACEMENT_EVENT_TYPE {
+  EVENT_BLOCK_PLACED,
+  EVENT_BLOCK_REJECTED,     // one per SM, when a block fits on none of them
+  EVENT_KERNEL_PLACED,      // every block placed
+  EVENT_KERNEL_DROPPED,     // some blocks did not fit
+  EVENT_KERNEL_CLEARED      // one per SM that clear_kernel_blocks() removed blocks from
+} PlacementEventType_t;
+
+typedef struct PLACEMENT_EVENT {
+  PlacementEventType_t type;
+  unsigned long long timestamp_ns;  // CLOCK_MONOTONIC
+  const Gpu_t* gpu;
+  const Kernel_t* kernel;
+  int sm_id;                        // -1 for EVENT_KERNEL_PLACED and EVENT_KERNEL_DROPPED
+  Limit_t reason;                   // resource the SM ran out of, for EVENT_BLOCK_REJECTED
+  unsigned int blocks;              // placed by the kernel, dropped, or cleared
+} PlacementEvent_t;
+
+typedef void (*PlacementObserver_t)(const PlacementEvent_t* event, void* context);
+
+// Most observers registered at once
+#define MAX_PLACEMENT_OBSERVERS 8
+
+extern int placement_observer_count;
+
+// Events are only built when someone listens; the branch is predicted not taken
+#define PLACEMENT_OBSERVED() __builtin_expect(placement_observer_count != 0, 0)
+
 // ================= Function Declarations ==================
 
+// Fills gpu; returns -1, leaving nothing allocated, when memory runs out
+int init_GPU(
+  Gpu_t* gpu,
+  const char* name,
+  unsigned long global_mem_size_in_bytes,
+  unsigned int shared_mem_size_in_bytes_per_SM,
+  unsigned int number_of_registers_per_SM,
+  unsigned short maximum_number_of_warps_per_SM,
+  unsigned short maximum_number_of_blocks_per_SM,
+  unsigned int number_of_SMs
+);
+
+// init_GPU() for the tools, exiting when memory runs out
 Gpu_t new_GPU(
   char* name,
   unsigned long global_mem_size_in_bytes,
@@ -60,20 +173,51 @@ Gpu_t new_GPU(
   unsigned int number_of_registers_per_SM,
   unsigned short maximum_number_of_warps_per_SM,
   unsigned short maximum_number_of_blocks_per_SM,
-  unsigned short number_of_SMs
+  unsigned int number_of_SMs
 );
 
 void free_GPU(Gpu_t* gpu);
 
+void free_kernel(Kernel_t* kernel);
+
+void reset_GPU(Gpu_t* gpu);
+
+const char* limit_name(Limit_t limit);
+
+/*
+ * Calls observer with context for every placement event from now on, on
+ * the thread placing the blocks. Observers are called in the order they
+ * were added. Adding and removing are not synchronized with placement, so
+ * do both while no GPU is being placed. Returns -1 when
+ * MAX_PLACEMENT_OBSERVERS are already registered.
+ */
+int add_placement_observer(PlacementObserver_t observer, void* context);
+
+void remove_placement_observer(PlacementObserver_t observer, void* context);
+
 void clear_kernel_blocks(Gpu_t* gpu, Kernel_t* kernel);
 
 void print_GPU_info(Gpu_t* gpu);
 
+int ensure_results_dir(void);
+
+void results_path_of_GPU(Gpu_t* gpu, const char* suffix, char* out, size_t out_size);
+
 void export_GPU_to_HTML(Gpu_t* gpu);
 
 bool canFitBlock(Gpu_t* gpu, int sm_pos, Block_t* block);
 
-void launch_one_kernel(Gpu_t* gpu, Kernel_t* kernel);
+unsigned int fit_mask_of_SMs(const Gpu_t* gpu, int first_SM, const Block_t* block);
+
+int find_fitting_SM(const Gpu_t* gpu, int first_SM, const Block_t* block);
+
+void place_block_on_SM(Gpu_t* gpu, int sm_pos, Block_t* block);
+
+unsigned int place_kernel_blocks(Gpu_t* gpu, Kernel_t* kernel);
+
+void print_kernel_launch_result(Gpu_t* gpu, Kernel_t* kernel, unsigned int dropped);
+
+unsigned int launch_one_kernel(Gpu_t* gpu, Kernel_t* kernel);
 
 void launch_kernels(Gpu_t* gpu, Kernel_t* kernel_arr, int arr_size);
 
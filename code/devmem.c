@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devmem.h"
+
+// Holder of the device ranges the caching allocator reserved as segments
+static const char segment_holder[] = "(segment)";
+
+static unsigned long long round_up(unsigned long long n, unsigned long long to) {
+  return (n + to - 1) / to * to;
+}
+
+const char* allocator_name(Allocator_t allocator) {
+  switch (allocator) {
+    case ALLOCATOR_FIRST_FIT: return "first-fit";
+    case ALLOCATOR_BUMP:      return "bump";
+    case ALLOCATOR_CACHING:   return "caching";
+  }
+  return "unknown";
+}
+
+int parse_allocator(const char* name, Allocator_t* out) {
+  static const Allocator_t allocators[] = { ALLOCATOR_FIRST_FIT, ALLOCATOR_BUMP, ALLOCATOR_CACHING };
+  for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+    if (!strcmp(name, allocator_name(allocators[i]))) {
+      *out = allocators[i];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+bool kernels_use_device_memory(const Kernel_t* kernels, int kernel_count) {
+  for (int k = 0; k < kernel_count; k++) {
+    if (kernels[k].memory_bytes || kernels[k].free_count) return true;
+  }
+  return false;
+}
+
+// FNV-1a, continuing from h
+static uint32_t hash_string(uint32_t h, const char* s) {
+  for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+    h ^= *p;
+    h *= 0x01000193u;
+  }
+  // The terminator too, so ["ab"] and ["a", "b"] differ
+  return h * 0x01000193u;
+}
+
+uint32_t memory_hash_of_kernel(const Kernel_t* kernel) {
+  if (!kernel->memory_bytes && !kernel->free_count) return 0;
+  uint32_t h = hash_string(0x811c9dc5u, kernel->name);
+  for (unsigned short i = 0; i < kernel->free_count; i++) {
+    h = hash_string(h, kernel->frees[i]);
+  }
+  return h ? h : 1;
+}
+
+// ================= Block Lists ==================
+
+// Makes room for extra more blocks, so insert_block() cannot fail
+static int reserve_blocks(DevBlocks_t* list, int extra) {
+  if (list->count + extra <= list->capacity) return 0;
+  int grown = list->capacity ? 2 * list->capacity : 16;
+  while (grown < list->count + extra) grown *= 2;
+  DevBlock_t* blocks = realloc(list->blocks, sizeof(DevBlock_t) * grown);
+  if (!blocks) return -1;
+  list->blocks = blocks;
+  list->capacity = grown;
+  return 0;
+}
+
+static void insert_block(DevBlocks_t* list, int index, DevBlock_t block) {
+  memmove(&list->blocks[index + 1], &list->blocks[index], sizeof(DevBlock_t) * (list->count - index));
+  list->blocks[index] = block;
+  list->count++;
+}
+
+static void remove_block(DevBlocks_t* list, int index) {
+  memmove(&list->blocks[index], &list->blocks[index + 1], sizeof(DevBlock_t) * (list->count - index - 1));
+  list->count--;
+}
+
+// Index where a block at offset belongs
+static int position_of(const DevBlocks_t* list, unsigned long long offset) {
+  int lo = 0, hi = list->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (list->blocks[mid].offset < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Cuts the free block at index down to size; the rest becomes a free block after it
+static void split_block(DevBlocks_t* list, int index, unsigned long long size) {
+  DevBlock_t rest = list->blocks[index];
+  if (rest.size == size) return;
+  rest.offset += size;
+  rest.size -= size;
+  list->blocks[index].size = size;
+  insert_block(list, index + 1, rest);
+}
+
+// Merges the free block at index with free neighbours of the same segment
+static void merge_free(DevBlocks_t* list, int index) {
+  DevBlock_t* blocks = list->blocks;
+  if (index + 1 < list->count && !blocks[index + 1].holder &&
+      blocks[index + 1].segment == blocks[index].segment) {
+    blocks[index].size += blocks[index + 1].size;
+    remove_block(list, index + 1);
+  }
+  if (index > 0 && !blocks[index - 1].holder && blocks[index - 1].segment == blocks[index].segment) {
+    blocks[index - 1].size += blocks[index].size;
+    remove_block(list, index);
+  }
+}
+
+// Takes size from the lowest free block large enough; returns its index or -1
+static int take_first_fit(DevBlocks_t* list, unsigned long long size, const char* holder) {
+  for (int i = 0; i < list->count; i++) {
+    if (list->blocks[i].holder || list->blocks[i].size < size) continue;
+    split_block(list, i, size);
+    list->blocks[i].holder = holder;
+    return i;
+  }
+  return -1;
+}
+
+static unsigned long long largest_free_block(const DevBlocks_t* list) {
+  unsigned long long largest = 0;
+  for (int i = 0; i < list->count; i++) {
+    if (!list->blocks[i].holder && list->blocks[i].size > largest) largest = list->blocks[i].size;
+  }
+  return largest;
+}
+
+// Live block of the latest allocation held by name, or -1
+static int latest_held_by(const DevBlocks_t* list, const char* name) {
+  int latest = -1;
+  for (int i = 0; i < list->count; i++) {
+    const DevBlock_t* block = &list->blocks[i];
+    if (block->holder && !strcmp(block->holder, name) &&
+        (latest < 0 || block->serial > list->blocks[latest].serial)) {
+      latest = i;
+    }
+  }
+  return latest;
+}
+
+// ================= Allocators ==================
+
+int init_device_memory(DevMemory_t* memory, const Gpu_t* gpu) {
+  memset(memory, 0, sizeof(*memory));
+  memory->allocator = gpu->allocator;
+  memory->stats.capacity = gpu->global_mem_size_in_bytes;
+  memory->stats.largest_free = gpu->global_mem_size_in_bytes;
+
+  // Bump keeps only the allocations; the others start from one hole
+  if (memory->allocator != ALLOCATOR_BUMP && memory->stats.capacity) {
+    if (reserve_blocks(&memory->device, 1) != 0) return -1;
+    insert_block(&memory->device, 0, (DevBlock_t){ .size = memory->stats.capacity });
+  }
+  return 0;
+}
+
+void free_device_memory(DevMemory_t* memory) {
+  free(memory->device.blocks);
+  free(memory->cache.blocks);
+  memset(memory, 0, sizeof(*memory));
+}
+
+static unsigned long long bump_top(const DevMemory_t* memory) {
+  const DevBlocks_t* list = &memory->device;
+  return list->count ? list->blocks[list->count - 1].offset + list->blocks[list->count - 1].size : 0;
+}
+
+// Index of the new block, or -1
+static int bump_allocate(DevMemory_t* memory, unsigned long long size, const char* holder) {
+  unsigned long long top = bump_top(memory);
+  if (memory->stats.capacity - top < size) return -1;
+  insert_block(&memory->device, memory->device.count, (DevBlock_t){ .offset = top, .size = size, .holder = holder });
+  return memory->device.count - 1;
+}
+
+// Gives every fully free segment back to the device; returns how many
+static int release_cached_segments(DevMemory_t* memory) {
+  int released = 0;
+  for (int i = 0; i < memory->cache.count; ) {
+    DevBlock_t block = memory->cache.blocks[i];
+    if (block.holder || block.size != block.segment_size) {
+      i++;
+      continue;
+    }
+    remove_block(&memory->cache, i);
+    int d = position_of(&memory->device, block.segment);
+    memory->device.blocks[d].holder = NULL;
+    merge_free(&memory->device, d);
+    memory->stats.reserved -= block.size;
+    released++;
+  }
+  memory->stats.segments_released += released;
+  return released;
+}
+
+// Smallest cached free block of the pool that holds size, or -1
+static int best_cached_fit(const DevMemory_t* memory, unsigned long long size, bool small) {
+  int best = -1;
+  for (int i = 0; i < memory->cache.count; i++) {
+    const DevBlock_t* block = &memory->cache.blocks[i];
+    if (block->holder || block->size < size || (block->segment_size == CACHING_SMALL_SEGMENT) != small) continue;
+    if (best < 0 || block->size < memory->cache.blocks[best].size) best = i;
+  }
+  return best;
+}
+
+static int caching_allocate(DevMemory_t* memory, unsigned long long size, const char* holder) {
+  bool small = size <= CACHING_SMALL_SIZE;
+  int i = best_cached_fit(memory, size, small);
+  if (i < 0) {
+    unsigned long long segment = small ? CACHING_SMALL_SEGMENT :
+      size < CACHING_MIN_LARGE_ALLOC ? CACHING_LARGE_SEGMENT : round_up(size, CACHING_SEGMENT_ROUND);
+    int d = take_first_fit(&memory->device, segment, segment_holder);
+    if (d < 0 && release_cached_segments(memory) > 0) {
+      d = take_first_fit(&memory->device, segment, segment_holder);
+    }
+    if (d < 0) return -1;
+
+    unsigned long long offset = memory->device.blocks[d].offset;
+    i = position_of(&memory->cache, offset);
+    insert_block(&memory->cache, i, (DevBlock_t){
+      .offset = offset, .size = segment, .segment = offset, .segment_size = segment,
+    });
+    memory->stats.reserved += segment;
+  }
+
+  // The rest stays a separate block only when it can serve another request of its pool
+  unsigned long long rest = memory->cache.blocks[i].size - size;
+  if (small ? rest >= CACHING_ROUND : rest > CACHING_SMALL_SIZE) split_block(&memory->cache, i, size);
+  memory->cache.blocks[i].holder = holder;
+  return i;
+}
+
+// List holding the kernels' allocations
+static DevBlocks_t* allocations_of(DevMemory_t* memory) {
+  return memory->allocator == ALLOCATOR_CACHING ? &memory->cache : &memory->device;
+}
+
+static void free_allocation(DevMemory_t* memory, int index) {
+  DevBlocks_t* list = allocations_of(memory);
+  memory->stats.allocated -= list->blocks[index].size;
+  if (memory->allocator == ALLOCATOR_FIRST_FIT) memory->stats.reserved -= list->blocks[index].size;
+  memory->stats.frees++;
+  list->blocks[index].holder = NULL;
+
+  if (memory->allocator == ALLOCATOR_BUMP) {
+    // Only the top comes back, and with it whatever was freed below it
+    while (list->count && !list->blocks[list->count - 1].holder) list->count--;
+  } else {
+    merge_free(list, index);
+  }
+}
+
+static void update_free_space(DevMemory_t* memory) {
+  DevMemoryStats_t* stats = &memory->stats;
+  if (memory->allocator == ALLOCATOR_BUMP) {
+    // Freed memory under the top is still used up
+    stats->reserved = bump_top(memory);
+    stats->largest_free = stats->capacity - stats->reserved;
+  } else {
+    stats->largest_free = largest_free_block(&memory->device);
+    if (memory->allocator == ALLOCATOR_CACHING) {
+      unsigned long long cached = largest_free_block(&memory->cache);
+      if (cached > stats->largest_free) stats->largest_free = cached;
+    }
+  }
+
+  unsigned long long free_bytes = stats->capacity - stats->allocated;
+  stats->fragmentation = free_bytes ? 1.0 - (double)stats->largest_free / free_bytes : 0.0;
+  if (stats->fragmentation > stats->peak_fragmentation) stats->peak_fragmentation = stats->fragmentation;
+  if (stats->allocated > stats->peak_allocated) stats->peak_allocated = stats->allocated;
+  if (stats->reserved > stats->peak_reserved) stats->peak_reserved = stats->reserved;
+}
+
+bool allocate_kernel_memory(DevMemory_t* memory, const Kernel_t* kernel) {
+  if (memory->failed) return false;
+  if (!kernel->memory_bytes && !kernel->free_count) return true;
+
+  // An allocation splits at most one device block, and when caching also
+  // adds a segment and splits it in the cache
+  if (reserve_blocks(&memory->device, 1) != 0 ||
+      (memory->allocator == ALLOCATOR_CACHING && reserve_blocks(&memory->cache, 2) != 0)) {
+    memory->failed = true;
+    return false;
+  }
+
+  for (unsigned short f = 0; f < kernel->free_count; f++) {
+    int index = latest_held_by(allocations_of(memory), kernel->frees[f]);
+    if (index >= 0) free_allocation(memory, index);
+  }
+
+  bool allocated = true;
+  if (kernel->memory_bytes) {
+    DevMemoryStats_t* stats = &memory->stats;
+    unsigned long long size = kernel->memory_bytes;
+    int index = -1;
+    if (size <= stats->capacity) {
+      size = round_up(size, memory->allocator == ALLOCATOR_CACHING ? CACHING_ROUND : DEVMEM_ALIGNMENT);
+      switch (memory->allocator) {
+        case ALLOCATOR_FIRST_FIT: index = take_first_fit(&memory->device, size, kernel->name); break;
+        case ALLOCATOR_BUMP:      index = bump_allocate(memory, size, kernel->name); break;
+        case ALLOCATOR_CACHING:   index = caching_allocate(memory, size, kernel->name); break;
+      }
+    }
+
+    if (index >= 0) {
+      DevBlock_t* block = &allocations_of(memory)->blocks[index];
+      block->serial = ++memory->next_serial;
+      stats->allocated += block->size;
+      if (memory->allocator == ALLOCATOR_FIRST_FIT) stats->reserved += block->size;
+      stats->allocations++;
+    } else {
+      stats->oom_launches++;
+      if (stats->capacity - stats->allocated >= size) stats->oom_fragmented++;
+      allocated = false;
+    }
+  }
+
+  update_free_space(memory);
+  return allocated;
+}
+
+// ================= Launching ==================
+
+unsigned int place_kernel_with_memory(Gpu_t* gpu, DevMemory_t* memory, Kernel_t* kernel) {
+  if (memory && !allocate_kernel_memory(memory, kernel)) return kernel->number_of_blocks;
+  return place_kernel_blocks(gpu, kernel);
+}
+
+void print_kernel_out_of_memory(const Gpu_t* gpu, const DevMemory_t* memory, const Kernel_t* kernel) {
+  printf("kernel %s not launched: %llu bytes of device memory do not fit in GPU %s "
+         "(%llu free, largest free range %llu)\n",
+         kernel->name, kernel->memory_bytes, gpu->name,
+         memory->stats.capacity - memory->stats.allocated, memory->stats.largest_free);
+}
+
+unsigned int launch_kernel_with_memory(Gpu_t* gpu, DevMemory_t* memory, Kernel_t* kernel) {
+  if (memory && !allocate_kernel_memory(memory, kernel)) {
+    if (!memory->failed) print_kernel_out_of_memory(gpu, memory, kernel);
+    return kernel->number_of_blocks;
+  }
+  return launch_one_kernel(gpu, kernel);
+}
+
+void print_device_memory(const Gpu_t* gpu, const DevMemory_t* memory) {
+  const DevMemoryStats_t* stats = &memory->stats;
+  const double mib = 1024.0 * 1024.0;
+  printf("\nDevice memory of %s (%s allocator): peak %.1f MiB allocated, %.1f MiB reserved of %.1f MiB\n",
+         gpu->name, allocator_name(memory->allocator),
+         stats->peak_allocated / mib, stats->peak_reserved / mib, stats->capacity / mib);
+  printf("  %u allocations, %u frees; fragmentation %.1f%% at the end, %.1f%% at worst\n",
+         stats->allocations, stats->frees, 100.0 * stats->fragmentation, 100.0 * stats->peak_fragmentation);
+  if (memory->allocator == ALLOCATOR_CACHING) {
+    printf("  %.1f MiB cached but unallocated at the end, %u segments released to retry\n",
+           (stats->reserved - stats->allocated) / mib, stats->segments_released);
+  }
+  printf("  %u launches blocked by out-of-memory, %u of them with enough memory free in total\n",
+         stats->oom_launches, stats->oom_fragmented);
+}
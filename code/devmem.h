@@ -0,0 +1,120 @@
+#ifndef DEVMEM_H
+#define DEVMEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cuda_arch.h"
+
+/*
+ * Global memory of a GPU as kernels allocate it. Before a kernel's blocks
+ * are placed, the allocations of the earlier kernels it names in "frees"
+ * are released and its memory_bytes are allocated; a launch whose memory
+ * cannot be allocated places no block. Allocators:
+ *
+ *   first-fit  address-ordered free list, split on allocation and
+ *              coalesced on free
+ *   bump       one pointer moving up; memory comes back only when the top
+ *              allocation is freed, or everything is
+ *   caching    like the caching allocators of deep learning frameworks:
+ *              sizes rounded to 512 bytes, requests up to 1 MiB split from
+ *              2 MiB segments, larger ones from 20 MiB segments (or their
+ *              own, rounded to 2 MiB, from 10 MiB). Freed blocks stay cached
+ *              in their segment for reuse, best fit first; fully free
+ *              segments go back to the device only when an allocation
+ *              would otherwise fail.
+ */
+
+// Every allocation and segment starts on this boundary
+#define DEVMEM_ALIGNMENT 256
+
+#define CACHING_ROUND 512
+#define CACHING_SMALL_SIZE (1ull << 20)
+#define CACHING_SMALL_SEGMENT (2ull << 20)
+#define CACHING_LARGE_SEGMENT (20ull << 20)
+#define CACHING_MIN_LARGE_ALLOC (10ull << 20)
+#define CACHING_SEGMENT_ROUND (2ull << 20)
+
+// ================= Type Declaration ==================
+
+// A range of the address space: an allocation, a hole, or for the caching
+// allocator a segment (device list) or a block split from one (cache list)
+typedef struct DEV_BLOCK {
+  unsigned long long offset;
+  unsigned long long size;
+  unsigned long long segment;        // caching: offset of the segment holding the block
+  unsigned long long segment_size;
+  unsigned long long serial;         // allocation order, to free the latest of a name first
+  const char* holder;                // kernel name, NULL when free
+} DevBlock_t;
+
+typedef struct DEV_BLOCKS {
+  DevBlock_t* blocks;                // sorted by offset
+  int count;
+  int capacity;
+} DevBlocks_t;
+
+typedef struct DEV_MEMORY_STATS {
+  unsigned long long capacity;
+  unsigned long long allocated;       // held by kernels
+  unsigned long long reserved;        // taken from the device: cached segments, or up to the bump pointer
+  unsigned long long peak_allocated;
+  unsigned long long peak_reserved;
+  unsigned long long largest_free;    // largest allocation that would fit now
+  double fragmentation;               // 1 - largest_free / (capacity - allocated)
+  double peak_fragmentation;          // highest after any launch
+  unsigned int allocations;
+  unsigned int frees;
+  unsigned int oom_launches;          // launches blocked for lack of memory
+  unsigned int oom_fragmented;        // of those, with enough memory free in total
+  unsigned int segments_released;     // caching: segments given back to retry
+} DevMemoryStats_t;
+
+typedef struct DEV_MEMORY {
+  Allocator_t allocator;
+  DevBlocks_t device;                 // holes and allocations, or segments when caching
+  DevBlocks_t cache;                  // caching: blocks of the segments
+  unsigned long long next_serial;
+  DevMemoryStats_t stats;
+  bool failed;                        // host memory ran out; nothing is allocated from then on
+} DevMemory_t;
+
+// ================= Function Declarations ==================
+
+const char* allocator_name(Allocator_t allocator);
+
+// "first-fit", "bump" or "caching"; returns -1 for anything else
+int parse_allocator(const char* name, Allocator_t* out);
+
+// True when a kernel allocates or frees memory, so the GPUs need a model
+bool kernels_use_device_memory(const Kernel_t* kernels, int kernel_count);
+
+// 0 for a kernel without memory, otherwise a hash of its name and frees
+uint32_t memory_hash_of_kernel(const Kernel_t* kernel);
+
+// Empty memory of the GPU's size and allocator; -1 when host memory runs
+// out, leaving nothing to free
+int init_device_memory(DevMemory_t* memory, const Gpu_t* gpu);
+
+void free_device_memory(DevMemory_t* memory);
+
+/*
+ * Frees what the kernel names in "frees", latest allocation of each name
+ * first, then allocates its memory_bytes. Returns false, counting an
+ * out-of-memory launch, when the allocation does not fit. Also returns
+ * false, setting failed instead, when host memory runs out.
+ */
+bool allocate_kernel_memory(DevMemory_t* memory, const Kernel_t* kernel);
+
+// place_kernel_blocks() once the kernel's memory is allocated; all of its
+// blocks are dropped when it is not
+unsigned int place_kernel_with_memory(Gpu_t* gpu, DevMemory_t* memory, Kernel_t* kernel);
+
+// The same, printing the outcome like launch_one_kernel()
+unsigned int launch_kernel_with_memory(Gpu_t* gpu, DevMemory_t* memory, Kernel_t* kernel);
+
+// What launch_kernel_with_memory() prints for a kernel whose memory did not fit
+void print_kernel_out_of_memory(const Gpu_t* gpu, const DevMemory_t* memory, const Kernel_t* kernel);
+
+void print_device_memory(const Gpu_t* gpu, const DevMemory_t* memory);
+
+#endif // DEVMEM_H
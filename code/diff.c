@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "diff.h"
+#include "occupancy.h"
+#include "cJSON.h"
+
+// Decimals kept of every occupancy, as written to results.json
+#define SUMMARY_DECIMALS 4
+
+// Occupancy differences below this are rounding, not changes
+#define SUMMARY_EPSILON 1e-9
+
+// Rounded the way results.json prints it, so a value read back compares equal
+static double rounded(double value) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", SUMMARY_DECIMALS, value);
+  return strtod(text, NULL);
+}
+
+static GpuSummary_t* new_gpu_summary(RunSummary_t* summary, const char* name, int kernel_count) {
+  if (summary->gpu_count == summary->capacity) {
+    int capacity = summary->capacity ? summary->capacity * 2 : 8;
+    GpuSummary_t* gpus = realloc(summary->gpus, capacity * sizeof(GpuSummary_t));
+    if (!gpus) return NULL;
+    summary->gpus = gpus;
+    summary->capacity = capacity;
+  }
+
+  GpuSummary_t* gpu = &summary->gpus[summary->gpu_count];
+  memset(gpu, 0, sizeof(*gpu));
+  gpu->name = strdup(name);
+  gpu->kernels = calloc(kernel_count ? kernel_count : 1, sizeof(KernelSummary_t));
+  if (!gpu->name || !gpu->kernels) {
+    free(gpu->name);
+    free(gpu->kernels);
+    return NULL;
+  }
+  summary->gpu_count++;
+  return gpu;
+}
+
+int add_GPU_to_summary(
+  RunSummary_t* summary,
+  Gpu_t* gpu,
+  const Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+) {
+  GpuSummary_t* entry = new_gpu_summary(summary, gpu->name, kernel_count);
+  if (!entry) {
+    perror("Failed to allocate run summary");
+    return -1;
+  }
+
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    entry->occupancy += calculate_occupancy_of_SM(gpu, i);
+    entry->placed += gpu->list_of_SMs[i].number_of_blocks;
+  }
+  if (gpu->number_of_SMs) entry->occupancy /= gpu->number_of_SMs;
+  entry->occupancy = rounded(entry->occupancy);
+
+  OccupancyTable_t table = new_occupancy_table(gpu);
+  for (int k = 0; k < kernel_count; k++) {
+    KernelSummary_t* kernel = &entry->kernels[entry->kernel_count];
+    kernel->name = strdup(kernels[k].name);
+    if (!kernel->name) {
+      perror("Failed to allocate run summary");
+      return -1;
+    }
+    entry->kernel_count++;
+
+    float occupancy;
+    unsigned char limit;
+    unsigned short blocks_per_SM;
+    occupancy_of_shape(&table, kernels[k].threads_per_block, kernels[k].registers_per_thread,
+                       kernels[k].shared_mem_used_in_bytes_per_block,
+                       &occupancy, &limit, &blocks_per_SM);
+    kernel->occupancy = rounded(occupancy);
+    kernel->dropped = dropped ? dropped[k] : 0;
+    kernel->placed = kernels[k].number_of_blocks - kernel->dropped;
+    snprintf(kernel->limit, sizeof(kernel->limit), "%s", limit_name(limit));
+    entry->dropped += kernel->dropped;
+  }
+  return 0;
+}
+
+void free_run_summary(RunSummary_t* summary) {
+  for (int g = 0; g < summary->gpu_count; g++) {
+    GpuSummary_t* gpu = &summary->gpus[g];
+    for (int k = 0; k < gpu->kernel_count; k++) free(gpu->kernels[k].name);
+    free(gpu->kernels);
+    free(gpu->name);
+  }
+  free(summary->gpus);
+  memset(summary, 0, sizeof(*summary));
+}
+
+// ================= Reading results.json ==================
+
+static char* read_file(const char* path) {
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "Failed to open %s: ", path);
+    perror(NULL);
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long len = ftell(fp);
+  rewind(fp);
+
+  char* data = malloc(len + 1);
+  if (!data) {
+    fprintf(stderr, "Memory allocation failed\n");
+    fclose(fp);
+    return NULL;
+  }
+  size_t read = fread(data, 1, len, fp);
+  data[read] = '\0';
+  fclose(fp);
+  return data;
+}
+
+static double number_of(const cJSON* object, const char* key) {
+  const cJSON* item = cJSON_GetObjectItem(object, key);
+  return cJSON_IsNumber(item) ? item->valuedouble : 0.0;
+}
+
+static int read_gpu_summary(RunSummary_t* summary, const cJSON* gpu) {
+  const cJSON* name = cJSON_GetObjectItem(gpu, "name");
+  const cJSON* kernels = cJSON_GetObjectItem(gpu, "kernels");
+  if (!cJSON_IsString(name) || !cJSON_IsArray(kernels)) return -1;
+
+  GpuSummary_t* entry = new_gpu_summary(summary, name->valuestring, cJSON_GetArraySize(kernels));
+  if (!entry) return -1;
+  entry->occupancy = number_of(gpu, "average_occupancy");
+  entry->placed = (unsigned long long)number_of(gpu, "blocks_placed");
+
+  const cJSON* kernel;
+  cJSON_ArrayForEach(kernel, kernels) {
+    const cJSON* kernel_name = cJSON_GetObjectItem(kernel, "name");
+    const cJSON* limit = cJSON_GetObjectItem(kernel, "limit");
+    if (!cJSON_IsString(kernel_name)) return -1;
+
+    KernelSummary_t* k = &entry->kernels[entry->kernel_count];
+    k->name = strdup(kernel_name->valuestring);
+    if (!k->name) return -1;
+    entry->kernel_count++;
+    k->occupancy = number_of(kernel, "theoretical_occupancy");
+    k->placed = (unsigned long long)number_of(kernel, "placed");
+    k->dropped = (unsigned long long)number_of(kernel, "dropped");
+    snprintf(k->limit, sizeof(k->limit), "%s", cJSON_IsString(limit) ? limit->valuestring : "unknown");
+    entry->dropped += k->dropped;
+  }
+  return 0;
+}
+
+int load_run_summary(const char* path, RunSummary_t* summary) {
+  memset(summary, 0, sizeof(*summary));
+  char* data = read_file(path);
+  if (!data) return -1;
+
+  cJSON* root = cJSON_Parse(data);
+  free(data);
+  if (!root) {
+    fprintf(stderr, "Error parsing JSON in %s: %s\n", path, cJSON_GetErrorPtr());
+    return -1;
+  }
+
+  // A config lists the kernels once; results list them under each GPU
+  if (cJSON_GetObjectItem(root, "kernels")) {
+    cJSON_Delete(root);
+    return 1;
+  }
+
+  const cJSON* gpus = cJSON_GetObjectItem(root, "gpus");
+  int status = cJSON_IsArray(gpus) ? 0 : -1;
+  const cJSON* gpu;
+  cJSON_ArrayForEach(gpu, gpus) {
+    if (status != 0) break;
+    status = read_gpu_summary(summary, gpu);
+  }
+  cJSON_Delete(root);
+
+  if (status != 0) {
+    fprintf(stderr, "Error: %s is neither a config nor a results.json written by --json\n", path);
+    free_run_summary(summary);
+  }
+  return status;
+}
+
+// ================= Matching kernels ==================
+
+// Launches of one kernel name on one GPU, in both runs
+typedef struct NAME_ENTRY {
+  const char* name;          // NULL for an empty slot
+  int next_after;            // first launch in after not yet matched, -1 when none
+  int last_after;
+  int before_count;          // launches in before seen so far
+} NameEntry_t;
+
+/*
+ * Pairs the nth launch of a name in before with the nth launch of that
+ * name in after, through a table of names with open addressing, so a GPU
+ * with many launches is matched in linear time.
+ */
+typedef struct KERNEL_MATCH {
+  unsigned int slot_count;   // a power of two, over twice the names
+  NameEntry_t* slots;
+  int* next_launch;          // next launch in after of the same name, -1 at the end
+  int* occurrence;           // of each launch in after among those of its name
+  bool* matched;             // launches in after paired with one in before
+} KernelMatch_t;
+
+// FNV-1a of a kernel name
+static uint32_t hash_name(const char* name) {
+  uint32_t h = 0x811c9dc5u;
+  for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+    h ^= *p;
+    h *= 0x01000193u;
+  }
+  return h;
+}
+
+static NameEntry_t* name_entry(KernelMatch_t* match, const char* name) {
+  for (uint32_t i = hash_name(name); ; i++) {
+    NameEntry_t* entry = &match->slots[i & (match->slot_count - 1)];
+    if (!entry->name) {
+      *entry = (NameEntry_t){ .name = name, .next_after = -1, .last_after = -1 };
+      return entry;
+    }
+    if (!strcmp(entry->name, name)) return entry;
+  }
+}
+
+static KernelMatch_t new_kernel_match(const GpuSummary_t* before, const GpuSummary_t* after) {
+  KernelMatch_t match = { .slot_count = 16 };
+  while (match.slot_count < 2u * (before->kernel_count + after->kernel_count)) match.slot_count *= 2;
+  int count = after->kernel_count ? after->kernel_count : 1;
+  match.slots = calloc(match.slot_count, sizeof(NameEntry_t));
+  match.next_launch = malloc(count * sizeof(int));
+  match.occurrence = malloc(count * sizeof(int));
+  match.matched = calloc(count, sizeof(bool));
+  if (!match.slots || !match.next_launch || !match.occurrence || !match.matched) {
+    perror("Failed to allocate kernel matching");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int k = 0; k < after->kernel_count; k++) {
+    NameEntry_t* entry = name_entry(&match, after->kernels[k].name);
+    match.next_launch[k] = -1;
+    match.occurrence[k] = 0;
+    if (entry->last_after < 0) {
+      entry->next_after = k;
+    } else {
+      match.next_launch[entry->last_after] = k;
+      match.occurrence[k] = match.occurrence[entry->last_after] + 1;
+    }
+    entry->last_after = k;
+  }
+  return match;
+}
+
+static void free_kernel_match(KernelMatch_t* match) {
+  free(match->slots);
+  free(match->next_launch);
+  free(match->occurrence);
+  free(match->matched);
+}
+
+// Later launches of a name are numbered from the second: "GPU / K #2"
+static void kernel_subject(char* subject, size_t size, const char* gpu, const char* kernel, int occurrence) {
+  if (occurrence) snprintf(subject, size, "%s / %s #%d", gpu, kernel, occurrence + 1);
+  else snprintf(subject, size, "%s / %s", gpu, kernel);
+}
+
+// ================= Comparing ==================
+
+typedef struct DIFF_COUNTS {
+  int regressions;
+  int improvements;
+  int changes;
+} DiffCounts_t;
+
+static const GpuSummary_t* find_gpu_summary(const RunSummary_t* summary, const char* name) {
+  for (int g = 0; g < summary->gpu_count; g++) {
+    if (!strcmp(summary->gpus[g].name, name)) return &summary->gpus[g];
+  }
+  return NULL;
+}
+
+static void print_occupancy_change(FILE* out, DiffCounts_t* counts, const DiffThresholds_t* thresholds,
+                                   const char* subject, const char* what, double before, double after) {
+  double change = after - before;
+  if (change > -SUMMARY_EPSILON && change < SUMMARY_EPSILON) return;
+
+  const char* verdict = "";
+  if (change < -thresholds->occupancy - SUMMARY_EPSILON) {
+    verdict = " REGRESSION";
+    counts->regressions++;
+  } else if (change > 0) {
+    counts->improvements++;
+  } else {
+    counts->changes++;
+  }
+  fprintf(out, "%s: %s %.2f%% -> %.2f%% (%+.2f pts)%s\n",
+          subject, what, before * 100.0, after * 100.0, change * 100.0, verdict);
+}
+
+static void print_blocks_change(FILE* out, DiffCounts_t* counts, const DiffThresholds_t* thresholds,
+                                const char* subject, unsigned long long before, unsigned long long after) {
+  if (before == after) return;
+
+  const char* verdict = "";
+  if (after < before && before - after > thresholds->blocks) {
+    verdict = " REGRESSION";
+    counts->regressions++;
+  } else if (after > before) {
+    counts->improvements++;
+  } else {
+    counts->changes++;
+  }
+  fprintf(out, "%s: blocks placed %llu -> %llu (%+lld)%s\n",
+          subject, before, after, (long long)(after - before), verdict);
+}
+
+static void diff_gpu(FILE* out, DiffCounts_t* counts, const DiffThresholds_t* thresholds,
+                     const GpuSummary_t* before, const GpuSummary_t* after) {
+  print_occupancy_change(out, counts, thresholds, before->name, "average occupancy",
+                         before->occupancy, after->occupancy);
+  print_blocks_change(out, counts, thresholds, before->name, before->placed, after->placed);
+
+  KernelMatch_t match = new_kernel_match(before, after);
+  char subject[512];
+  for (int k = 0; k < before->kernel_count; k++) {
+    const KernelSummary_t* old = &before->kernels[k];
+    NameEntry_t* entry = name_entry(&match, old->name);
+    kernel_subject(subject, sizeof(subject), before->name, old->name, entry->before_count++);
+    int paired = entry->next_after;
+    if (paired < 0) {
+      fprintf(out, "%s: missing from the new run REGRESSION\n", subject);
+      counts->regressions++;
+      continue;
+    }
+    entry->next_after = match.next_launch[paired];
+    match.matched[paired] = true;
+    const KernelSummary_t* new = &after->kernels[paired];
+
+    print_occupancy_change(out, counts, thresholds, subject, "theoretical occupancy",
+                           old->occupancy, new->occupancy);
+    print_blocks_change(out, counts, thresholds, subject, old->placed, new->placed);
+    if (strcmp(old->limit, new->limit)) {
+      fprintf(out, "%s: limited by %s -> %s\n", subject, old->limit, new->limit);
+      counts->changes++;
+    }
+  }
+
+  for (int k = 0; k < after->kernel_count; k++) {
+    if (!match.matched[k]) {
+      kernel_subject(subject, sizeof(subject), after->name, after->kernels[k].name, match.occurrence[k]);
+      fprintf(out, "%s: new kernel, %llu blocks placed\n", subject, after->kernels[k].placed);
+      counts->changes++;
+    }
+  }
+  free_kernel_match(&match);
+}
+
+int diff_run_summaries(const RunSummary_t* before, const RunSummary_t* after,
+                       const DiffThresholds_t* thresholds, FILE* out) {
+  DiffCounts_t counts = {0};
+  for (int g = 0; g < before->gpu_count; g++) {
+    const GpuSummary_t* new = find_gpu_summary(after, before->gpus[g].name);
+    if (!new) {
+      fprintf(out, "%s: missing from the new run REGRESSION\n", before->gpus[g].name);
+      counts.regressions++;
+      continue;
+    }
+    diff_gpu(out, &counts, thresholds, &before->gpus[g], new);
+  }
+  for (int g = 0; g < after->gpu_count; g++) {
+    if (!find_gpu_summary(before, after->gpus[g].name)) {
+      fprintf(out, "%s: new GPU, %llu blocks placed\n", after->gpus[g].name, after->gpus[g].placed);
+      counts.changes++;
+    }
+  }
+
+  fprintf(out, "%d regressions, %d improvements, %d other changes\n",
+          counts.regressions, counts.improvements, counts.changes);
+  return counts.regressions;
+}
@@ -0,0 +1,76 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "cuda_arch.h"
+
+// ================= Type Declaration ==================
+
+// Outcome of one kernel on one GPU
+typedef struct KERNEL_SUMMARY {
+  char* name;
+  double occupancy;          // theoretical occupancy of its block shape
+  unsigned long long placed;
+  unsigned long long dropped;
+  char limit[16];            // resource that caps the blocks per SM
+} KernelSummary_t;
+
+typedef struct GPU_SUMMARY {
+  char* name;
+  double occupancy;          // mean over the SMs
+  unsigned long long placed;
+  unsigned long long dropped;
+  int kernel_count;
+  KernelSummary_t* kernels;
+} GpuSummary_t;
+
+/*
+ * What a run produced, per GPU and per kernel on each GPU, read back from
+ * the results.json of --json or built from GPUs as they are simulated.
+ * Occupancies are rounded to 4 decimals, as in results.json, so both
+ * sources compare equal for the same placement.
+ */
+typedef struct RUN_SUMMARY {
+  int gpu_count;
+  int capacity;
+  GpuSummary_t* gpus;
+} RunSummary_t;
+
+// Changes that count as regressions; anything smaller is only reported
+typedef struct DIFF_THRESHOLDS {
+  double occupancy;          // largest allowed drop, as a fraction
+  unsigned long long blocks; // largest allowed drop in blocks placed
+} DiffThresholds_t;
+
+// ================= Function Declarations ==================
+
+/*
+ * Reads a results.json written by --json. Returns 0, 1 when the file is a
+ * config (it has "kernels") and must be simulated instead, or -1 after
+ * printing why it could not be read.
+ */
+int load_run_summary(const char* path, RunSummary_t* summary);
+
+// dropped[k] is the number of blocks of kernels[k] that did not fit
+int add_GPU_to_summary(
+  RunSummary_t* summary,
+  Gpu_t* gpu,
+  const Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+);
+
+void free_run_summary(RunSummary_t* summary);
+
+/*
+ * Prints every change from before to after, one line each, then a total.
+ * GPUs are matched by name, kernels by name and launch order: the second
+ * launch of a name is compared with the second one in after. Returns the number of regressions:
+ * lower occupancy or fewer blocks placed beyond the thresholds, or a GPU
+ * or kernel missing from after.
+ */
+int diff_run_summaries(const RunSummary_t* before, const RunSummary_t* after,
+                       const DiffThresholds_t* thresholds, FILE* out);
+
+#endif // DIFF_H
@@ -0,0 +1,409 @@
+/*
+ * Synthetic workload generator:
+ *   gen_workload [options] > workload.json
+ * Writes a config in the format of config.json: a fleet of GPUs and a mix
+ * of kernel launches, the same for the same seed and options. Launches are
+ * drawn from a smaller set of kernel types, a few of them launched far more
+ * often than the rest, as real applications do. Each launch also gets an
+ * arrival time and a duration in microseconds. The duration sets how long
+ * the launch runs on the stream timeline; the arrival time is ignored.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "writer.h"
+
+#define MAX_THREAD_CHOICES 16
+
+typedef struct GPU_MODEL {
+  const char* name;
+  unsigned long long memory_bytes;
+  unsigned int shared_mem_per_sm;
+  unsigned int registers_per_sm;
+  unsigned int max_warps_per_sm;
+  unsigned int max_blocks_per_sm;
+  unsigned int num_sms;
+} GpuModel_t;
+
+static const GpuModel_t gpu_models[] = {
+  { "T4",   17179869184ull,  65536, 65536, 32, 16,  40 },
+  { "L4",   25769803776ull, 102400, 65536, 48, 24,  58 },
+  { "A100", 42949672960ull, 167936, 65536, 64, 32, 108 },
+  { "H100", 85899345920ull, 233472, 65536, 64, 32, 132 },
+};
+#define GPU_MODEL_COUNT (int)(sizeof(gpu_models) / sizeof(gpu_models[0]))
+
+// Inclusive range of an integer parameter
+typedef struct RANGE {
+  unsigned long long min;
+  unsigned long long max;
+} Range_t;
+
+typedef struct GEN_OPTIONS {
+  unsigned long long seed;
+  const char* output;
+  int gpus;
+  const char* models;            // comma separated, NULL for all
+  Range_t sms;                   // {0, 0} keeps each model's SM count
+  unsigned long long launches;
+  int kernel_types;
+  int streams;
+  Range_t blocks;                // log-uniform
+  int thread_choices;
+  unsigned int threads[MAX_THREAD_CHOICES];
+  double thread_weights[MAX_THREAD_CHOICES];
+  double registers_mean;
+  double registers_stddev;
+  Range_t shared;                // log-uniform bytes, when used
+  double shared_fraction;        // of kernel types that use shared memory
+  double rate;                   // launches per second
+  double duration_mean;          // microseconds
+  double duration_sigma;         // of the log of the duration
+} GenOptions_t;
+
+typedef struct KERNEL_TYPE {
+  unsigned int blocks;
+  unsigned int threads;
+  unsigned int registers;
+  unsigned int shared_mem;
+  double duration_us;            // median of its launches
+} KernelType_t;
+
+// ================= Random numbers ==================
+
+// splitmix64: one 64-bit state, the same sequence on every platform
+static uint64_t rng_state;
+
+static uint64_t next_u64(void) {
+  uint64_t z = (rng_state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Uniform in (0, 1), never 0 so its log is finite
+static double next_uniform(void) {
+  return ((next_u64() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double next_normal(void) {
+  double u = next_uniform(), v = next_uniform();
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static unsigned long long next_in_range(Range_t range) {
+  return range.min + next_u64() % (range.max - range.min + 1);
+}
+
+// Every order of magnitude between min and max is as likely as any other
+static unsigned long long next_log_uniform(Range_t range) {
+  double low = log((double)(range.min ? range.min : 1));
+  double high = log((double)range.max + 1.0);
+  unsigned long long value = (unsigned long long)exp(low + (high - low) * next_uniform());
+  if (value < range.min) value = range.min;
+  if (value > range.max) value = range.max;
+  return value;
+}
+
+// Index into a cumulative distribution
+static int pick(const double* cdf, int count) {
+  double u = next_uniform() * cdf[count - 1];
+  int low = 0, high = count - 1;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (cdf[mid] < u) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+
+// ================= Options ==================
+
+static void print_usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -o FILE               write to FILE instead of stdout\n"
+          "  --seed=N              random seed (default 1)\n"
+          "  --gpus=N              GPUs in the fleet (default 4)\n"
+          "  --models=LIST         GPU models to draw from, of T4,L4,A100,H100 (default all)\n"
+          "  --sms=MIN:MAX         SMs per GPU instead of each model's own\n"
+          "  --launches=N          kernel launches (default 1000)\n"
+          "  --kernel-types=N      distinct kernels the launches are drawn from (default 32)\n"
+          "  --streams=N           streams the launches are spread over (default 4)\n"
+          "  --blocks=MIN:MAX      blocks per launch, log-uniform (default 1:4096)\n"
+          "  --threads=LIST        block sizes and weights (default 64:1,128:3,256:4,512:2,1024:1)\n"
+          "  --registers=MEAN:SD   registers per thread, normal (default 40:16)\n"
+          "  --shared=MIN:MAX      shared memory bytes per block, log-uniform (default 256:49152)\n"
+          "  --shared-fraction=P   percent of kernels using shared memory (default 60)\n"
+          "  --rate=R              launches per second, Poisson arrivals (default 10000)\n"
+          "  --duration=MEAN:SIGMA kernel duration in us, log-normal (default 50:1)\n",
+          program);
+}
+
+static int parse_range(const char* text, Range_t* range) {
+  char* end;
+  range->min = strtoull(text, &end, 10);
+  if (*end != ':') return -1;
+  range->max = strtoull(end + 1, &end, 10);
+  return *end || range->min > range->max ? -1 : 0;
+}
+
+static int parse_pair(const char* text, double* first, double* second) {
+  char* end;
+  *first = strtod(text, &end);
+  if (*end != ':') return -1;
+  *second = strtod(end + 1, &end);
+  return *end ? -1 : 0;
+}
+
+// "128:3,256:4" or "128,256", where a missing weight is 1
+static int parse_threads(const char* text, GenOptions_t* options) {
+  options->thread_choices = 0;
+  while (*text) {
+    if (options->thread_choices == MAX_THREAD_CHOICES) return -1;
+    char* end;
+    unsigned long threads = strtoul(text, &end, 10);
+    double weight = 1.0;
+    if (*end == ':') weight = strtod(end + 1, &end);
+    if (threads == 0 || threads > 1024 || weight <= 0.0 || (*end && *end != ',')) return -1;
+    options->threads[options->thread_choices] = threads;
+    options->thread_weights[options->thread_choices] = weight;
+    options->thread_choices++;
+    text = *end ? end + 1 : end;
+  }
+  return options->thread_choices ? 0 : -1;
+}
+
+static void parse_args(int argc, char** argv, GenOptions_t* options) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    int status = 0;
+    if (!strcmp(arg, "--help")) {
+      print_usage(argv[0]);
+      exit(0);
+    } else if (!strcmp(arg, "-o") && i + 1 < argc) {
+      options->output = argv[++i];
+    } else if (!strncmp(arg, "--seed=", 7)) {
+      options->seed = strtoull(arg + 7, NULL, 10);
+    } else if (!strncmp(arg, "--gpus=", 7)) {
+      options->gpus = atoi(arg + 7);
+      status = options->gpus > 0 ? 0 : -1;
+    } else if (!strncmp(arg, "--models=", 9)) {
+      options->models = arg + 9;
+    } else if (!strncmp(arg, "--sms=", 6)) {
+      status = parse_range(arg + 6, &options->sms);
+      if (options->sms.min == 0) status = -1;
+    } else if (!strncmp(arg, "--launches=", 11)) {
+      options->launches = strtoull(arg + 11, NULL, 10);
+    } else if (!strncmp(arg, "--kernel-types=", 15)) {
+      options->kernel_types = atoi(arg + 15);
+      status = options->kernel_types > 0 ? 0 : -1;
+    } else if (!strncmp(arg, "--streams=", 10)) {
+      options->streams = atoi(arg + 10);
+      status = options->streams > 0 && options->streams <= 65535 ? 0 : -1;
+    } else if (!strncmp(arg, "--blocks=", 9)) {
+      status = parse_range(arg + 9, &options->blocks);
+      if (options->blocks.min == 0 || options->blocks.max > 0xffffffffull) status = -1;
+    } else if (!strncmp(arg, "--threads=", 10)) {
+      status = parse_threads(arg + 10, options);
+    } else if (!strncmp(arg, "--registers=", 12)) {
+      status = parse_pair(arg + 12, &options->registers_mean, &options->registers_stddev);
+    } else if (!strncmp(arg, "--shared=", 9)) {
+      status = parse_range(arg + 9, &options->shared);
+    } else if (!strncmp(arg, "--shared-fraction=", 18)) {
+      options->shared_fraction = atof(arg + 18) / 100.0;
+    } else if (!strncmp(arg, "--rate=", 7)) {
+      options->rate = atof(arg + 7);
+      status = options->rate > 0.0 ? 0 : -1;
+    } else if (!strncmp(arg, "--duration=", 11)) {
+      status = parse_pair(arg + 11, &options->duration_mean, &options->duration_sigma);
+      if (options->duration_mean <= 0.0) status = -1;
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", arg);
+      print_usage(argv[0]);
+      exit(1);
+    }
+    if (status != 0) {
+      fprintf(stderr, "Invalid value: %s\n", arg);
+      print_usage(argv[0]);
+      exit(1);
+    }
+  }
+}
+
+// Models named in a comma separated list, or all of them
+static int select_models(const char* list, const GpuModel_t** models) {
+  int count = 0;
+  for (int m = 0; m < GPU_MODEL_COUNT; m++) {
+    if (!list) {
+      models[count++] = &gpu_models[m];
+      continue;
+    }
+    size_t length = strlen(gpu_models[m].name);
+    for (const char* p = list; p; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL) {
+      if (!strncmp(p, gpu_models[m].name, length) && (p[length] == ',' || !p[length])) {
+        models[count++] = &gpu_models[m];
+        break;
+      }
+    }
+  }
+  return count;
+}
+
+// ================= Generation ==================
+
+static void write_gpus(Writer_t* w, const GenOptions_t* options, const GpuModel_t** models, int model_count) {
+  char name[64];
+  json_key(w, "gpus");
+  json_begin_array(w);
+  for (int g = 0; g < options->gpus; g++) {
+    const GpuModel_t* model = models[next_u64() % model_count];
+    unsigned long long sms = options->sms.min ? next_in_range(options->sms) : model->num_sms;
+    snprintf(name, sizeof(name), "%s_%03d", model->name, g);
+
+    write_text(w, "\n");
+    json_begin_object(w);
+    json_key(w, "name");              json_string(w, name);
+    json_key(w, "memory_bytes");      json_uint(w, model->memory_bytes);
+    json_key(w, "shared_mem_per_sm"); json_uint(w, model->shared_mem_per_sm);
+    json_key(w, "registers_per_sm");  json_uint(w, model->registers_per_sm);
+    json_key(w, "max_warps_per_sm");  json_uint(w, model->max_warps_per_sm);
+    json_key(w, "max_blocks_per_sm"); json_uint(w, model->max_blocks_per_sm);
+    json_key(w, "num_sms");           json_uint(w, sms);
+    json_end_object(w);
+  }
+  json_end_array(w);
+}
+
+static void make_kernel_types(const GenOptions_t* options, KernelType_t* types) {
+  double thread_cdf[MAX_THREAD_CHOICES];
+  double total = 0.0;
+  for (int c = 0; c < options->thread_choices; c++) {
+    total += options->thread_weights[c];
+    thread_cdf[c] = total;
+  }
+
+  for (int t = 0; t < options->kernel_types; t++) {
+    KernelType_t* type = &types[t];
+    type->blocks = next_log_uniform(options->blocks);
+    type->threads = options->threads[pick(thread_cdf, options->thread_choices)];
+
+    // Compilers allocate registers in groups of 8 and cap them so a block
+    // still fits the 65536 registers of an SM
+    double registers = options->registers_mean + options->registers_stddev * next_normal();
+    unsigned int cap = 65536 / type->threads / 8 * 8;
+    if (cap > 255) cap = 255;
+    type->registers = registers < 16.0 ? 16 : (unsigned int)(registers + 7.0) / 8 * 8;
+    if (type->registers > cap) type->registers = cap;
+
+    type->shared_mem = 0;
+    if (next_uniform() < options->shared_fraction) {
+      type->shared_mem = (next_log_uniform(options->shared) + 255) / 256 * 256;
+    }
+
+    type->duration_us = options->duration_mean *
+                        exp(options->duration_sigma * next_normal() -
+                            options->duration_sigma * options->duration_sigma / 2.0);
+  }
+}
+
+static void write_kernels(Writer_t* w, const GenOptions_t* options, const KernelType_t* types) {
+  // Zipf popularity: type t is launched 1/(t+1) as often as type 0
+  double* type_cdf = malloc(sizeof(double) * options->kernel_types);
+  if (!type_cdf) {
+    perror("Memory allocation failed");
+    exit(1);
+  }
+  double total = 0.0;
+  for (int t = 0; t < options->kernel_types; t++) {
+    total += 1.0 / (t + 1);
+    type_cdf[t] = total;
+  }
+
+  char name[64];
+  double arrival = 0.0;
+  json_key(w, "kernels");
+  json_begin_array(w);
+  for (unsigned long long k = 0; k < options->launches; k++) {
+    int t = pick(type_cdf, options->kernel_types);
+    const KernelType_t* type = &types[t];
+    // Launches of one kernel vary a little around its median duration
+    double duration = type->duration_us * exp(0.1 * next_normal());
+    arrival += -log(next_uniform()) * 1e6 / options->rate;
+    snprintf(name, sizeof(name), "k%02d_%llu", t, k);
+
+    write_text(w, "\n");
+    json_begin_object(w);
+    json_key(w, "name");                               json_string(w, name);
+    json_key(w, "number_of_blocks");                   json_uint(w, type->blocks);
+    json_key(w, "threads_per_block");                  json_uint(w, type->threads);
+    json_key(w, "shared_mem_used_in_bytes_per_block"); json_uint(w, type->shared_mem);
+    json_key(w, "registers_per_thread");               json_uint(w, type->registers);
+    json_key(w, "stream_id");                          json_uint(w, 1 + next_u64() % options->streams);
+    json_key(w, "arrival_us");                         json_fixed(w, arrival, 3);
+    json_key(w, "duration_us");                        json_fixed(w, duration, 3);
+    json_end_object(w);
+  }
+  json_end_array(w);
+  free(type_cdf);
+}
+
+int main(int argc, char** argv) {
+  GenOptions_t options = {
+    .seed = 1,
+    .output = "/dev/stdout",
+    .gpus = 4,
+    .launches = 1000,
+    .kernel_types = 32,
+    .streams = 4,
+    .blocks = { 1, 4096 },
+    .thread_choices = 5,
+    .threads = { 64, 128, 256, 512, 1024 },
+    .thread_weights = { 1, 3, 4, 2, 1 },
+    .registers_mean = 40,
+    .registers_stddev = 16,
+    .shared = { 256, 49152 },
+    .shared_fraction = 0.6,
+    .rate = 10000,
+    .duration_mean = 50,
+    .duration_sigma = 1,
+  };
+  parse_args(argc, argv, &options);
+
+  const GpuModel_t* models[GPU_MODEL_COUNT];
+  int model_count = select_models(options.models, models);
+  if (model_count == 0) {
+    fprintf(stderr, "Error: no known GPU model in %s\n", options.models);
+    return 1;
+  }
+
+  KernelType_t* types = malloc(sizeof(KernelType_t) * options.kernel_types);
+  if (!types) {
+    perror("Memory allocation failed");
+    return 1;
+  }
+
+  Writer_t w;
+  if (open_writer(&w, options.output) != 0) {
+    free(types);
+    return 1;
+  }
+
+  // Fleet, kernel types and launches each draw from their own stream, so
+  // changing the fleet does not change the kernels, and changing the
+  // kernel types does not reshuffle the streams and arrivals of launches
+  json_begin_object(&w);
+  rng_state = options.seed;
+  write_gpus(&w, &options, models, model_count);
+  rng_state = options.seed ^ 0x6b65726e656c73ull;
+  make_kernel_types(&options, types);
+  rng_state = options.seed ^ 0x6c61756e63686573ull;
+  write_kernels(&w, &options, types);
+  json_end_object(&w);
+  write_text(&w, "\n");
+
+  free(types);
+  return close_writer(&w) != 0;
+}
@@ -0,0 +1,23 @@
+#include "gpu_presets.h"
+
+#define GPU_PRESET_ENTRY(NAME, SHARED, REGS, WARPS, BLOCKS)                \
+    { #NAME, SHARED, REGS, WARPS, BLOCKS,                                  \
+      calculate_occupancy_of_SM_##NAME },
+
+static const GpuPreset_t gpu_presets[] = {
+  GPU_PRESETS(GPU_PRESET_ENTRY)
+};
+
+// Returns the preset with the same SM limits as the GPU, or NULL
+const GpuPreset_t* find_gpu_preset(const Gpu_t* gpu) {
+  for (size_t i = 0; i < sizeof(gpu_presets) / sizeof(gpu_presets[0]); i++) {
+    const GpuPreset_t* p = &gpu_presets[i];
+    if (p->shared_mem_size_in_bytes_per_SM == gpu->shared_mem_size_in_bytes_per_SM &&
+        p->number_of_registers_per_SM == gpu->number_of_registers_per_SM &&
+        p->maximum_number_of_warps_per_SM == gpu->maximum_number_of_warps_per_SM &&
+        p->maximum_number_of_blocks_per_SM == gpu->maximum_number_of_blocks_per_SM) {
+      return p;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef GPU_PRESETS_H
+#define GPU_PRESETS_H
+
+#include <stddef.h>
+#include "cuda_arch.h"
+
+/*
+ * GPUs whose SM limits are known at compile time. Each entry is
+ *   X(NAME, shared_mem_per_sm, registers_per_sm, max_warps_per_sm, max_blocks_per_sm)
+ * and must match the limits of a GPU in config.json to be picked up by
+ * find_gpu_preset().
+ */
+#define GPU_PRESETS(X)                                                     \
+    X(low_resources,   49152,  65536, 64,  8)                              \
+    X(mid_resources,   98304, 131072, 64, 16)                              \
+    X(high_resources, 131072, 256000, 64, 32)
+
+/*
+ * Macro to define the SM occupancy function specialized for constant SM
+ * limits. With the limits folded in, the compiler turns the divisions into
+ * multiplications and bounds the loop over block slots. Blocks per SM have
+ * no specialized form: occupancy_batch() divides several shapes per
+ * instruction, which beats a scalar loop over the block slots even with
+ * constant limits. canFitBlock() has none either: it only compares against
+ * the free resources kept per SM, which do not depend on the limits.
+ *
+ * Example:
+ *   GPU_PRESET_DEFINE(mid_resources, 98304, 131072, 64, 16)
+ *   -> defines double calculate_occupancy_of_SM_mid_resources(const SM_t*)
+ */
+
+#define GPU_PRESET_DEFINE(NAME, SHARED, REGS, WARPS, BLOCKS)               \
+static inline double calculate_occupancy_of_SM_##NAME(const SM_t *sm) {    \
+    if (sm->number_of_blocks == 0) return 0.0;                             \
+    unsigned int total_warps = 0, total_registers = 0, total_shared = 0;   \
+    for (int i = 0; i < sm->number_of_blocks && i < (BLOCKS); i++) {       \
+        const Block_t *b = &sm->list_of_blocks[i];                         \
+        total_warps += (b->number_of_thread + 31) / 32;                    \
+        total_registers += b->number_of_registers_used_per_thread *        \
+            b->number_of_thread;                                           \
+        total_shared += b->shared_mem_used_in_bytes;                       \
+    }                                                                      \
+    double occupancy = (double)total_warps / (WARPS);                      \
+    double reg_occ = (double)total_registers / (REGS);                     \
+    double shm_occ = (double)total_shared / (SHARED);                      \
+    double blk_occ = (double)sm->number_of_blocks / (BLOCKS);              \
+    if (reg_occ > occupancy) occupancy = reg_occ;                          \
+    if (shm_occ > occupancy) occupancy = shm_occ;                          \
+    if (blk_occ > occupancy) occupancy = blk_occ;                          \
+    return occupancy > 1.0 ? 1.0 : occupancy;                              \
+}
+
+GPU_PRESETS(GPU_PRESET_DEFINE)
+
+// ================= Preset lookup ==================
+
+typedef struct GPU_PRESET {
+  const char* name;
+  unsigned int shared_mem_size_in_bytes_per_SM;
+  unsigned int number_of_registers_per_SM;
+  unsigned short maximum_number_of_warps_per_SM;
+  unsigned short maximum_number_of_blocks_per_SM;
+
+  double (*calculate_occupancy_of_SM)(const SM_t* sm);
+} GpuPreset_t;
+
+const GpuPreset_t* find_gpu_preset(const Gpu_t* gpu);
+
+#endif // GPU_PRESETS_H
@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "gpusim.h"
+#include "cuda_arch.h"
+#include "config.h"
+#include "devmem.h"
+#include "query.h"
+
+struct GPUSIM_CONTEXT {
+  Gpu_t* gpus;
+  int gpu_count;
+  int gpu_capacity;
+  Kernel_t* kernels;
+  int kernel_count;
+  int kernel_capacity;
+
+  // Blocks of each kernel that did not fit, one row per launched GPU and
+  // NULL for GPUs not launched since the GPUs or kernels changed
+  unsigned int** dropped;
+  DevMemoryStats_t* memory;      // of each launched GPU, next to dropped
+
+  // Built on the first query, after any change to the GPUs
+  bool has_engine;
+  QueryEngine_t engine;
+  QueryScratch_t scratch;
+
+  GpusimLog_t log;
+  void* log_user;
+  char error[512];
+};
+
+// ================= Messages ==================
+
+static void log_message(void* sink, const char* message) {
+  GpusimContext_t* ctx = sink;
+  snprintf(ctx->error, sizeof(ctx->error), "%s", message);
+  if (ctx->log) ctx->log(ctx->log_user, message);
+}
+
+static int fail(GpusimContext_t* ctx, const char* format, ...) {
+  char message[sizeof(ctx->error)];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  log_message(ctx, message);
+  return -1;
+}
+
+// ================= Sized Structs ==================
+
+// Bytes of a struct up to and including field: what every caller of this ABI sets
+#define SIZE_THROUGH(type, field) (offsetof(type, field) + sizeof(((type*)0)->field))
+
+// Copies a caller's spec of size bytes into out, sizeof known, leaving
+// the fields the caller does not know zero. -1 when size is below
+// minimum or the caller set a field this library does not know.
+static int read_spec(const void* spec, size_t minimum, void* out, size_t known) {
+  size_t size = *(const uint32_t*)spec;
+  if (size < minimum) return -1;
+  for (size_t i = known; i < size; i++) {
+    if (((const unsigned char*)spec)[i]) return -1;
+  }
+  memset(out, 0, known);
+  memcpy(out, spec, size < known ? size : known);
+  return 0;
+}
+
+// Writes the result, sizeof known, into the caller's out of out->size bytes
+static int write_result(void* out, size_t minimum, const void* result, size_t known) {
+  uint32_t size = *(const uint32_t*)out;
+  if (size < minimum) return -1;
+  memcpy((char*)out + sizeof(size), (const char*)result + sizeof(size),
+         (size < known ? size : known) - sizeof(size));
+  return 0;
+}
+
+// ================= Context ==================
+
+int gpusim_abi_version(void) {
+  return GPUSIM_ABI_VERSION;
+}
+
+GpusimContext_t* gpusim_create(void) {
+  return calloc(1, sizeof(GpusimContext_t));
+}
+
+static void drop_engine(GpusimContext_t* ctx) {
+  if (!ctx->has_engine) return;
+  free_query_scratch(&ctx->scratch);
+  free_query_engine(&ctx->engine);
+  ctx->has_engine = false;
+}
+
+static void drop_results(GpusimContext_t* ctx) {
+  for (int g = 0; g < ctx->gpu_count; g++) {
+    free(ctx->dropped[g]);
+    ctx->dropped[g] = NULL;
+  }
+}
+
+static void free_entries(GpusimContext_t* ctx) {
+  drop_engine(ctx);
+  drop_results(ctx);
+  free_config(ctx->gpus, ctx->gpu_count, ctx->kernels, ctx->kernel_count);
+  free(ctx->dropped);
+  free(ctx->memory);
+  ctx->gpus = NULL;
+  ctx->kernels = NULL;
+  ctx->dropped = NULL;
+  ctx->memory = NULL;
+  ctx->gpu_count = ctx->gpu_capacity = 0;
+  ctx->kernel_count = ctx->kernel_capacity = 0;
+}
+
+void gpusim_destroy(GpusimContext_t* ctx) {
+  if (!ctx) return;
+  free_entries(ctx);
+  free(ctx);
+}
+
+void gpusim_set_log(GpusimContext_t* ctx, GpusimLog_t log, void* user) {
+  ctx->log = log;
+  ctx->log_user = user;
+}
+
+const char* gpusim_last_error(const GpusimContext_t* ctx) {
+  return ctx->error;
+}
+
+int gpusim_gpu_count(const GpusimContext_t* ctx) {
+  return ctx->gpu_count;
+}
+
+int gpusim_kernel_count(const GpusimContext_t* ctx) {
+  return ctx->kernel_count;
+}
+
+// ================= Loading ==================
+
+// Takes over a parsed config, leaving out the entries it skipped
+static int adopt_config(GpusimContext_t* ctx, Gpu_t* gpus, int gpu_count, Kernel_t* kernels, int kernel_count) {
+  unsigned int** dropped = calloc(gpu_count ? gpu_count : 1, sizeof(unsigned int*));
+  DevMemoryStats_t* memory = calloc(gpu_count ? gpu_count : 1, sizeof(DevMemoryStats_t));
+  if (!dropped || !memory) {
+    free(dropped);
+    free(memory);
+    free_config(gpus, gpu_count, kernels, kernel_count);
+    return fail(ctx, "Memory allocation failed");
+  }
+
+  free_entries(ctx);
+
+  ctx->gpus = gpus;
+  ctx->gpu_capacity = gpu_count;
+  ctx->kernels = kernels;
+  ctx->kernel_capacity = kernel_count;
+  drop_skipped_entries(gpus, &gpu_count, kernels, &kernel_count);
+  ctx->gpu_count = gpu_count;
+  ctx->kernel_count = kernel_count;
+
+  ctx->dropped = dropped;
+  ctx->memory = memory;
+  return 0;
+}
+
+int gpusim_load_file(GpusimContext_t* ctx, const char* path) {
+  Gpu_t* gpus = NULL;
+  Kernel_t* kernels = NULL;
+  int gpu_count = 0, kernel_count = 0;
+  ctx->error[0] = '\0';
+  if (read_config(path, &gpus, &gpu_count, &kernels, &kernel_count, log_message, ctx) != 0) return -1;
+  return adopt_config(ctx, gpus, gpu_count, kernels, kernel_count);
+}
+
+int gpusim_load_json(GpusimContext_t* ctx, const char* json, size_t length) {
+  Gpu_t* gpus = NULL;
+  Kernel_t* kernels = NULL;
+  int gpu_count = 0, kernel_count = 0;
+  ctx->error[0] = '\0';
+  if (parse_config(json, length, &gpus, &gpu_count, &kernels, &kernel_count, log_message, ctx) != 0) return -1;
+  return adopt_config(ctx, gpus, gpu_count, kernels, kernel_count);
+}
+
+_Static_assert(GPUSIM_MAX_SMS == MAX_NUMBER_OF_SMS, "GPUSIM_MAX_SMS is the simulator's limit");
+
+int gpusim_add_gpu(GpusimContext_t* ctx, const GpusimGpuSpec_t* caller_spec) {
+  GpusimGpuSpec_t copy;
+  if (read_spec(caller_spec, SIZE_THROUGH(GpusimGpuSpec_t, num_sms), &copy, sizeof(copy)) != 0) {
+    return fail(ctx, "GPU spec of %u bytes: set size to sizeof(GpusimGpuSpec_t)", caller_spec->size);
+  }
+  const GpusimGpuSpec_t* spec = &copy;
+  if (!spec->name || !spec->num_sms || spec->num_sms > GPUSIM_MAX_SMS || !spec->max_blocks_per_sm ||
+      spec->max_warps_per_sm > 0xffff || spec->max_blocks_per_sm > 0xffff) {
+    return fail(ctx, "GPU %s: needs a name, 1 to %d SMs and at most 65535 warps and blocks per SM",
+                spec->name ? spec->name : "(null)", GPUSIM_MAX_SMS);
+  }
+
+  // The query tables point into the array, which may move
+  drop_engine(ctx);
+  if (ctx->gpu_count == ctx->gpu_capacity) {
+    // Results grow with the GPUs, so all three keep gpu_capacity entries
+    int grown = ctx->gpu_capacity ? 2 * ctx->gpu_capacity : 8;
+    Gpu_t* gpus = realloc(ctx->gpus, grown * sizeof(Gpu_t));
+    if (gpus) ctx->gpus = gpus;
+    unsigned int** dropped = gpus ? realloc(ctx->dropped, grown * sizeof(unsigned int*)) : NULL;
+    if (dropped) ctx->dropped = dropped;
+    DevMemoryStats_t* memory = dropped ? realloc(ctx->memory, grown * sizeof(DevMemoryStats_t)) : NULL;
+    if (memory) ctx->memory = memory;
+    if (!gpus || !dropped || !memory) return fail(ctx, "Memory allocation failed");
+    ctx->gpu_capacity = grown;
+  }
+
+  if (init_GPU(&ctx->gpus[ctx->gpu_count], spec->name, spec->memory_bytes, spec->shared_mem_per_sm,
+               spec->registers_per_sm, spec->max_warps_per_sm, spec->max_blocks_per_sm, spec->num_sms) != 0) {
+    return fail(ctx, "GPU %s: memory allocation failed", spec->name);
+  }
+  ctx->dropped[ctx->gpu_count] = NULL;
+  return ctx->gpu_count++;
+}
+
+int gpusim_add_kernel(GpusimContext_t* ctx, const GpusimKernelSpec_t* caller_spec) {
+  GpusimKernelSpec_t copy;
+  if (read_spec(caller_spec, SIZE_THROUGH(GpusimKernelSpec_t, stream_id), &copy, sizeof(copy)) != 0) {
+    return fail(ctx, "Kernel spec of %u bytes: set size to sizeof(GpusimKernelSpec_t)", caller_spec->size);
+  }
+  const GpusimKernelSpec_t* spec = &copy;
+  if (!spec->name || spec->stream_id > 0xffff) {
+    return fail(ctx, "Kernel %s: needs a name and a stream below 65536", spec->name ? spec->name : "(null)");
+  }
+
+  char* name = strdup(spec->name);
+  if (!name) return fail(ctx, "Memory allocation failed");
+  if (ctx->kernel_count == ctx->kernel_capacity) {
+    int grown = ctx->kernel_capacity ? 2 * ctx->kernel_capacity : 8;
+    Kernel_t* kernels = realloc(ctx->kernels, grown * sizeof(Kernel_t));
+    if (!kernels) {
+      free(name);
+      return fail(ctx, "Memory allocation failed");
+    }
+    ctx->kernels = kernels;
+    ctx->kernel_capacity = grown;
+  }
+
+  drop_results(ctx);
+  ctx->kernels[ctx->kernel_count] = (Kernel_t){
+    .name = name,
+    .number_of_blocks = spec->number_of_blocks,
+    .threads_per_block = spec->threads_per_block,
+    .shared_mem_used_in_bytes_per_block = spec->shared_mem_per_block,
+    .registers_per_thread = spec->registers_per_thread,
+    .stream_id = spec->stream_id,
+  };
+  return ctx->kernel_count++;
+}
+
+int gpusim_set_allocator(GpusimContext_t* ctx, int gpu, const char* allocator) {
+  if (gpu < 0 || gpu >= ctx->gpu_count) return fail(ctx, "No GPU %d", gpu);
+  Allocator_t parsed;
+  if (!allocator || parse_allocator(allocator, &parsed) != 0) {
+    return fail(ctx, "Unknown allocator %s", allocator ? allocator : "(null)");
+  }
+
+  free(ctx->dropped[gpu]);
+  ctx->dropped[gpu] = NULL;
+  ctx->gpus[gpu].allocator = parsed;
+  return 0;
+}
+
+int gpusim_set_kernel_memory(GpusimContext_t* ctx, int kernel, uint64_t memory_bytes,
+                             const char* const* frees, int free_count) {
+  if (kernel < 0 || kernel >= ctx->kernel_count) return fail(ctx, "No kernel %d", kernel);
+  if (free_count < 0 || free_count > 0xffff) return fail(ctx, "Kernel %d: %d frees", kernel, free_count);
+
+  char** copies = calloc(free_count ? free_count : 1, sizeof(char*));
+  int i = 0;
+  for (; copies && i < free_count && frees[i]; i++) {
+    copies[i] = strdup(frees[i]);
+    if (!copies[i]) break;
+  }
+  if (!copies || i < free_count) {
+    while (copies && i > 0) free(copies[--i]);
+    free(copies);
+    return fail(ctx, "Kernel %d: frees must be %d names", kernel, free_count);
+  }
+
+  Kernel_t* k = &ctx->kernels[kernel];
+  for (unsigned short f = 0; f < k->free_count; f++) {
+    free(k->frees[f]);
+  }
+  free(k->frees);
+  k->memory_bytes = memory_bytes;
+  k->frees = copies;
+  k->free_count = free_count;
+  drop_results(ctx);
+  return 0;
+}
+
+void gpusim_clear_kernels(GpusimContext_t* ctx) {
+  drop_results(ctx);
+  for (int k = 0; k < ctx->kernel_count; k++) {
+    free_kernel(&ctx->kernels[k]);
+  }
+  ctx->kernel_count = 0;
+}
+
+// ================= Launching ==================
+
+int gpusim_launch_gpu(GpusimContext_t* ctx, int gpu) {
+  if (gpu < 0 || gpu >= ctx->gpu_count) return fail(ctx, "No GPU %d", gpu);
+
+  unsigned int* dropped = ctx->dropped[gpu];
+  if (!dropped) {
+    dropped = malloc(sizeof(unsigned int) * (ctx->kernel_count ? ctx->kernel_count : 1));
+    if (!dropped) return fail(ctx, "Memory allocation failed");
+  }
+
+  Gpu_t* g = &ctx->gpus[gpu];
+  DevMemory_t memory;
+  bool model_memory = kernels_use_device_memory(ctx->kernels, ctx->kernel_count);
+  if (model_memory && init_device_memory(&memory, g) != 0) memory.failed = true;
+  reset_GPU(g);
+  for (int k = 0; k < ctx->kernel_count; k++) {
+    dropped[k] = place_kernel_with_memory(g, model_memory ? &memory : NULL, &ctx->kernels[k]);
+  }
+
+  memset(&ctx->memory[gpu], 0, sizeof(DevMemoryStats_t));
+  if (model_memory) {
+    bool failed = memory.failed;
+    ctx->memory[gpu] = memory.stats;
+    free_device_memory(&memory);
+    if (failed) {
+      // The GPU stays unlaunched rather than keep a partial placement
+      if (dropped != ctx->dropped[gpu]) free(dropped);
+      free(ctx->dropped[gpu]);
+      ctx->dropped[gpu] = NULL;
+      return fail(ctx, "GPU %s: memory allocation failed", g->name);
+    }
+  }
+  ctx->dropped[gpu] = dropped;
+  return 0;
+}
+
+int gpusim_launch(GpusimContext_t* ctx) {
+  for (int g = 0; g < ctx->gpu_count; g++) {
+    if (gpusim_launch_gpu(ctx, g) != 0) return -1;
+  }
+  return 0;
+}
+
+// ================= Results ==================
+
+static const unsigned int* results_of(const GpusimContext_t* ctx, int gpu) {
+  if (gpu < 0 || gpu >= ctx->gpu_count) return NULL;
+  return ctx->dropped[gpu];
+}
+
+int gpusim_gpu_result(const GpusimContext_t* ctx, int gpu, GpusimGpuResult_t* out) {
+  const unsigned int* dropped = results_of(ctx, gpu);
+  if (!dropped) return -1;
+
+  GpusimGpuResult_t result = {0};
+  for (int k = 0; k < ctx->kernel_count; k++) {
+    result.blocks_placed += ctx->kernels[k].number_of_blocks - dropped[k];
+    result.blocks_dropped += dropped[k];
+  }
+
+  Gpu_t* g = &ctx->gpus[gpu];
+  for (unsigned int i = 0; i < g->number_of_SMs; i++) {
+    if (g->list_of_SMs[i].number_of_blocks == 0) continue;
+    result.sms_used++;
+    result.occupancy += calculate_occupancy_of_SM(g, i);
+  }
+  if (g->number_of_SMs) result.occupancy /= g->number_of_SMs;
+  return write_result(out, SIZE_THROUGH(GpusimGpuResult_t, occupancy), &result, sizeof(result));
+}
+
+int gpusim_kernel_result(const GpusimContext_t* ctx, int gpu, int kernel, GpusimKernelResult_t* out) {
+  const unsigned int* dropped = results_of(ctx, gpu);
+  if (!dropped || kernel < 0 || kernel >= ctx->kernel_count) return -1;
+
+  GpusimKernelResult_t result = {
+    .blocks_placed = ctx->kernels[kernel].number_of_blocks - dropped[kernel],
+    .blocks_dropped = dropped[kernel],
+  };
+  return write_result(out, SIZE_THROUGH(GpusimKernelResult_t, blocks_dropped), &result, sizeof(result));
+}
+
+int gpusim_sm_occupancy(const GpusimContext_t* ctx, int gpu, int sm, double* out) {
+  if (!results_of(ctx, gpu) || sm < 0 || (unsigned int)sm >= ctx->gpus[gpu].number_of_SMs) return -1;
+  *out = calculate_occupancy_of_SM(&ctx->gpus[gpu], sm);
+  return 0;
+}
+
+int gpusim_memory_result(const GpusimContext_t* ctx, int gpu, GpusimMemoryResult_t* out) {
+  if (!results_of(ctx, gpu)) return -1;
+
+  const DevMemoryStats_t* stats = &ctx->memory[gpu];
+  GpusimMemoryResult_t result = {
+    .peak_allocated = stats->peak_allocated,
+    .peak_reserved = stats->peak_reserved,
+    .allocated = stats->allocated,
+    .fragmentation = stats->fragmentation,
+    .peak_fragmentation = stats->peak_fragmentation,
+    .oom_launches = stats->oom_launches,
+    .oom_fragmented = stats->oom_fragmented,
+  };
+  return write_result(out, SIZE_THROUGH(GpusimMemoryResult_t, oom_fragmented), &result, sizeof(result));
+}
+
+// ================= Queries ==================
+
+size_t gpusim_query(GpusimContext_t* ctx, const char* line, size_t length, char* answer, size_t answer_size) {
+  if (!ctx->has_engine) {
+    if (new_query_engine(&ctx->engine, ctx->gpus, ctx->gpu_count) != 0) {
+      fail(ctx, "Failed to build the query tables");
+      return 0;
+    }
+    if (new_query_scratch(&ctx->scratch, &ctx->engine) != 0) {
+      free_query_engine(&ctx->engine);
+      fail(ctx, "Failed to build the query tables");
+      return 0;
+    }
+    ctx->has_engine = true;
+  }
+
+  char out[QUERY_MAX_ANSWER];
+  size_t n = answer_query_line(&ctx->scratch, line, length, out);
+  if (answer_size) {
+    size_t copied = n < answer_size - 1 ? n : answer_size - 1;
+    memcpy(answer, out, copied);
+    answer[copied] = '\0';
+  }
+  return n;
+}
@@ -0,0 +1,176 @@
+#ifndef GPUSIM_H
+#define GPUSIM_H
+
+/*
+ * Embedding API of the simulator, built by make lib into libgpusim.a and
+ * libgpusim.so. A context owns its GPUs, kernels, results, query tables
+ * and log sink; nothing is shared between contexts, so separate threads
+ * can each drive their own context without locking. One context must not
+ * be used by two threads at once.
+ *
+ * Nothing is printed and no file is written: messages go to the log sink
+ * and results are read back with the query calls.
+ *
+ *   GpusimContext_t* ctx = gpusim_create();
+ *   if (gpusim_load_file(ctx, "config.json") != 0) puts(gpusim_last_error(ctx));
+ *   gpusim_launch(ctx);
+ *   GpusimGpuResult_t result = { .size = sizeof(result) };
+ *   gpusim_gpu_result(ctx, 0, &result);
+ *   gpusim_destroy(ctx);
+ *
+ * The ABI only changes with GPUSIM_ABI_VERSION, which is also the soname
+ * version: structs only grow at the end and functions are only added.
+ * Every struct the caller allocates starts with size, set to its sizeof,
+ * so either side may be built against an older header: fields missing
+ * from a spec are taken as zero, a result is written up to size, and a
+ * spec field the library does not know must be zero.
+ * Placement observers (cuda_arch.h) are process-wide and not part of it.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPUSIM_ABI_VERSION 2
+
+// Most SMs gpusim_add_gpu() accepts
+#define GPUSIM_MAX_SMS (1 << 24)
+
+// Largest answer of gpusim_query(), including '\n' and the terminator
+#define GPUSIM_MAX_ANSWER 257
+
+#if defined(__GNUC__)
+  #define GPUSIM_API __attribute__((visibility("default")))
+#else
+  #define GPUSIM_API
+#endif
+
+// ================= Type Declaration ==================
+
+typedef struct GPUSIM_CONTEXT GpusimContext_t;
+
+// Receives each warning and error as one line without '\n'
+typedef void (*GpusimLog_t)(void* user, const char* message);
+
+// The fields of a config.json GPU
+typedef struct GPUSIM_GPU_SPEC {
+  uint32_t size;               // sizeof(GpusimGpuSpec_t)
+  const char* name;
+  uint64_t memory_bytes;
+  uint32_t shared_mem_per_sm;
+  uint32_t registers_per_sm;
+  uint32_t max_warps_per_sm;
+  uint32_t max_blocks_per_sm;
+  uint32_t num_sms;
+} GpusimGpuSpec_t;
+
+// The fields of a config.json kernel
+typedef struct GPUSIM_KERNEL_SPEC {
+  uint32_t size;               // sizeof(GpusimKernelSpec_t)
+  const char* name;
+  uint32_t number_of_blocks;
+  uint32_t threads_per_block;
+  uint32_t shared_mem_per_block;
+  uint32_t registers_per_thread;
+  uint32_t stream_id;
+} GpusimKernelSpec_t;
+
+typedef struct GPUSIM_GPU_RESULT {
+  uint32_t size;             // sizeof(GpusimGpuResult_t)
+  uint64_t blocks_placed;
+  uint64_t blocks_dropped;
+  uint32_t sms_used;
+  double occupancy;          // mean over every SM
+} GpusimGpuResult_t;
+
+typedef struct GPUSIM_KERNEL_RESULT {
+  uint32_t size;             // sizeof(GpusimKernelResult_t)
+  uint64_t blocks_placed;
+  uint64_t blocks_dropped;
+} GpusimKernelResult_t;
+
+// Device memory of a launch in which kernels allocate; all zero otherwise
+typedef struct GPUSIM_MEMORY_RESULT {
+  uint32_t size;               // sizeof(GpusimMemoryResult_t)
+  uint64_t peak_allocated;
+  uint64_t peak_reserved;
+  uint64_t allocated;          // still held when the last kernel was launched
+  double fragmentation;        // 1 - largest free range / free memory, at the end
+  double peak_fragmentation;
+  uint32_t oom_launches;       // kernels not launched for lack of memory
+  uint32_t oom_fragmented;     // of those, with enough memory free in total
+} GpusimMemoryResult_t;
+
+// ================= Function Declarations ==================
+
+GPUSIM_API int gpusim_abi_version(void);
+
+// Returns NULL when out of memory
+GPUSIM_API GpusimContext_t* gpusim_create(void);
+
+GPUSIM_API void gpusim_destroy(GpusimContext_t* ctx);
+
+// Messages are also kept for gpusim_last_error(); log may be NULL
+GPUSIM_API void gpusim_set_log(GpusimContext_t* ctx, GpusimLog_t log, void* user);
+
+// Last error or warning of the context, "" when there was none
+GPUSIM_API const char* gpusim_last_error(const GpusimContext_t* ctx);
+
+/*
+ * Replace the GPUs and kernels with those of a config.json, from a file
+ * or from memory. Entries missing a field are logged and left out, so
+ * indices count only the entries kept. On failure the context keeps what
+ * it had. Both return 0 or -1.
+ */
+GPUSIM_API int gpusim_load_file(GpusimContext_t* ctx, const char* path);
+GPUSIM_API int gpusim_load_json(GpusimContext_t* ctx, const char* json, size_t length);
+
+// Both return the index of the new entry, or -1
+GPUSIM_API int gpusim_add_gpu(GpusimContext_t* ctx, const GpusimGpuSpec_t* spec);
+GPUSIM_API int gpusim_add_kernel(GpusimContext_t* ctx, const GpusimKernelSpec_t* spec);
+
+/*
+ * Device memory of the config.json "allocator" and "memory_bytes" and
+ * "frees" fields (see the README): the allocator of a GPU, "first-fit",
+ * "bump" or "caching", and the memory a kernel allocates and the earlier
+ * kernels whose allocations it frees. Both return 0 or -1.
+ */
+GPUSIM_API int gpusim_set_allocator(GpusimContext_t* ctx, int gpu, const char* allocator);
+GPUSIM_API int gpusim_set_kernel_memory(GpusimContext_t* ctx, int kernel, uint64_t memory_bytes,
+                                        const char* const* frees, int free_count);
+
+// Removes every kernel, keeping the GPUs
+GPUSIM_API void gpusim_clear_kernels(GpusimContext_t* ctx);
+
+GPUSIM_API int gpusim_gpu_count(const GpusimContext_t* ctx);
+GPUSIM_API int gpusim_kernel_count(const GpusimContext_t* ctx);
+
+// Places every kernel in order on an empty GPU, on all GPUs or on one.
+// Changing the kernels discards the results of every GPU. Return 0 or -1.
+GPUSIM_API int gpusim_launch(GpusimContext_t* ctx);
+GPUSIM_API int gpusim_launch_gpu(GpusimContext_t* ctx, int gpu);
+
+// Results of the last launch of a GPU; -1 when it was not launched since it changed
+GPUSIM_API int gpusim_gpu_result(const GpusimContext_t* ctx, int gpu, GpusimGpuResult_t* out);
+GPUSIM_API int gpusim_kernel_result(const GpusimContext_t* ctx, int gpu, int kernel, GpusimKernelResult_t* out);
+GPUSIM_API int gpusim_sm_occupancy(const GpusimContext_t* ctx, int gpu, int sm, double* out);
+GPUSIM_API int gpusim_memory_result(const GpusimContext_t* ctx, int gpu, GpusimMemoryResult_t* out);
+
+/*
+ * Answers one JSON query line of the query server (occupancy, best block
+ * size, placement or gpu; see the README) against the context's GPUs,
+ * without touching their launch results. The answer is a JSON line
+ * ending in '\n', cut to answer_size - 1 bytes and terminated. Returns
+ * its full length, or 0 when the query tables could not be built.
+ */
+GPUSIM_API size_t gpusim_query(GpusimContext_t* ctx, const char* line, size_t length,
+                               char* answer, size_t answer_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPUSIM_H
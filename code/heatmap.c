@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heatmap.h"
+
+// Shares of a resource in use, as bytes of the embedded arrays
+typedef enum HEATMAP_METRIC {
+  METRIC_OCCUPANCY,
+  METRIC_SHARED_MEM,
+  METRIC_REGISTERS
+} HeatmapMetric_t;
+
+static const char* const metric_keys[] = { "occupancy", "shared", "registers" };
+
+// Draws GPUS, appended before it, on the canvas and shows the SM under the mouse
+static const char heatmap_script[] =
+  "const KEYS = ['occupancy', 'shared', 'registers'];\n"
+  "for (const gpu of GPUS) {\n"
+  "  for (const key of KEYS) {\n"
+  "    const text = atob(gpu[key]);\n"
+  "    const bytes = new Uint8Array(text.length);\n"
+  "    for (let i = 0; i < text.length; i++) bytes[i] = text.charCodeAt(i);\n"
+  "    gpu[key] = bytes;\n"
+  "  }\n"
+  "}\n"
+  "\n"
+  "const canvas = document.getElementById('heatmap');\n"
+  "const tip = document.getElementById('heatmap-tip');\n"
+  "const metric = document.getElementById('heatmap-metric');\n"
+  "const LABEL = 22, GAP = 10;\n"
+  "\n"
+  "// From the page background to the report green, as little-endian RGBA words\n"
+  "const colours = new Uint32Array(256);\n"
+  "for (let v = 0; v < 256; v++) {\n"
+  "  const t = v / 255;\n"
+  "  const r = Math.round(30 + t * 102), g = Math.round(41 + t * 163), b = Math.round(59 - t * 37);\n"
+  "  colours[v] = (0xff << 24 | b << 16 | g << 8 | r) >>> 0;\n"
+  "}\n"
+  "\n"
+  "let layout = { cell: 1, columns: 1, bands: [] };\n"
+  "\n"
+  "function draw() {\n"
+  "  const width = Math.max(canvas.parentElement.clientWidth, 100);\n"
+  "  const total = GPUS.reduce((n, gpu) => n + gpu.sms, 0) || 1;\n"
+  "  const cell = Math.max(2, Math.min(24, Math.floor(Math.sqrt(width * 800 / total))));\n"
+  "  const columns = Math.max(1, Math.floor(width / cell));\n"
+  "  let y = 0;\n"
+  "  const bands = GPUS.map(gpu => {\n"
+  "    const band = { gpu, top: y + LABEL, rows: Math.ceil(gpu.sms / columns) };\n"
+  "    y = band.top + band.rows * cell + GAP;\n"
+  "    return band;\n"
+  "  });\n"
+  "  layout = { cell, columns, bands };\n"
+  "\n"
+  "  canvas.width = columns * cell;\n"
+  "  canvas.height = Math.max(y, 1);\n"
+  "  const ctx = canvas.getContext('2d');\n"
+  "  const image = ctx.createImageData(canvas.width, canvas.height);\n"
+  "  const pixels = new Uint32Array(image.data.buffer);\n"
+  "  const inner = cell > 3 ? cell - 1 : cell;\n"
+  "  for (const band of bands) {\n"
+  "    const values = band.gpu[metric.value];\n"
+  "    for (let sm = 0; sm < band.gpu.sms; sm++) {\n"
+  "      const x = (sm % columns) * cell;\n"
+  "      const top = band.top + Math.floor(sm / columns) * cell;\n"
+  "      const colour = colours[values[sm]];\n"
+  "      for (let row = top; row < top + inner; row++) {\n"
+  "        pixels.fill(colour, row * canvas.width + x, row * canvas.width + x + inner);\n"
+  "      }\n"
+  "    }\n"
+  "  }\n"
+  "  ctx.putImageData(image, 0, 0);\n"
+  "\n"
+  "  ctx.fillStyle = '#e2e8f0';\n"
+  "  ctx.font = '14px sans-serif';\n"
+  "  ctx.textBaseline = 'middle';\n"
+  "  for (const band of bands) {\n"
+  "    ctx.fillText(band.gpu.name + ' (' + band.gpu.sms + ' SMs)', 0, band.top - LABEL / 2);\n"
+  "  }\n"
+  "}\n"
+  "\n"
+  "function percent(byte) {\n"
+  "  return (byte * 100 / 255).toFixed(1) + '%';\n"
+  "}\n"
+  "\n"
+  "canvas.addEventListener('mousemove', event => {\n"
+  "  const box = canvas.getBoundingClientRect();\n"
+  "  const x = (event.clientX - box.left) * canvas.width / box.width;\n"
+  "  const y = (event.clientY - box.top) * canvas.height / box.height;\n"
+  "  const { cell, columns, bands } = layout;\n"
+  "  const band = bands.find(b => y >= b.top && y < b.top + b.rows * cell);\n"
+  "  const sm = band ? Math.floor((y - band.top) / cell) * columns + Math.floor(x / cell) : -1;\n"
+  "  if (!band || x >= columns * cell || sm >= band.gpu.sms) {\n"
+  "    tip.style.display = 'none';\n"
+  "    return;\n"
+  "  }\n"
+  "  const gpu = band.gpu;\n"
+  "  tip.textContent = gpu.name + ' SM #' + sm +\n"
+  "    '\\nOccupancy: ' + percent(gpu.occupancy[sm]) +\n"
+  "    '\\nShared Mem: ' + percent(gpu.shared[sm]) +\n"
+  "    '\\nRegisters: ' + percent(gpu.registers[sm]);\n"
+  "  tip.style.left = (event.clientX + 14) + 'px';\n"
+  "  tip.style.top = (event.clientY + 14) + 'px';\n"
+  "  tip.style.display = 'block';\n"
+  "});\n"
+  "canvas.addEventListener('mouseleave', () => { tip.style.display = 'none'; });\n"
+  "metric.addEventListener('change', draw);\n"
+  "window.addEventListener('resize', draw);\n"
+  "draw();\n";
+
+int open_heatmap(Heatmap_t* heatmap) {
+  memset(heatmap, 0, sizeof(*heatmap));
+  if (ensure_results_dir() != 0) return -1;
+  if (open_writer(&heatmap->out, HEATMAP_FILE) != 0) return -1;
+
+  write_text(&heatmap->out,
+             "<!DOCTYPE html>\n"
+             "<html lang='en'>\n"
+             "<head>\n"
+             "  <meta charset='UTF-8'>\n"
+             "  <meta name='viewport' content='width=device-width, initial-scale=1.0'>\n"
+             "  <title>SM Heatmap</title>\n"
+             "  <link rel='stylesheet' href='../gpu_style.css'>\n"
+             "</head>\n"
+             "<body>\n"
+             "  <h1>SM Heatmap</h1>\n"
+             "  <div class='gpu-container'>\n"
+             "    <div class='gpu-header'>Show: <select id='heatmap-metric'>\n"
+             "      <option value='occupancy'>Occupancy</option>\n"
+             "      <option value='shared'>Shared Mem</option>\n"
+             "      <option value='registers'>Registers</option>\n"
+             "    </select></div>\n"
+             "    <div class='heatmap'><canvas id='heatmap'></canvas></div>\n"
+             "  </div>\n"
+             "  <div id='heatmap-tip' class='heatmap-tip'></div>\n"
+             "  <script>\n"
+             "const GPUS = ");
+  json_begin_array(&heatmap->out);
+  return 0;
+}
+
+static unsigned char share_of(unsigned int used, unsigned int total) {
+  if (!total) return 0;
+  if (used > total) used = total;
+  return (unsigned char)((used * 255.0) / total + 0.5);
+}
+
+static void fill_metric(Heatmap_t* heatmap, Gpu_t* gpu, HeatmapMetric_t metric) {
+  const SMResources_t* res = &gpu->free_resources;
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    switch (metric) {
+      case METRIC_OCCUPANCY:
+        heatmap->values[i] = (unsigned char)(calculate_occupancy_of_SM(gpu, i) * 255.0 + 0.5);
+        break;
+      case METRIC_SHARED_MEM:
+        heatmap->values[i] = share_of(gpu->shared_mem_size_in_bytes_per_SM - res->free_shared_mem[i],
+                                      gpu->shared_mem_size_in_bytes_per_SM);
+        break;
+      case METRIC_REGISTERS:
+        heatmap->values[i] = share_of(gpu->number_of_registers_per_SM - res->free_registers[i],
+                                      gpu->number_of_registers_per_SM);
+        break;
+    }
+  }
+}
+
+void add_GPU_to_heatmap(Heatmap_t* heatmap, Gpu_t* gpu) {
+  if ((size_t)gpu->number_of_SMs > heatmap->capacity) {
+    unsigned char* values = realloc(heatmap->values, gpu->number_of_SMs);
+    if (!values) {
+      perror("Failed to allocate heatmap");
+      return;
+    }
+    heatmap->values = values;
+    heatmap->capacity = gpu->number_of_SMs;
+  }
+
+  Writer_t* w = &heatmap->out;
+  json_begin_object(w);
+  json_key(w, "name"); json_string(w, gpu->name);
+  json_key(w, "sms");  json_uint(w, gpu->number_of_SMs);
+  for (HeatmapMetric_t metric = METRIC_OCCUPANCY; metric <= METRIC_REGISTERS; metric++) {
+    fill_metric(heatmap, gpu, metric);
+    json_key(w, metric_keys[metric]);
+    json_base64(w, heatmap->values, gpu->number_of_SMs);
+  }
+  json_end_object(w);
+}
+
+int close_heatmap(Heatmap_t* heatmap) {
+  Writer_t* w = &heatmap->out;
+  json_end_array(w);
+  write_text(w, ";\n");
+  write_text(w, heatmap_script);
+  write_text(w,
+             "  </script>\n"
+             "</body>\n</html>\n");
+
+  free(heatmap->values);
+  heatmap->values = NULL;
+  heatmap->capacity = 0;
+  if (close_writer(w) != 0) return -1;
+  printf("HTML visualization generated: %s\n", HEATMAP_FILE);
+  return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdbool.h>
+#include "cuda_arch.h"
+#include "writer.h"
+
+#define HEATMAP_FILE "results/heatmap.html"
+
+/*
+ * One page with a canvas heatmap of every SM of every GPU. Per GPU, the
+ * occupancy, shared memory and register use of each SM are embedded as
+ * base64 byte arrays (255 = fully used), 4 characters per SM in all, and
+ * an inline script draws them, so the file grows with the number of SMs
+ * only. GPUs are appended as they finish; the script is written on close.
+ */
+typedef struct HEATMAP {
+  Writer_t out;
+  unsigned char* values;   // one metric of the current GPU
+  size_t capacity;
+} Heatmap_t;
+
+int open_heatmap(Heatmap_t* heatmap);
+
+void add_GPU_to_heatmap(Heatmap_t* heatmap, Gpu_t* gpu);
+
+// Returns -1 when the file could not be written
+int close_heatmap(Heatmap_t* heatmap);
+
+#endif // HEATMAP_H
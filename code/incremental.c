@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "incremental.h"
+#include "devmem.h"
+
+// FNV-1a of a kernel name, so a renamed kernel counts as changed
+static uint32_t hash_name(const char* name) {
+  uint32_t h = 0x811c9dc5u;
+  for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+    h ^= *p;
+    h *= 0x01000193u;
+  }
+  return h;
+}
+
+uint32_t* signature_of_GPU(Gpu_t* gpu, Kernel_t* kernels, int kernel_count, size_t* out_words) {
+  size_t words = SIGNATURE_HEADER_WORDS + SIGNATURE_KERNEL_WORDS * (size_t)kernel_count;
+  uint32_t* sig = malloc(sizeof(uint32_t) * words);
+  if (!sig) {
+    perror("Failed to allocate GPU signature");
+    return NULL;
+  }
+
+  sig[0] = gpu->number_of_SMs;
+  sig[1] = gpu->shared_mem_size_in_bytes_per_SM;
+  sig[2] = gpu->number_of_registers_per_SM;
+  sig[3] = gpu->maximum_number_of_warps_per_SM;
+  sig[4] = gpu->maximum_number_of_blocks_per_SM;
+  sig[5] = (uint32_t)gpu->global_mem_size_in_bytes;
+  sig[6] = (uint32_t)((uint64_t)gpu->global_mem_size_in_bytes >> 32);
+  sig[7] = gpu->allocator;
+  sig[8] = kernel_count;
+
+  for (int k = 0; k < kernel_count; k++) {
+    uint32_t* entry = sig + SIGNATURE_HEADER_WORDS + SIGNATURE_KERNEL_WORDS * k;
+    entry[0] = kernels[k].number_of_blocks;
+    entry[1] = kernels[k].threads_per_block;
+    entry[2] = kernels[k].shared_mem_used_in_bytes_per_block;
+    entry[3] = kernels[k].registers_per_thread;
+    entry[4] = hash_name(kernels[k].name);
+    entry[5] = (uint32_t)kernels[k].memory_bytes;
+    entry[6] = (uint32_t)(kernels[k].memory_bytes >> 32);
+    entry[7] = memory_hash_of_kernel(&kernels[k]);
+  }
+
+  *out_words = words;
+  return sig;
+}
+
+int first_changed_kernel(
+  const uint32_t* old_signature,
+  size_t old_words,
+  const uint32_t* new_signature,
+  size_t new_words
+) {
+  if (old_words < SIGNATURE_HEADER_WORDS || new_words < SIGNATURE_HEADER_WORDS) return 0;
+
+  // Everything before the kernel count describes the GPU itself
+  if (memcmp(old_signature, new_signature, sizeof(uint32_t) * (SIGNATURE_HEADER_WORDS - 1)) != 0) {
+    return 0;
+  }
+
+  size_t old_kernels = (old_words - SIGNATURE_HEADER_WORDS) / SIGNATURE_KERNEL_WORDS;
+  size_t new_kernels = (new_words - SIGNATURE_HEADER_WORDS) / SIGNATURE_KERNEL_WORDS;
+  size_t common = old_kernels < new_kernels ? old_kernels : new_kernels;
+
+  const uint32_t* a = old_signature + SIGNATURE_HEADER_WORDS;
+  const uint32_t* b = new_signature + SIGNATURE_HEADER_WORDS;
+  size_t k = 0;
+  while (k < common &&
+         !memcmp(a + SIGNATURE_KERNEL_WORDS * k, b + SIGNATURE_KERNEL_WORDS * k,
+                 sizeof(uint32_t) * SIGNATURE_KERNEL_WORDS)) {
+    k++;
+  }
+  return (int)k;
+}
+
+int same_signature(const uint32_t* a, size_t a_words, const uint32_t* b, size_t b_words) {
+  return a_words == b_words && !memcmp(a, b, sizeof(uint32_t) * a_words);
+}
+
+int init_run_state(RunState_t* run, int gpu_count) {
+  run->gpu_count = 0;
+  run->gpus = calloc(gpu_count ? gpu_count : 1, sizeof(GpuRecord_t));
+  if (!run->gpus) {
+    perror("Failed to allocate run state");
+    return -1;
+  }
+  run->gpu_count = gpu_count;
+  return 0;
+}
+
+static void clear_gpu_record(GpuRecord_t* record) {
+  free(record->name);
+  free(record->signature);
+  free(record->state);
+  memset(record, 0, sizeof(*record));
+}
+
+void free_run_state(RunState_t* run) {
+  for (int i = 0; i < run->gpu_count; i++) {
+    clear_gpu_record(&run->gpus[i]);
+  }
+  free(run->gpus);
+  run->gpus = NULL;
+  run->gpu_count = 0;
+}
+
+void set_gpu_record(
+  RunState_t* run,
+  int index,
+  const char* name,
+  uint32_t* signature,
+  size_t signature_words,
+  unsigned int* state,
+  size_t state_words
+) {
+  GpuRecord_t* record = &run->gpus[index];
+  char* copy = strdup(name);
+  clear_gpu_record(record);
+
+  record->name = copy;
+  record->signature = signature;
+  record->signature_words = signature_words;
+  record->state = state;
+  record->state_words = state_words;
+}
+
+int copy_gpu_record(RunState_t* run, int index, const GpuRecord_t* record) {
+  uint32_t* signature = malloc(sizeof(uint32_t) * (record->signature_words + 1));
+  unsigned int* state = malloc(sizeof(unsigned int) * (record->state_words + 1));
+  if (!signature || !state) {
+    perror("Failed to copy GPU record");
+    free(signature);
+    free(state);
+    return -1;
+  }
+
+  memcpy(signature, record->signature, sizeof(uint32_t) * record->signature_words);
+  memcpy(state, record->state, sizeof(unsigned int) * record->state_words);
+  set_gpu_record(run, index, record->name, signature, record->signature_words,
+                 state, record->state_words);
+  return 0;
+}
+
+const GpuRecord_t* find_gpu_record(const RunState_t* run, const char* name, int hint) {
+  // GPUs rarely move in the config, so the same position is checked first
+  if (hint >= 0 && hint < run->gpu_count && run->gpus[hint].name &&
+      !strcmp(run->gpus[hint].name, name)) {
+    return &run->gpus[hint];
+  }
+  for (int i = 0; i < run->gpu_count; i++) {
+    if (run->gpus[i].name && !strcmp(run->gpus[i].name, name)) return &run->gpus[i];
+  }
+  return NULL;
+}
+
+/*
+ * File layout, all 32-bit words after the magic:
+ *   magic, version, gpu count
+ *   per GPU: name length, name (zero-padded to a word),
+ *            signature words, signature, state words, state
+ */
+static int read_words(FILE* f, void* out, size_t count) {
+  return fread(out, sizeof(uint32_t), count, f) == count ? 0 : -1;
+}
+
+static void* read_array(FILE* f, size_t* out_count, size_t elem_size) {
+  uint32_t count;
+  if (read_words(f, &count, 1) != 0) return NULL;
+
+  size_t words = ((size_t)count * elem_size + 3) / 4;
+  uint32_t* data = calloc(words + 1, sizeof(uint32_t));
+  if (!data) return NULL;
+  if (read_words(f, data, words) != 0) {
+    free(data);
+    return NULL;
+  }
+  *out_count = count;
+  return data;
+}
+
+int load_run_state(const char* path, RunState_t* run) {
+  run->gpu_count = 0;
+  run->gpus = NULL;
+
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    if (errno == ENOENT) return 0;
+    fprintf(stderr, "Error: could not open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  char magic[4];
+  uint32_t header[2];
+  if (fread(magic, 1, 4, f) != 4 || memcmp(magic, RUN_STATE_MAGIC, 4) != 0 ||
+      read_words(f, header, 2) != 0 || header[0] != RUN_STATE_VERSION ||
+      init_run_state(run, header[1]) != 0) {
+    fprintf(stderr, "Warning: ignoring %s, not a run state of this version\n", path);
+    fclose(f);
+    return -1;
+  }
+
+  for (int i = 0; i < run->gpu_count; i++) {
+    GpuRecord_t* record = &run->gpus[i];
+    size_t name_length;
+    record->name = read_array(f, &name_length, 1);
+    record->signature = read_array(f, &record->signature_words, sizeof(uint32_t));
+    record->state = read_array(f, &record->state_words, sizeof(uint32_t));
+    if (!record->name || !record->signature || !record->state) {
+      fprintf(stderr, "Warning: ignoring truncated run state %s\n", path);
+      free_run_state(run);
+      fclose(f);
+      return -1;
+    }
+  }
+
+  fclose(f);
+  return 0;
+}
+
+static int write_array(FILE* f, const void* data, size_t count, size_t elem_size) {
+  uint32_t header = (uint32_t)count;
+  size_t bytes = count * elem_size;
+  static const char padding[4] = {0};
+
+  if (fwrite(&header, sizeof(header), 1, f) != 1) return -1;
+  if (bytes && fwrite(data, 1, bytes, f) != bytes) return -1;
+  if (bytes % 4 && fwrite(padding, 1, 4 - bytes % 4, f) != 4 - bytes % 4) return -1;
+  return 0;
+}
+
+int save_run_state(const char* path, const RunState_t* run) {
+  char tmp_path[512];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+  FILE* f = fopen(tmp_path, "wb");
+  if (!f) {
+    fprintf(stderr, "Error: could not open %s for writing: %s\n", tmp_path, strerror(errno));
+    return -1;
+  }
+
+  uint32_t header[2] = { RUN_STATE_VERSION, (uint32_t)run->gpu_count };
+  int status = fwrite(RUN_STATE_MAGIC, 1, 4, f) == 4 && fwrite(header, sizeof(header), 1, f) == 1 ? 0 : -1;
+
+  for (int i = 0; status == 0 && i < run->gpu_count; i++) {
+    const GpuRecord_t* record = &run->gpus[i];
+    const char* name = record->name ? record->name : "";
+    if (write_array(f, name, strlen(name), 1) != 0 ||
+        write_array(f, record->signature, record->signature_words, sizeof(uint32_t)) != 0 ||
+        write_array(f, record->state, record->state_words, sizeof(uint32_t)) != 0) {
+      status = -1;
+    }
+  }
+
+  if (fclose(f) != 0) status = -1;
+  if (status == 0 && rename(tmp_path, path) != 0) status = -1;
+  if (status != 0) {
+    fprintf(stderr, "Error: could not write run state %s: %s\n", path, strerror(errno));
+    remove(tmp_path);
+  }
+  return status;
+}
@@ -0,0 +1,81 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cuda_arch.h"
+
+#define RUN_STATE_FILE "results/.gpusim_state"
+#define RUN_STATE_MAGIC "GSIS"
+#define RUN_STATE_VERSION 2
+
+/*
+ * Signature of everything a GPU's report depends on, one word per field:
+ *   [0, SIGNATURE_HEADER_WORDS)   SM limits, global memory, allocator, kernel count
+ *   then SIGNATURE_KERNEL_WORDS   blocks, threads, shared mem, registers, name hash,
+ *                                 memory bytes, memory hash (devmem.h)
+ *   per kernel in launch order
+ * Two runs place the blocks of the first N kernels identically when their
+ * headers match and so do the first N kernel entries.
+ */
+#define SIGNATURE_HEADER_WORDS 9
+#define SIGNATURE_KERNEL_WORDS 8
+
+// What the previous run left for one GPU
+typedef struct GPU_RECORD {
+  char* name;
+  uint32_t* signature;
+  size_t signature_words;
+  unsigned int* state;     // encode_GPU_state() output
+  size_t state_words;
+} GpuRecord_t;
+
+typedef struct RUN_STATE {
+  int gpu_count;
+  GpuRecord_t* gpus;
+} RunState_t;
+
+uint32_t* signature_of_GPU(Gpu_t* gpu, Kernel_t* kernels, int kernel_count, size_t* out_words);
+
+/*
+ * Number of leading kernels whose placement can be taken from the old run:
+ * 0 when the GPU changed, otherwise the length of the common kernel prefix.
+ */
+int first_changed_kernel(
+  const uint32_t* old_signature,
+  size_t old_words,
+  const uint32_t* new_signature,
+  size_t new_words
+);
+
+int same_signature(const uint32_t* a, size_t a_words, const uint32_t* b, size_t b_words);
+
+// Allocates gpu_count empty records
+int init_run_state(RunState_t* run, int gpu_count);
+
+void free_run_state(RunState_t* run);
+
+// Takes ownership of signature and state; replaces what the record held
+void set_gpu_record(
+  RunState_t* run,
+  int index,
+  const char* name,
+  uint32_t* signature,
+  size_t signature_words,
+  unsigned int* state,
+  size_t state_words
+);
+
+// Duplicates a record of another run state into slot `index`
+int copy_gpu_record(RunState_t* run, int index, const GpuRecord_t* record);
+
+// Record of the GPU with this name; index `hint` is tried first
+const GpuRecord_t* find_gpu_record(const RunState_t* run, const char* name, int hint);
+
+// A missing file leaves an empty state and is not an error
+int load_run_state(const char* path, RunState_t* run);
+
+// Writes to a temporary file and renames it over path
+int save_run_state(const char* path, const RunState_t* run);
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "metrics.h"
+
+Metrics_t metrics;
+
+static const unsigned long long bucket_bounds_ns[METRICS_BUCKETS] = {
+  1000ull, 2000ull, 5000ull,
+  10000ull, 20000ull, 50000ull,
+  100000ull, 200000ull, 500000ull,
+  1000000ull, 2000000ull, 5000000ull,
+  10000000ull, 20000000ull, 50000000ull,
+  100000000ull, 200000000ull, 500000000ull,
+  1000000000ull, 2000000000ull, 5000000000ull,
+  10000000000ull,
+};
+
+// Wall clock time the process started, for rates over its whole life
+static time_t start_time;
+
+unsigned long long metrics_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void metrics_observe(MetricsHistogram_t* histogram, unsigned long long ns) {
+  int b = 0;
+  while (b < METRICS_BUCKETS && ns > bucket_bounds_ns[b]) b++;
+  atomic_fetch_add_explicit(&histogram->buckets[b], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->sum_ns, ns, memory_order_relaxed);
+}
+
+void metrics_queue_streams(const Kernel_t* kernels, int kernel_count) {
+  unsigned int depth[METRICS_STREAMS + 1] = {0};
+  for (int k = 0; k < kernel_count; k++) {
+    depth[kernels[k].stream_id < METRICS_STREAMS ? kernels[k].stream_id : METRICS_STREAMS]++;
+  }
+  for (int s = 0; s <= METRICS_STREAMS; s++) {
+    atomic_store_explicit(&metrics.stream_depth[s], depth[s], memory_order_relaxed);
+  }
+}
+
+// ================= Text Format ==================
+
+static unsigned long long load(atomic_ullong* counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static void write_counter(FILE* out, const char* name, const char* help, unsigned long long value) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, value);
+}
+
+static void write_gauge(FILE* out, const char* name, const char* help, double value) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %.17g\n", name, help, name, name, value);
+}
+
+static void write_histogram(FILE* out, const char* name, const char* help, MetricsHistogram_t* histogram) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+  unsigned long long count = 0;
+  for (int b = 0; b <= METRICS_BUCKETS; b++) {
+    count += atomic_load_explicit(&histogram->buckets[b], memory_order_relaxed);
+    if (b < METRICS_BUCKETS) {
+      fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", name, bucket_bounds_ns[b] / 1e9, count);
+    } else {
+      fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, count);
+    }
+  }
+  fprintf(out, "%s_sum %.9f\n%s_count %llu\n", name, load(&histogram->sum_ns) / 1e9, name, count);
+}
+
+// Resident set size, or 0 where /proc is missing
+static double resident_bytes(void) {
+  unsigned long long size = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (!f) return 0.0;
+  if (fscanf(f, "%llu %llu", &size, &resident) != 2) resident = 0;
+  fclose(f);
+  return (double)resident * sysconf(_SC_PAGESIZE);
+}
+
+void write_metrics(FILE* out) {
+  write_gauge(out, "gpusim_start_time_seconds", "Start time of the process since the Unix epoch",
+              (double)start_time);
+  write_counter(out, "gpusim_queries_total", "Occupancy queries answered", load(&metrics.queries));
+  write_counter(out, "gpusim_simulations_total", "GPUs whose kernels were placed",
+                load(&metrics.simulations));
+  write_counter(out, "gpusim_gpus_unchanged_total", "GPUs kept from the previous run by --incremental or --watch",
+                load(&metrics.gpus_unchanged));
+
+  unsigned long long hits = load(&metrics.cache_hits), misses = load(&metrics.cache_misses);
+  fprintf(out, "# HELP gpusim_result_cache_lookups_total Result cache lookups by outcome\n"
+               "# TYPE gpusim_result_cache_lookups_total counter\n"
+               "gpusim_result_cache_lookups_total{result=\"hit\"} %llu\n"
+               "gpusim_result_cache_lookups_total{result=\"miss\"} %llu\n", hits, misses);
+  write_gauge(out, "gpusim_result_cache_hit_ratio", "Result cache hits over all lookups since start",
+              hits + misses ? (double)hits / (hits + misses) : 0.0);
+
+  write_histogram(out, "gpusim_gpu_placement_seconds", "Time to place every kernel on one GPU",
+                  &metrics.gpu_placement);
+  write_histogram(out, "gpusim_query_placement_seconds", "Time to answer one placement query",
+                  &metrics.query_placement);
+
+  write_gauge(out, "gpusim_query_backlog", "Connections with queries waiting for a query worker",
+              atomic_load_explicit(&metrics.query_backlog, memory_order_relaxed));
+  write_gauge(out, "gpusim_query_connections", "Query connections open",
+              atomic_load_explicit(&metrics.query_connections, memory_order_relaxed));
+
+  fprintf(out, "# HELP gpusim_stream_queue_depth Kernels of the GPU being simulated still queued on each stream\n"
+               "# TYPE gpusim_stream_queue_depth gauge\n");
+  for (int s = 0; s <= METRICS_STREAMS; s++) {
+    unsigned int depth = atomic_load_explicit(&metrics.stream_depth[s], memory_order_relaxed);
+    if (!depth) continue;
+    if (s < METRICS_STREAMS) fprintf(out, "gpusim_stream_queue_depth{stream=\"%d\"} %u\n", s, depth);
+    else fprintf(out, "gpusim_stream_queue_depth{stream=\"other\"} %u\n", depth);
+  }
+
+  write_gauge(out, "gpusim_resident_memory_bytes", "Resident memory of the process", resident_bytes());
+}
+
+// ================= Exporter ==================
+
+static int write_metrics_file(const char* path) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE* f = fopen(tmp, "w");
+  if (!f) {
+    perror("Failed to write metrics");
+    return -1;
+  }
+  write_metrics(f);
+  if (fclose(f) != 0 || rename(tmp, path) != 0) {
+    perror("Failed to write metrics");
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+// Any request gets the metrics; the request itself is not looked at
+static void answer_scrape(int listen_fd) {
+  int fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0) return;
+
+  char request[1024];
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  if (poll(&pfd, 1, 1000) > 0) (void)!read(fd, request, sizeof(request));
+
+  FILE* out = fdopen(fd, "w");
+  if (!out) {
+    close(fd);
+    return;
+  }
+  fprintf(out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+  write_metrics(out);
+  fclose(out);
+}
+
+static void* exporter_main(void* arg) {
+  MetricsExporter_t* exporter = arg;
+  struct pollfd fds[2] = {
+    { .fd = exporter->wake[0], .events = POLLIN },
+    { .fd = exporter->listen_fd, .events = POLLIN },
+  };
+  int nfds = exporter->listen_fd >= 0 ? 2 : 1;
+  unsigned long long interval_ns = exporter->interval * 1000000000ull;
+  unsigned long long next = metrics_now_ns();   // the file is written right away
+
+  for (;;) {
+    int timeout = -1;
+    if (exporter->path) {
+      unsigned long long now = metrics_now_ns();
+      timeout = next > now ? (int)((next - now) / 1000000) + 1 : 0;
+    }
+    int ready = poll(fds, nfds, timeout);
+    if (ready < 0 && errno != EINTR) break;
+    if (ready > 0 && fds[0].revents) break;
+    if (ready > 0 && nfds > 1 && fds[1].revents) answer_scrape(exporter->listen_fd);
+
+    if (exporter->path && metrics_now_ns() >= next) {
+      write_metrics_file(exporter->path);
+      next = metrics_now_ns() + interval_ns;
+    }
+  }
+  return NULL;
+}
+
+static int listen_on_port(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("Failed to create metrics socket");
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_port = htons(port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+    perror("Failed to listen for metrics scrapes");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int start_metrics_exporter(MetricsExporter_t* exporter, const char* path, int interval, int port) {
+  memset(exporter, 0, sizeof(*exporter));
+  exporter->path = path;
+  exporter->interval = interval > 0 ? interval : METRICS_INTERVAL;
+  exporter->listen_fd = -1;
+  start_time = time(NULL);
+
+  if (port && (exporter->listen_fd = listen_on_port(port)) < 0) return -1;
+  if (pipe(exporter->wake) != 0) {
+    perror("Failed to start metrics exporter");
+    if (exporter->listen_fd >= 0) close(exporter->listen_fd);
+    return -1;
+  }
+
+  // The thread takes no signals, so they keep reaching the main thread
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  int error = pthread_create(&exporter->thread, NULL, exporter_main, exporter);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (error) {
+    fprintf(stderr, "Failed to start metrics exporter: %s\n", strerror(error));
+    close(exporter->wake[0]);
+    close(exporter->wake[1]);
+    if (exporter->listen_fd >= 0) close(exporter->listen_fd);
+    return -1;
+  }
+  return 0;
+}
+
+void stop_metrics_exporter(MetricsExporter_t* exporter) {
+  (void)!write(exporter->wake[1], "", 1);
+  pthread_join(exporter->thread, NULL);
+  close(exporter->wake[0]);
+  close(exporter->wake[1]);
+  if (exporter->listen_fd >= 0) close(exporter->listen_fd);
+  if (exporter->path) write_metrics_file(exporter->path);
+}
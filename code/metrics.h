@@ -0,0 +1,102 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "cuda_arch.h"
+
+// Seconds between writes of the --metrics file
+#define METRICS_INTERVAL 15
+
+// Streams with their own queue depth; higher ids are summed under "other"
+#define METRICS_STREAMS 64
+
+// Upper bounds of the latency buckets in nanoseconds, 1-2-5 from 1 us to 10 s
+#define METRICS_BUCKETS 22
+
+// ================= Type Declaration ==================
+
+// Counts per bucket, made cumulative when written
+typedef struct METRICS_HISTOGRAM {
+  atomic_ullong buckets[METRICS_BUCKETS + 1];   // the last one is +Inf
+  atomic_ullong sum_ns;
+} MetricsHistogram_t;
+
+/*
+ * Process-wide counters in the Prometheus text format, for long runs
+ * (--watch, --serve) that monitoring scrapes. The hot paths only do
+ * relaxed atomic adds and stores; everything else, the cumulative
+ * buckets, the resident memory and the formatting, happens when the
+ * metrics are written.
+ *
+ * Counters and histograms updated by every query worker, or on every
+ * placement, start on their own cache lines.
+ */
+typedef struct METRICS {
+  _Alignas(64) atomic_ullong queries;
+  _Alignas(64) atomic_ullong simulations;        // GPUs placed
+  atomic_ullong gpus_unchanged;                  // kept from the previous run
+  atomic_ullong cache_hits;
+  atomic_ullong cache_misses;
+  atomic_int query_backlog;                      // connections with queries waiting for a worker
+  atomic_int query_connections;                  // connections open
+  atomic_uint stream_depth[METRICS_STREAMS + 1]; // kernels still queued on each stream
+  _Alignas(64) MetricsHistogram_t gpu_placement;
+  _Alignas(64) MetricsHistogram_t query_placement;
+} Metrics_t;
+
+extern Metrics_t metrics;
+
+// Writer of the metrics file and answerer of scrapes, when either is asked for
+typedef struct METRICS_EXPORTER {
+  const char* path;          // textfile collector file, or NULL
+  int interval;              // seconds between writes of path
+  int listen_fd;             // HTTP on 127.0.0.1, or -1
+  int wake[2];               // pipe that stops the thread
+  pthread_t thread;
+} MetricsExporter_t;
+
+// ================= Function Declarations ==================
+
+static inline void metrics_add(atomic_ullong* counter, unsigned long long n) {
+  atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+static inline void metrics_set(atomic_int* gauge, int value) {
+  atomic_store_explicit(gauge, value, memory_order_relaxed);
+}
+
+static inline void metrics_add_connections(int n) {
+  atomic_fetch_add_explicit(&metrics.query_connections, n, memory_order_relaxed);
+}
+
+// Nanoseconds on the monotonic clock, for metrics_observe()
+unsigned long long metrics_now_ns(void);
+
+void metrics_observe(MetricsHistogram_t* histogram, unsigned long long ns);
+
+// Queues every kernel on its stream before a GPU is launched
+void metrics_queue_streams(const Kernel_t* kernels, int kernel_count);
+
+// Takes one launched kernel off its stream's queue
+static inline void metrics_dequeue_stream(unsigned short stream_id) {
+  int s = stream_id < METRICS_STREAMS ? stream_id : METRICS_STREAMS;
+  atomic_fetch_sub_explicit(&metrics.stream_depth[s], 1, memory_order_relaxed);
+}
+
+// Every metric in the Prometheus text exposition format
+void write_metrics(FILE* out);
+
+/*
+ * Starts a thread that writes the metrics to path every interval seconds,
+ * through a temporary file renamed over it so the textfile collector never
+ * reads half a file, and answers HTTP requests on 127.0.0.1:port when
+ * port is not 0. Returns -1 when neither can be set up.
+ */
+int start_metrics_exporter(MetricsExporter_t* exporter, const char* path, int interval, int port);
+
+// Writes the file one last time and joins the thread
+void stop_metrics_exporter(MetricsExporter_t* exporter);
+
+#endif // METRICS_H
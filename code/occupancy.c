@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include "occupancy.h"
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+// Shapes evaluated per call of occupancy_chunk()
+#define OCCUPANCY_CHUNK 16
+
+// Capacities up to this divide exactly in single precision
+#define FLOAT_EXACT_LIMIT (1u << 24)
+
+OccupancyTable_t new_occupancy_table(const Gpu_t* gpu) {
+  OccupancyTable_t table = {
+    .max_blocks = gpu->maximum_number_of_blocks_per_SM,
+    .warps = gpu->maximum_number_of_warps_per_SM,
+    .registers = gpu->number_of_registers_per_SM,
+    .shared_mem = gpu->shared_mem_size_in_bytes_per_SM,
+    .inverse_warps = gpu->maximum_number_of_warps_per_SM ?
+      1.0f / gpu->maximum_number_of_warps_per_SM : 0.0f,
+    .inverse_registers = gpu->number_of_registers_per_SM ?
+      1.0f / gpu->number_of_registers_per_SM : 0.0f,
+    .inverse_shared_mem = gpu->shared_mem_size_in_bytes_per_SM ?
+      1.0f / gpu->shared_mem_size_in_bytes_per_SM : 0.0f,
+    .inverse_blocks = gpu->maximum_number_of_blocks_per_SM ?
+      1.0f / gpu->maximum_number_of_blocks_per_SM : 0.0f,
+  };
+  table.exact_in_float = table.warps < FLOAT_EXACT_LIMIT && table.registers < FLOAT_EXACT_LIMIT &&
+                         table.shared_mem < FLOAT_EXACT_LIMIT;
+  return table;
+}
+
+/*
+ * Blocks of each shape that fit, and the limit: every capacity divided by
+ * the need, rounded down, and at most max_blocks. A need of 0 divides to
+ * inf, or NaN over a capacity of 0, and then sets no bound: the minimum
+ * keeps its second operand and the compares are false. A resource is the
+ * limit when its quotient is below blocks + 1, so one more block would
+ * not fit; the first such in Limit_t order, blocks, warps, registers,
+ * shared memory, is reported, like rejecting_limit() does for placement.
+ */
+static void count_blocks_double(const OccupancyTable_t* table, const int* warps, const int* regs,
+                                const int* shared, int* out_blocks, int* out_limit) {
+  double max_blocks = table->max_blocks;
+  for (int i = 0; i < OCCUPANCY_CHUNK; i++) {
+    double qw = (double)table->warps / warps[i];
+    double qr = (double)table->registers / regs[i];
+    double qs = (double)table->shared_mem / shared[i];
+    double fit = qw < max_blocks ? qw : max_blocks;
+    fit = qr < fit ? qr : fit;
+    fit = qs < fit ? qs : fit;
+    int a = (int)fit;
+
+    int limit = LIMIT_SHARED_MEM;
+    limit = qr < a + 1 ? LIMIT_REGISTERS : limit;
+    limit = qw < a + 1 ? LIMIT_WARPS : limit;
+    limit = (unsigned int)a == table->max_blocks ? LIMIT_BLOCKS : limit;
+    out_blocks[i] = a;
+    out_limit[i] = limit;
+  }
+}
+
+// The same in single precision, several shapes per instruction. Needs and
+// capacities are integers, so while the capacities stay below 2^24 the
+// quotient never rounds up to the next integer.
+static void count_fitting_blocks(const OccupancyTable_t* table, const int* warps, const int* regs,
+                                 const int* shared, int* out_blocks, int* out_limit) {
+#if defined(__AVX2__)
+  if (table->exact_in_float) {
+    __m256 cw = _mm256_set1_ps(table->warps), cr = _mm256_set1_ps(table->registers);
+    __m256 cs = _mm256_set1_ps(table->shared_mem), mb = _mm256_set1_ps(table->max_blocks);
+    __m256i max_blocks = _mm256_set1_epi32(table->max_blocks);
+    for (int lane = 0; lane < OCCUPANCY_CHUNK; lane += 8) {
+      __m256 qw = _mm256_div_ps(cw, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(warps + lane))));
+      __m256 qr = _mm256_div_ps(cr, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(regs + lane))));
+      __m256 qs = _mm256_div_ps(cs, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(shared + lane))));
+      __m256 fit = _mm256_min_ps(qs, _mm256_min_ps(qr, _mm256_min_ps(qw, mb)));
+      __m256i a = _mm256_cvttps_epi32(fit);
+      __m256 next = _mm256_add_ps(_mm256_cvtepi32_ps(a), _mm256_set1_ps(1.0f));
+
+      __m256 limit = _mm256_set1_ps(LIMIT_SHARED_MEM);
+      limit = _mm256_blendv_ps(limit, _mm256_set1_ps(LIMIT_REGISTERS), _mm256_cmp_ps(qr, next, _CMP_LT_OQ));
+      limit = _mm256_blendv_ps(limit, _mm256_set1_ps(LIMIT_WARPS), _mm256_cmp_ps(qw, next, _CMP_LT_OQ));
+      limit = _mm256_blendv_ps(limit, _mm256_set1_ps(LIMIT_BLOCKS),
+                               _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, max_blocks)));
+      _mm256_storeu_si256((__m256i*)(out_blocks + lane), a);
+      _mm256_storeu_si256((__m256i*)(out_limit + lane), _mm256_cvttps_epi32(limit));
+    }
+    return;
+  }
+#elif defined(__SSE2__)
+  if (table->exact_in_float) {
+    __m128 cw = _mm_set1_ps(table->warps), cr = _mm_set1_ps(table->registers);
+    __m128 cs = _mm_set1_ps(table->shared_mem), mb = _mm_set1_ps(table->max_blocks);
+    __m128i max_blocks = _mm_set1_epi32(table->max_blocks);
+    for (int lane = 0; lane < OCCUPANCY_CHUNK; lane += 4) {
+      __m128 qw = _mm_div_ps(cw, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(warps + lane))));
+      __m128 qr = _mm_div_ps(cr, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(regs + lane))));
+      __m128 qs = _mm_div_ps(cs, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(shared + lane))));
+      __m128 fit = _mm_min_ps(qs, _mm_min_ps(qr, _mm_min_ps(qw, mb)));
+      __m128i a = _mm_cvttps_epi32(fit);
+      __m128 next = _mm_add_ps(_mm_cvtepi32_ps(a), _mm_set1_ps(1.0f));
+
+      // No blend in SSE2: masked lanes take the new limit
+      __m128i limit = _mm_set1_epi32(LIMIT_SHARED_MEM);
+      __m128i m = _mm_castps_si128(_mm_cmplt_ps(qr, next));
+      limit = _mm_or_si128(_mm_and_si128(m, _mm_set1_epi32(LIMIT_REGISTERS)), _mm_andnot_si128(m, limit));
+      m = _mm_castps_si128(_mm_cmplt_ps(qw, next));
+      limit = _mm_or_si128(_mm_and_si128(m, _mm_set1_epi32(LIMIT_WARPS)), _mm_andnot_si128(m, limit));
+      m = _mm_cmpeq_epi32(a, max_blocks);
+      limit = _mm_or_si128(_mm_and_si128(m, _mm_set1_epi32(LIMIT_BLOCKS)), _mm_andnot_si128(m, limit));
+      _mm_storeu_si128((__m128i*)(out_blocks + lane), a);
+      _mm_storeu_si128((__m128i*)(out_limit + lane), limit);
+    }
+    return;
+  }
+#endif
+  count_blocks_double(table, warps, regs, shared, out_blocks, out_limit);
+}
+
+static void occupancy_chunk(
+  const OccupancyTable_t* table,
+  const unsigned int* threads,
+  const unsigned int* regs,
+  const unsigned int* shared,
+  float* out_occupancy,
+  unsigned char* out_limit,
+  unsigned short* out_blocks
+) {
+  // Needs are clamped to INT_MAX so signed SIMD compares stay exact
+  int need_warps[OCCUPANCY_CHUNK], need_regs[OCCUPANCY_CHUNK], need_shared[OCCUPANCY_CHUNK];
+  int active[OCCUPANCY_CHUNK], limits[OCCUPANCY_CHUNK];
+
+  for (int i = 0; i < OCCUPANCY_CHUNK; i++) {
+    uint64_t r = (uint64_t)regs[i] * threads[i];
+    need_warps[i] = (int)((threads[i] >> 5) + ((threads[i] & 31) != 0));
+    need_regs[i] = r > INT_MAX ? INT_MAX : (int)r;
+    need_shared[i] = shared[i] > INT_MAX ? INT_MAX : (int)shared[i];
+  }
+
+  count_fitting_blocks(table, need_warps, need_regs, need_shared, active, limits);
+
+  for (int i = 0; i < OCCUPANCY_CHUNK; i++) {
+    out_limit[i] = (unsigned char)limits[i];
+    if (out_blocks) out_blocks[i] = (unsigned short)active[i];
+  }
+
+  // Same definition as calculate_occupancy_of_SM(): the most used resource
+  for (int i = 0; i < OCCUPANCY_CHUNK; i++) {
+    float fa = (float)active[i];
+    float occ = fa * table->inverse_blocks;
+    float w = fa * (float)need_warps[i] * table->inverse_warps;
+    float r = fa * (float)need_regs[i] * table->inverse_registers;
+    float s = fa * (float)need_shared[i] * table->inverse_shared_mem;
+    occ = w > occ ? w : occ;
+    occ = r > occ ? r : occ;
+    occ = s > occ ? s : occ;
+    out_occupancy[i] = occ > 1.0f ? 1.0f : occ;
+  }
+}
+
+void occupancy_batch(
+  const OccupancyTable_t* table,
+  size_t count,
+  const unsigned int* threads_per_block,
+  const unsigned int* registers_per_thread,
+  const unsigned int* shared_mem_per_block,
+  float* out_occupancy,
+  unsigned char* out_limit,
+  unsigned short* out_blocks_per_SM
+) {
+  size_t i = 0;
+  for (; i + OCCUPANCY_CHUNK <= count; i += OCCUPANCY_CHUNK) {
+    occupancy_chunk(table,
+      threads_per_block + i, registers_per_thread + i, shared_mem_per_block + i,
+      out_occupancy + i, out_limit + i,
+      out_blocks_per_SM ? out_blocks_per_SM + i : NULL);
+  }
+
+  if (i == count) return;
+
+  // Pad the tail to a full chunk
+  unsigned int threads[OCCUPANCY_CHUNK] = {0}, regs[OCCUPANCY_CHUNK] = {0}, shared[OCCUPANCY_CHUNK] = {0};
+  float occ[OCCUPANCY_CHUNK];
+  unsigned char limit[OCCUPANCY_CHUNK];
+  unsigned short blocks[OCCUPANCY_CHUNK];
+  size_t rest = count - i;
+
+  memcpy(threads, threads_per_block + i, sizeof(unsigned int) * rest);
+  memcpy(regs, registers_per_thread + i, sizeof(unsigned int) * rest);
+  memcpy(shared, shared_mem_per_block + i, sizeof(unsigned int) * rest);
+  occupancy_chunk(table, threads, regs, shared, occ, limit, blocks);
+
+  memcpy(out_occupancy + i, occ, sizeof(float) * rest);
+  memcpy(out_limit + i, limit, rest);
+  if (out_blocks_per_SM) memcpy(out_blocks_per_SM + i, blocks, sizeof(unsigned short) * rest);
+}
+
+void occupancy_of_shape(
+  const OccupancyTable_t* table,
+  unsigned int threads_per_block,
+  unsigned int registers_per_thread,
+  unsigned int shared_mem_per_block,
+  float* out_occupancy,
+  unsigned char* out_limit,
+  unsigned short* out_blocks_per_SM
+) {
+  uint64_t r = (uint64_t)registers_per_thread * threads_per_block;
+  int need_warps = (int)((threads_per_block >> 5) + ((threads_per_block & 31) != 0));
+  int need_regs = r > INT_MAX ? INT_MAX : (int)r;
+  int need_shared = shared_mem_per_block > INT_MAX ? INT_MAX : (int)shared_mem_per_block;
+
+  // Blocks each resource allows, UINT_MAX for one the shape does not need
+  unsigned int fit_warps = need_warps ? table->warps / need_warps : UINT_MAX;
+  unsigned int fit_regs = need_regs ? table->registers / need_regs : UINT_MAX;
+  unsigned int fit_shared = need_shared ? table->shared_mem / need_shared : UINT_MAX;
+  unsigned int active = table->max_blocks;
+  active = fit_warps < active ? fit_warps : active;
+  active = fit_regs < active ? fit_regs : active;
+  active = fit_shared < active ? fit_shared : active;
+
+  // Allowing no more than active blocks makes a resource the limit
+  unsigned char limit = LIMIT_SHARED_MEM;
+  limit = fit_regs == active ? LIMIT_REGISTERS : limit;
+  limit = fit_warps == active ? LIMIT_WARPS : limit;
+  limit = active == table->max_blocks ? LIMIT_BLOCKS : limit;
+
+  float fa = (float)active;
+  float occ = fa * table->inverse_blocks;
+  float w = fa * (float)need_warps * table->inverse_warps;
+  float rg = fa * (float)need_regs * table->inverse_registers;
+  float sh = fa * (float)need_shared * table->inverse_shared_mem;
+  occ = w > occ ? w : occ;
+  occ = rg > occ ? rg : occ;
+  occ = sh > occ ? sh : occ;
+
+  *out_occupancy = occ > 1.0f ? 1.0f : occ;
+  *out_limit = limit;
+  if (out_blocks_per_SM) *out_blocks_per_SM = (unsigned short)active;
+}
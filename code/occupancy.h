@@ -0,0 +1,65 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "cuda_arch.h"
+
+// ================= Type Declaration ==================
+
+/*
+ * Per-GPU constants for the batch occupancy API.
+ *
+ * The number of blocks of one shape an empty SM can hold is, for each
+ * resource, its capacity divided by the shape's need, rounded down, and at
+ * most maximum_number_of_blocks_per_SM. SIMD divides several shapes at once
+ * in single precision, exact while every capacity is below 2^24; larger
+ * capacities take a scalar double-precision path.
+ */
+typedef struct OCCUPANCY_TABLE {
+  unsigned int max_blocks;
+  unsigned int warps;          // capacities of one SM
+  unsigned int registers;
+  unsigned int shared_mem;
+  bool exact_in_float;
+
+  float inverse_warps;
+  float inverse_registers;
+  float inverse_shared_mem;
+  float inverse_blocks;
+} OccupancyTable_t;
+
+// ================= Function Declarations ==================
+
+// Holds no memory, so it needs no freeing
+OccupancyTable_t new_occupancy_table(const Gpu_t* gpu);
+
+/*
+ * Occupancy of an empty SM filled with as many blocks of each shape as fit,
+ * using the same limits as canFitBlock() and the same definition as
+ * calculate_occupancy_of_SM(). Inputs and outputs are parallel arrays of
+ * `count` entries; out_blocks_per_SM may be NULL.
+ */
+void occupancy_batch(
+  const OccupancyTable_t* table,
+  size_t count,
+  const unsigned int* threads_per_block,
+  const unsigned int* registers_per_thread,
+  const unsigned int* shared_mem_per_block,
+  float* out_occupancy,
+  unsigned char* out_limit,
+  unsigned short* out_blocks_per_SM
+);
+
+// Same as occupancy_batch() for a single shape, without padding it to a chunk
+void occupancy_of_shape(
+  const OccupancyTable_t* table,
+  unsigned int threads_per_block,
+  unsigned int registers_per_thread,
+  unsigned int shared_mem_per_block,
+  float* out_occupancy,
+  unsigned char* out_limit,
+  unsigned short* out_blocks_per_SM
+);
+
+#endif // OCCUPANCY_H
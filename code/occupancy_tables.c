@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "occupancy_tables.h"
+#include "stats.h"
+
+void compute_occupancy_tables(Gpu_t* gpu, OccupancyTables_t* tables) {
+  // A single empty SM with the GPU's limits is refilled for every shape
+  Gpu_t sm = new_GPU(
+    gpu->name,
+    gpu->global_mem_size_in_bytes,
+    gpu->shared_mem_size_in_bytes_per_SM,
+    gpu->number_of_registers_per_SM,
+    gpu->maximum_number_of_warps_per_SM,
+    gpu->maximum_number_of_blocks_per_SM,
+    1
+  );
+
+  tables->shared_bucket = (gpu->shared_mem_size_in_bytes_per_SM + TABLE_SHARED_BUCKETS - 1) / TABLE_SHARED_BUCKETS;
+
+  for (unsigned int t = 0; t < TABLE_BUCKETS; t++) {
+    for (unsigned int r = 0; r < TABLE_BUCKETS; r++) {
+      for (unsigned int s = 0; s < TABLE_BUCKETS; s++) {
+        Block_t block = {
+          .kernel_name = gpu->name,
+          .number_of_thread = t * TABLE_THREAD_BUCKET,
+          .number_of_registers_used_per_thread = r * TABLE_REGISTER_BUCKET,
+          .shared_mem_used_in_bytes = s * tables->shared_bucket,
+        };
+
+        reset_GPU(&sm);
+        unsigned int blocks = 0;
+        while (canFitBlock(&sm, 0, &block)) {
+          place_block_on_SM(&sm, 0, &block);
+          blocks++;
+        }
+
+        tables->max_blocks[t][r][s] = blocks > 255 ? 255 : (unsigned char)blocks;
+        tables->occupancy_bp[t][r][s] = (unsigned short)(calculate_occupancy_of_SM(&sm, 0) * 10000.0 + 0.5);
+      }
+    }
+  }
+
+  free_GPU(&sm);
+}
+
+static void put_u32(FILE* f, unsigned int v) {
+  unsigned char b[4] = { v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, (v >> 24) & 0xFF };
+  fwrite(b, 1, sizeof(b), f);
+}
+
+static int write_tables_blob(Gpu_t* gpu, const OccupancyTables_t* tables, const char* filepath) {
+  FILE* f = fopen(filepath, "wb");
+  if (!f) {
+    fprintf(stderr, "Error: could not open file %s for writing.\n", filepath);
+    return -1;
+  }
+
+  unsigned int name_length = (unsigned int)strlen(gpu->name);
+  fwrite(TABLE_BLOB_MAGIC, 1, 4, f);
+  put_u32(f, TABLE_BLOB_VERSION);
+  put_u32(f, TABLE_BUCKETS);
+  put_u32(f, TABLE_THREAD_BUCKET);
+  put_u32(f, TABLE_REGISTER_BUCKET);
+  put_u32(f, tables->shared_bucket);
+  put_u32(f, gpu->shared_mem_size_in_bytes_per_SM);
+  put_u32(f, gpu->number_of_registers_per_SM);
+  put_u32(f, gpu->maximum_number_of_warps_per_SM);
+  put_u32(f, gpu->maximum_number_of_blocks_per_SM);
+  put_u32(f, name_length);
+  fwrite(gpu->name, 1, name_length, f);
+
+  fwrite(tables->max_blocks, 1, sizeof(tables->max_blocks), f);
+  const unsigned short* occ = &tables->occupancy_bp[0][0][0];
+  for (size_t i = 0; i < sizeof(tables->occupancy_bp) / sizeof(*occ); i++) {
+    unsigned char b[2] = { occ[i] & 0xFF, occ[i] >> 8 };
+    fwrite(b, 1, sizeof(b), f);
+  }
+
+  int failed = ferror(f);
+  STATS_ADD(STAT_BYTES_WRITTEN, ftell(f));
+  fclose(f);
+  if (failed) {
+    fprintf(stderr, "Error: could not write %s.\n", filepath);
+    return -1;
+  }
+  return 0;
+}
+
+static void write_table_rows(FILE* f, const char* type, const char* prefix, const char* table,
+                             const void* data, size_t elem_size) {
+  fprintf(f, "static const %s %s_%s[%d][%d][%d] = {\n", type, prefix, table,
+          TABLE_BUCKETS, TABLE_BUCKETS, TABLE_BUCKETS);
+  for (int t = 0; t < TABLE_BUCKETS; t++) {
+    fprintf(f, "  {\n");
+    for (int r = 0; r < TABLE_BUCKETS; r++) {
+      fprintf(f, "    {");
+      for (int s = 0; s < TABLE_BUCKETS; s++) {
+        size_t i = ((size_t)t * TABLE_BUCKETS + r) * TABLE_BUCKETS + s;
+        unsigned int v = elem_size == 1 ? ((const unsigned char*)data)[i] : ((const unsigned short*)data)[i];
+        fprintf(f, "%s%u", s ? "," : "", v);
+      }
+      fprintf(f, "}%s\n", r + 1 < TABLE_BUCKETS ? "," : "");
+    }
+    fprintf(f, "  }%s\n", t + 1 < TABLE_BUCKETS ? "," : "");
+  }
+  fprintf(f, "};\n\n");
+}
+
+static int write_tables_header(Gpu_t* gpu, const OccupancyTables_t* tables, const char* filepath) {
+  FILE* f = fopen(filepath, "w");
+  if (!f) {
+    fprintf(stderr, "Error: could not open file %s for writing.\n", filepath);
+    return -1;
+  }
+
+  // C identifiers for the GPU: as-is for functions and tables, upper case for macros
+  char prefix[256], macro[256];
+  snprintf(prefix, sizeof(prefix), "%s%s", isdigit((unsigned char)gpu->name[0]) ? "gpu_" : "", gpu->name);
+  for (char* p = prefix; *p; p++) {
+    if (!isalnum((unsigned char)*p)) *p = '_';
+  }
+  for (size_t i = 0; i < sizeof(macro); i++) {
+    macro[i] = (char)toupper((unsigned char)prefix[i]);
+    if (!prefix[i]) break;
+  }
+
+  fprintf(f,
+          "/* Occupancy lookup tables for GPU %s, generated by GPU_sim --tables. Do not edit. */\n"
+          "#ifndef %s_OCCUPANCY_H\n"
+          "#define %s_OCCUPANCY_H\n\n"
+          "/* SM limits the tables were computed for */\n"
+          "#define %s_SHARED_MEM_PER_SM %u\n"
+          "#define %s_REGISTERS_PER_SM %u\n"
+          "#define %s_MAX_WARPS_PER_SM %hu\n"
+          "#define %s_MAX_BLOCKS_PER_SM %hu\n\n"
+          "/* Index = ceil(value / bucket); entries hold the largest shape of each bucket */\n"
+          "#define %s_TABLE_BUCKETS %d\n"
+          "#define %s_THREAD_BUCKET %d\n"
+          "#define %s_REGISTER_BUCKET %d\n"
+          "#define %s_SHARED_BUCKET %u\n\n",
+          gpu->name, macro, macro,
+          macro, gpu->shared_mem_size_in_bytes_per_SM,
+          macro, gpu->number_of_registers_per_SM,
+          macro, gpu->maximum_number_of_warps_per_SM,
+          macro, gpu->maximum_number_of_blocks_per_SM,
+          macro, TABLE_BUCKETS,
+          macro, TABLE_THREAD_BUCKET,
+          macro, TABLE_REGISTER_BUCKET,
+          macro, tables->shared_bucket);
+
+  write_table_rows(f, "unsigned char", prefix, "max_blocks", tables->max_blocks, 1);
+  fprintf(f, "/* Occupancy in units of 1/10000 */\n");
+  write_table_rows(f, "unsigned short", prefix, "occupancy_bp", tables->occupancy_bp, 2);
+
+  fprintf(f,
+          "/* Returns 0 and leaves the indexes unset when a value is past the last bucket */\n"
+          "static inline int %s_table_index(unsigned int threads, unsigned int registers_per_thread,\n"
+          "                                 unsigned int shared_mem, unsigned int *t, unsigned int *r, unsigned int *s) {\n"
+          "  unsigned int ti = (threads + %s_THREAD_BUCKET - 1) / %s_THREAD_BUCKET;\n"
+          "  unsigned int ri = (registers_per_thread + %s_REGISTER_BUCKET - 1) / %s_REGISTER_BUCKET;\n"
+          "  unsigned int si = (shared_mem + %s_SHARED_BUCKET - 1) / %s_SHARED_BUCKET;\n"
+          "  if (ti >= %s_TABLE_BUCKETS || ri >= %s_TABLE_BUCKETS || si >= %s_TABLE_BUCKETS) return 0;\n"
+          "  *t = ti; *r = ri; *s = si;\n"
+          "  return 1;\n"
+          "}\n\n"
+          "static inline unsigned int %s_max_active_blocks(unsigned int threads, unsigned int registers_per_thread,\n"
+          "                                                unsigned int shared_mem) {\n"
+          "  unsigned int t, r, s;\n"
+          "  if (!%s_table_index(threads, registers_per_thread, shared_mem, &t, &r, &s)) return 0;\n"
+          "  return %s_max_blocks[t][r][s];\n"
+          "}\n\n"
+          "static inline double %s_occupancy(unsigned int threads, unsigned int registers_per_thread,\n"
+          "                                  unsigned int shared_mem) {\n"
+          "  unsigned int t, r, s;\n"
+          "  if (!%s_table_index(threads, registers_per_thread, shared_mem, &t, &r, &s)) return 0.0;\n"
+          "  return %s_occupancy_bp[t][r][s] / 10000.0;\n"
+          "}\n\n"
+          "#endif /* %s_OCCUPANCY_H */\n",
+          prefix, macro, macro, macro, macro, macro, macro, macro, macro, macro,
+          prefix, prefix, prefix,
+          prefix, prefix, prefix,
+          macro);
+
+  int failed = ferror(f);
+  STATS_ADD(STAT_BYTES_WRITTEN, ftell(f));
+  fclose(f);
+  if (failed) {
+    fprintf(stderr, "Error: could not write %s.\n", filepath);
+    return -1;
+  }
+  return 0;
+}
+
+int export_occupancy_tables(Gpu_t* gpu) {
+  if (!gpu) {
+    fprintf(stderr, "Error: GPU pointer is NULL.\n");
+    return -1;
+  }
+  if (ensure_results_dir() != 0) return -1;
+
+  OccupancyTables_t* tables = malloc(sizeof(OccupancyTables_t));
+  if (!tables) {
+    perror("Failed to allocate occupancy tables");
+    return -1;
+  }
+  compute_occupancy_tables(gpu, tables);
+
+  char header_path[512], blob_path[512];
+  results_path_of_GPU(gpu, "_occupancy.h", header_path, sizeof(header_path));
+  results_path_of_GPU(gpu, "_occupancy.bin", blob_path, sizeof(blob_path));
+
+  int status = write_tables_header(gpu, tables, header_path);
+  if (status == 0) status = write_tables_blob(gpu, tables, blob_path);
+  free(tables);
+
+  if (status == 0) {
+    printf("Occupancy tables generated: %s, %s\n", header_path, blob_path);
+  }
+  return status;
+}
@@ -0,0 +1,36 @@
+#ifndef OCCUPANCY_TABLES_H
+#define OCCUPANCY_TABLES_H
+
+#include "cuda_arch.h"
+
+// Tables are indexed by ceil(value / bucket size) along each axis
+#define TABLE_THREAD_BUCKET 32
+#define TABLE_REGISTER_BUCKET 8
+#define TABLE_SHARED_BUCKETS 32
+#define TABLE_BUCKETS 33
+
+#define TABLE_BLOB_MAGIC "GSOT"
+#define TABLE_BLOB_VERSION 1
+
+/*
+ * Dense lookup tables of one GPU, indexed [threads][registers][shared mem].
+ * Each entry is computed for the largest shape in its bucket by filling an
+ * empty SM through canFitBlock() and reading calculate_occupancy_of_SM(),
+ * so a lookup never promises more than the simulator would place.
+ */
+typedef struct OCCUPANCY_TABLES {
+  unsigned int shared_bucket;                                    // bytes
+  unsigned char max_blocks[TABLE_BUCKETS][TABLE_BUCKETS][TABLE_BUCKETS];
+  unsigned short occupancy_bp[TABLE_BUCKETS][TABLE_BUCKETS][TABLE_BUCKETS];  // 1/10000
+} OccupancyTables_t;
+
+void compute_occupancy_tables(Gpu_t* gpu, OccupancyTables_t* tables);
+
+/*
+ * Writes results/<gpu>_occupancy.h, a self-contained C header with the
+ * tables and an inline lookup, and results/<gpu>_occupancy.bin, the same
+ * tables as a little-endian blob. Returns 0 on success.
+ */
+int export_occupancy_tables(Gpu_t* gpu);
+
+#endif // OCCUPANCY_TABLES_H
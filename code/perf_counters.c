@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+  #include <stdint.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <linux/perf_event.h>
+#endif
+
+static const char* const phase_names[] = { "load_config", "placement", "reporting", "export" };
+
+static const char* const event_names[] = { "cycles", "instructions", "cache misses", "branch misses" };
+
+static double wall_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+
+static const unsigned long long event_configs[] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// The leader (group_fd -1) starts disabled and enables the whole group
+static int open_event(unsigned long long config, int group_fd) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group_fd < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                     PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void open_group(PerfCounters_t* perf) {
+  for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+    perf->fds[e] = open_event(event_configs[e], perf->group_fd);
+    if (perf->fds[e] < 0) {
+      if (perf->group_fd < 0) {
+        fprintf(stderr, "Hardware counters unavailable (%s: %s), reporting wall time only\n",
+                event_names[e], strerror(errno));
+        return;
+      }
+      fprintf(stderr, "Hardware counter for %s unavailable: %s\n", event_names[e], strerror(errno));
+      continue;
+    }
+
+    uint64_t id;
+    ioctl(perf->fds[e], PERF_EVENT_IOC_ID, &id);
+    perf->event_ids[e] = id;
+    if (perf->group_fd < 0) perf->group_fd = perf->fds[e];
+  }
+
+  ioctl(perf->group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static void read_counters(const PerfCounters_t* perf, PerfSample_t* sample) {
+  // nr, time enabled, time running, then a value and an id per event
+  uint64_t data[3 + 2 * PERF_EVENT_COUNT];
+  if (perf->group_fd < 0 || read(perf->group_fd, data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t))) {
+    return;
+  }
+
+  // Counters the kernel had to share with other users ran part of the time
+  double scale = data[2] ? (double)data[1] / data[2] : 1.0;
+  for (uint64_t i = 0; i < data[0] && i < PERF_EVENT_COUNT; i++) {
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+      if (perf->fds[e] >= 0 && perf->event_ids[e] == data[4 + 2 * i]) {
+        sample->values[e] = (unsigned long long)(data[3 + 2 * i] * scale);
+      }
+    }
+  }
+}
+
+#else
+
+static void open_group(PerfCounters_t* perf) {
+  (void)perf;
+  fprintf(stderr, "Hardware counters need Linux perf_event_open(), reporting wall time only\n");
+}
+
+static void read_counters(const PerfCounters_t* perf, PerfSample_t* sample) {
+  (void)perf;
+  (void)sample;
+}
+
+#endif // __linux__
+
+void open_perf_counters(PerfCounters_t* perf) {
+  memset(perf, 0, sizeof(*perf));
+  perf->enabled = true;
+  perf->group_fd = -1;
+  for (int e = 0; e < PERF_EVENT_COUNT; e++) perf->fds[e] = -1;
+  open_group(perf);
+}
+
+void close_perf_counters(PerfCounters_t* perf) {
+  for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+    if (perf->fds[e] >= 0) close(perf->fds[e]);
+    perf->fds[e] = -1;
+  }
+  perf->group_fd = -1;
+}
+
+void perf_phase_begin(PerfCounters_t* perf, StatPhase_t phase) {
+  if (!perf->enabled) return;
+  PerfSample_t* begin = &perf->begin[phase];
+  read_counters(perf, begin);
+  begin->wall_seconds = wall_now();
+}
+
+void perf_phase_end(PerfCounters_t* perf, StatPhase_t phase) {
+  if (!perf->enabled) return;
+  PerfSample_t now = {0};
+  now.wall_seconds = wall_now();
+  read_counters(perf, &now);
+
+  PerfSample_t* total = &perf->total[phase];
+  const PerfSample_t* begin = &perf->begin[phase];
+  total->wall_seconds += now.wall_seconds - begin->wall_seconds;
+  for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+    if (now.values[e] > begin->values[e]) total->values[e] += now.values[e] - begin->values[e];
+  }
+  perf->calls[phase]++;
+}
+
+static void print_count(FILE* out, const PerfCounters_t* perf, PerfEvent_t event, unsigned long long value) {
+  if (perf->fds[event] < 0) fprintf(out, " %14s", "n/a");
+  else fprintf(out, " %14llu", value);
+}
+
+void print_perf_summary(const PerfCounters_t* perf, FILE* out) {
+  fprintf(out, "\n============================================================\n");
+  fprintf(out, " HARDWARE COUNTERS PER PHASE\n");
+  fprintf(out, "============================================================\n");
+  fprintf(out, "%-12s %10s %14s %14s %6s %14s %14s\n",
+          "Phase", "Wall ms", "Cycles", "Instructions", "IPC", "Cache misses", "Branch misses");
+
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    const PerfSample_t* total = &perf->total[p];
+    if (!perf->calls[p]) continue;
+
+    fprintf(out, "%-12s %10.3f", phase_names[p], total->wall_seconds * 1e3);
+    print_count(out, perf, PERF_CYCLES, total->values[PERF_CYCLES]);
+    print_count(out, perf, PERF_INSTRUCTIONS, total->values[PERF_INSTRUCTIONS]);
+    if (perf->fds[PERF_CYCLES] >= 0 && perf->fds[PERF_INSTRUCTIONS] >= 0 && total->values[PERF_CYCLES]) {
+      fprintf(out, " %6.2f", (double)total->values[PERF_INSTRUCTIONS] / total->values[PERF_CYCLES]);
+    } else {
+      fprintf(out, " %6s", "n/a");
+    }
+    print_count(out, perf, PERF_CACHE_MISSES, total->values[PERF_CACHE_MISSES]);
+    print_count(out, perf, PERF_BRANCH_MISSES, total->values[PERF_BRANCH_MISSES]);
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "stats.h"
+
+// ================= Type Declaration ==================
+
+typedef enum PERF_EVENT {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_EVENT_COUNT
+} PerfEvent_t;
+
+// Counter values at one instant, scaled up when the kernel multiplexed them
+typedef struct PERF_SAMPLE {
+  double wall_seconds;
+  unsigned long long values[PERF_EVENT_COUNT];
+} PerfSample_t;
+
+/*
+ * Hardware counters of the calling thread, read around each phase of a
+ * run (--perf). The events are opened as one perf_event_open() group, so
+ * they count over the same instructions; an event the CPU or the
+ * container does not offer is left out and shown as n/a. When none can be
+ * opened only wall time is kept, after one line saying why.
+ *
+ * Phases do not nest: perf_phase_end() adds what happened since the
+ * matching perf_phase_begin().
+ */
+typedef struct PERF_COUNTERS {
+  bool enabled;                 // --perf was given
+  int group_fd;                 // -1 without hardware counters
+  int fds[PERF_EVENT_COUNT];    // -1 for events that could not be opened
+  unsigned long long event_ids[PERF_EVENT_COUNT];
+  PerfSample_t begin[PHASE_COUNT];
+  PerfSample_t total[PHASE_COUNT];
+  unsigned long long calls[PHASE_COUNT];
+} PerfCounters_t;
+
+// ================= Function Declarations ==================
+
+// Opens the counters; without them the run still gets per-phase wall time
+void open_perf_counters(PerfCounters_t* perf);
+
+void close_perf_counters(PerfCounters_t* perf);
+
+// Both do nothing unless the counters were opened with --perf
+void perf_phase_begin(PerfCounters_t* perf, StatPhase_t phase);
+void perf_phase_end(PerfCounters_t* perf, StatPhase_t phase);
+
+// Per-phase table of wall time, cycles, instructions, IPC and misses
+void print_perf_summary(const PerfCounters_t* perf, FILE* out);
+
+#endif // PERF_COUNTERS_H
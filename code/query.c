@@ -0,0 +1,487 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include "query.h"
+#include "metrics.h"
+
+// Name given to the blocks of placement queries
+static char query_kernel_name[] = "query";
+
+int new_query_engine(QueryEngine_t* engine, const Gpu_t* gpus, int gpu_count) {
+  engine->gpu_count = gpu_count;
+  engine->gpus = gpus;
+  engine->tables = malloc(sizeof(OccupancyTable_t) * (gpu_count ? gpu_count : 1));
+  if (!engine->tables) {
+    perror("Failed to allocate query engine");
+    return -1;
+  }
+
+  for (int g = 0; g < gpu_count; g++) {
+    engine->tables[g] = new_occupancy_table(&gpus[g]);
+  }
+  return 0;
+}
+
+void free_query_engine(QueryEngine_t* engine) {
+  free(engine->tables);
+  engine->tables = NULL;
+  engine->gpu_count = 0;
+}
+
+int new_query_scratch(QueryScratch_t* scratch, const QueryEngine_t* engine) {
+  scratch->engine = engine;
+  scratch->gpus = calloc(engine->gpu_count ? engine->gpu_count : 1, sizeof(Gpu_t));
+  if (!scratch->gpus) {
+    perror("Failed to allocate query scratch");
+    return -1;
+  }
+  return 0;
+}
+
+void free_query_scratch(QueryScratch_t* scratch) {
+  for (int g = 0; g < scratch->engine->gpu_count; g++) {
+    free_GPU(&scratch->gpus[g]);
+  }
+  free(scratch->gpus);
+  scratch->gpus = NULL;
+}
+
+// ================= Query parsing ==================
+
+static const char* skip_space(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+  return p;
+}
+
+// p is on the opening quote; escapes are kept as they are
+static const char* parse_string(const char* p, const char* end, const char** start, size_t* length) {
+  *start = ++p;
+  while (p < end && *p != '"') {
+    if (*p == '\\') p++;
+    p++;
+  }
+  if (p >= end) return NULL;
+  *length = p - *start;
+  return p + 1;
+}
+
+// Keeps the integer part of any JSON number, saturating on overflow
+static const char* parse_number(const char* p, const char* end, long long* out) {
+  bool negative = p < end && *p == '-';
+  if (negative) p++;
+  if (p >= end || *p < '0' || *p > '9') return NULL;
+
+  long long value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    value = value < (LLONG_MAX - 9) / 10 ? value * 10 + (*p - '0') : LLONG_MAX;
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++);
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) p++;
+    for (; p < end && *p >= '0' && *p <= '9'; p++);
+  }
+
+  *out = negative ? -value : value;
+  return p;
+}
+
+static bool key_is(const char* key, size_t length, const char* name) {
+  return strlen(name) == length && !memcmp(key, name, length);
+}
+
+static int set_field(Query_t* query, const char* key, size_t key_length, long long value,
+                     bool* has_blocks, const char** error) {
+  unsigned int* field = NULL;
+  if (key_is(key, key_length, "id")) {
+    query->has_id = true;
+    query->id = value;
+    return 0;
+  } else if (key_is(key, key_length, "threads") || key_is(key, key_length, "threads_per_block")) {
+    field = &query->threads;
+  } else if (key_is(key, key_length, "registers") || key_is(key, key_length, "registers_per_thread")) {
+    field = &query->registers;
+  } else if (key_is(key, key_length, "shared_mem") ||
+             key_is(key, key_length, "shared_mem_used_in_bytes_per_block")) {
+    field = &query->shared_mem;
+  } else if (key_is(key, key_length, "blocks") || key_is(key, key_length, "number_of_blocks")) {
+    field = &query->blocks;
+    *has_blocks = true;
+  } else {
+    return 0;
+  }
+
+  if (value < 0) {
+    *error = "negative value";
+    return -1;
+  }
+  *field = value > UINT_MAX ? UINT_MAX : (unsigned int)value;
+  return 0;
+}
+
+static int set_string(Query_t* query, const char* key, size_t key_length,
+                      const char* value, size_t value_length, bool* has_op, const char** error) {
+  if (key_is(key, key_length, "gpu")) {
+    query->gpu = value;
+    query->gpu_length = value_length;
+  } else if (key_is(key, key_length, "op")) {
+    *has_op = true;
+    if (key_is(value, value_length, "occupancy")) {
+      query->op = QUERY_OCCUPANCY;
+    } else if (key_is(value, value_length, "best_block_size")) {
+      query->op = QUERY_BEST_BLOCK_SIZE;
+    } else if (key_is(value, value_length, "placement")) {
+      query->op = QUERY_PLACEMENT;
+    } else if (key_is(value, value_length, "gpu")) {
+      query->op = QUERY_GPU;
+    } else {
+      *error = "unknown op";
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int parse_query(const char* line, size_t length, Query_t* query, const char** error) {
+  const char* p = line;
+  const char* end = line + length;
+  bool has_op = false, has_blocks = false;
+  memset(query, 0, sizeof(*query));
+
+  p = skip_space(p, end);
+  if (p >= end || *p != '{') {
+    *error = "expected a JSON object";
+    return -1;
+  }
+  p = skip_space(p + 1, end);
+  if (p < end && *p == '}') p++;
+  else for (;;) {
+    const char *key, *value;
+    size_t key_length, value_length;
+    long long number;
+
+    if (p >= end || *p != '"' || !(p = parse_string(p, end, &key, &key_length))) {
+      *error = "expected a key";
+      return -1;
+    }
+    p = skip_space(p, end);
+    if (p >= end || *p != ':') {
+      *error = "expected ':'";
+      return -1;
+    }
+    p = skip_space(p + 1, end);
+
+    if (p < end && *p == '"') {
+      if (!(p = parse_string(p, end, &value, &value_length))) {
+        *error = "unterminated string";
+        return -1;
+      }
+      if (set_string(query, key, key_length, value, value_length, &has_op, error) != 0) return -1;
+    } else if (p < end && (*p == '-' || (*p >= '0' && *p <= '9'))) {
+      if (!(p = parse_number(p, end, &number))) {
+        *error = "bad number";
+        return -1;
+      }
+      if (set_field(query, key, key_length, number, &has_blocks, error) != 0) return -1;
+    } else if (p < end && (*p == 't' || *p == 'f' || *p == 'n')) {
+      while (p < end && *p >= 'a' && *p <= 'z') p++;
+    } else {
+      *error = "unsupported value";
+      return -1;
+    }
+
+    p = skip_space(p, end);
+    if (p < end && *p == ',') {
+      p = skip_space(p + 1, end);
+      continue;
+    }
+    if (p < end && *p == '}') {
+      p++;
+      break;
+    }
+    *error = "expected ',' or '}'";
+    return -1;
+  }
+
+  if (skip_space(p, end) != end) {
+    *error = "trailing characters";
+    return -1;
+  }
+
+  if (!has_op) query->op = has_blocks ? QUERY_PLACEMENT : QUERY_OCCUPANCY;
+  bool needs_shape = query->op == QUERY_OCCUPANCY || query->op == QUERY_PLACEMENT;
+  if (needs_shape && query->threads == 0) {
+    *error = "threads must be positive";
+    return -1;
+  }
+  return 0;
+}
+
+// ================= Answers ==================
+
+static int find_gpu(const QueryEngine_t* engine, const Query_t* query) {
+  if (!query->gpu) return engine->gpu_count ? 0 : -1;
+  for (int g = 0; g < engine->gpu_count; g++) {
+    if (key_is(query->gpu, query->gpu_length, engine->gpus[g].name)) return g;
+  }
+  return -1;
+}
+
+static size_t answer_error(const Query_t* query, const char* error, char* out) {
+  if (query && query->has_id) {
+    return snprintf(out, QUERY_MAX_ANSWER, "{\"id\":%lld,\"error\":\"%s\"}\n", query->id, error);
+  }
+  return snprintf(out, QUERY_MAX_ANSWER, "{\"error\":\"%s\"}\n", error);
+}
+
+// The hot answers are formatted by hand: snprintf() of a float costs more
+// than answering the query
+static char* put_string(char* p, const char* s) {
+  while (*s) *p++ = *s++;
+  return p;
+}
+
+static char* put_uint(char* p, unsigned long long value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n) *p++ = digits[--n];
+  return p;
+}
+
+// Four decimals of a value that is not negative, ties rounded to even
+static char* put_fixed4(char* p, double value) {
+  double x = value * 10000.0;
+  unsigned long long scaled = (unsigned long long)x;
+  double rest = x - (double)scaled;
+  scaled += rest > 0.5 || (rest == 0.5 && (scaled & 1));
+  unsigned int fraction = scaled % 10000;
+  p = put_uint(p, scaled / 10000);
+  *p++ = '.';
+  p[0] = '0' + fraction / 1000;
+  p[1] = '0' + fraction / 100 % 10;
+  p[2] = '0' + fraction / 10 % 10;
+  p[3] = '0' + fraction % 10;
+  return p + 4;
+}
+
+static char* begin_answer(const Query_t* query, char* out) {
+  char* p = out;
+  *p++ = '{';
+  if (query->has_id) {
+    p = put_string(p, "\"id\":");
+    if (query->id < 0) *p++ = '-';
+    p = put_uint(p, query->id < 0 ? -(unsigned long long)query->id : (unsigned long long)query->id);
+    *p++ = ',';
+  }
+  return p;
+}
+
+static size_t end_answer(char* p, const char* out) {
+  *p++ = '}';
+  *p++ = '\n';
+  return p - out;
+}
+
+static size_t answer_occupancy(const QueryEngine_t* engine, int g, const Query_t* query, char* out) {
+  float occupancy;
+  unsigned char limit;
+  unsigned short blocks;
+  occupancy_of_shape(&engine->tables[g], query->threads, query->registers, query->shared_mem,
+                     &occupancy, &limit, &blocks);
+
+  char* p = begin_answer(query, out);
+  p = put_fixed4(put_string(p, "\"occupancy\":"), occupancy);
+  p = put_uint(put_string(p, ",\"blocks_per_sm\":"), blocks);
+  p = put_string(put_string(put_string(p, ",\"limit\":\""), limit_name(limit)), "\"");
+  return end_answer(p, out);
+}
+
+// Tries every multiple of a warp up to 1024 threads, like
+// cudaOccupancyMaxPotentialBlockSize() preferring the larger of equal sizes
+static size_t answer_best_block_size(const QueryEngine_t* engine, int g, const Query_t* query, char* out) {
+  enum { MAX_CANDIDATES = 32 };
+  unsigned int threads[MAX_CANDIDATES], regs[MAX_CANDIDATES], shared[MAX_CANDIDATES];
+  float occupancy[MAX_CANDIDATES];
+  unsigned char limit[MAX_CANDIDATES];
+  unsigned short blocks[MAX_CANDIDATES];
+
+  int candidates = engine->gpus[g].maximum_number_of_warps_per_SM;
+  if (candidates > MAX_CANDIDATES) candidates = MAX_CANDIDATES;
+  for (int i = 0; i < candidates; i++) {
+    threads[i] = 32 * (i + 1);
+    regs[i] = query->registers;
+    shared[i] = query->shared_mem;
+  }
+  occupancy_batch(&engine->tables[g], candidates, threads, regs, shared, occupancy, limit, blocks);
+
+  int best = -1;
+  for (int i = candidates - 1; i >= 0; i--) {
+    if (blocks[i] && (best < 0 || occupancy[i] > occupancy[best])) best = i;
+  }
+  if (best < 0) return answer_error(query, "no block size fits on an SM", out);
+
+  char* p = begin_answer(query, out);
+  p = put_uint(put_string(p, "\"threads\":"), threads[best]);
+  p = put_fixed4(put_string(p, ",\"occupancy\":"), occupancy[best]);
+  p = put_uint(put_string(p, ",\"blocks_per_sm\":"), blocks[best]);
+  p = put_string(put_string(put_string(p, ",\"limit\":\""), limit_name(limit[best])), "\"");
+  return end_answer(p, out);
+}
+
+static size_t answer_placement(QueryScratch_t* scratch, int g, const Query_t* query, char* out) {
+  unsigned long long start = metrics_now_ns();
+  Gpu_t* gpu = &scratch->gpus[g];
+  if (!gpu->name) {
+    const Gpu_t* limits = &scratch->engine->gpus[g];
+    if (init_GPU(gpu, limits->name, limits->global_mem_size_in_bytes,
+                 limits->shared_mem_size_in_bytes_per_SM, limits->number_of_registers_per_SM,
+                 limits->maximum_number_of_warps_per_SM, limits->maximum_number_of_blocks_per_SM,
+                 limits->number_of_SMs) != 0) {
+      return answer_error(query, "out of memory", out);
+    }
+  } else {
+    reset_GPU(gpu);
+  }
+
+  Kernel_t kernel = {
+    .name = query_kernel_name,
+    .number_of_blocks = query->blocks,
+    .threads_per_block = query->threads,
+    .shared_mem_used_in_bytes_per_block = query->shared_mem,
+    .registers_per_thread = query->registers,
+  };
+  unsigned int dropped = place_kernel_blocks(gpu, &kernel);
+
+  int sms_used = 0;
+  double occupancy = 0.0;
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    if (gpu->list_of_SMs[i].number_of_blocks == 0) continue;
+    sms_used++;
+    occupancy += calculate_occupancy_of_SM(gpu, i);
+  }
+  if (gpu->number_of_SMs) occupancy /= gpu->number_of_SMs;
+  metrics_observe(&metrics.query_placement, metrics_now_ns() - start);
+
+  char* p = begin_answer(query, out);
+  p = put_uint(put_string(p, "\"placed\":"), query->blocks - dropped);
+  p = put_uint(put_string(p, ",\"dropped\":"), dropped);
+  p = put_uint(put_string(p, ",\"sms_used\":"), sms_used);
+  p = put_fixed4(put_string(p, ",\"occupancy\":"), occupancy);
+  return end_answer(p, out);
+}
+
+static size_t answer_gpu(const QueryEngine_t* engine, int g, const Query_t* query, char* out) {
+  const Gpu_t* gpu = &engine->gpus[g];
+  size_t n = begin_answer(query, out) - out;
+  return n + snprintf(out + n, QUERY_MAX_ANSWER - n,
+                      "\"gpu\":\"%.64s\",\"sms\":%u,\"shared_mem_per_sm\":%u,\"registers_per_sm\":%u,"
+                      "\"max_warps_per_sm\":%hu,\"max_blocks_per_sm\":%hu}\n",
+                      gpu->name, gpu->number_of_SMs, gpu->shared_mem_size_in_bytes_per_SM,
+                      gpu->number_of_registers_per_SM, gpu->maximum_number_of_warps_per_SM,
+                      gpu->maximum_number_of_blocks_per_SM);
+}
+
+size_t answer_query_line(QueryScratch_t* scratch, const char* line, size_t length, char* out) {
+  Query_t query;
+  const char* error = NULL;
+  if (parse_query(line, length, &query, &error) != 0) {
+    return answer_error(NULL, error, out);
+  }
+
+  int g = find_gpu(scratch->engine, &query);
+  if (g < 0) return answer_error(&query, "unknown gpu", out);
+
+  switch (query.op) {
+    case QUERY_OCCUPANCY:       return answer_occupancy(scratch->engine, g, &query, out);
+    case QUERY_BEST_BLOCK_SIZE: return answer_best_block_size(scratch->engine, g, &query, out);
+    case QUERY_PLACEMENT:       return answer_placement(scratch, g, &query, out);
+    case QUERY_GPU:             return answer_gpu(scratch->engine, g, &query, out);
+  }
+  return answer_error(&query, "unknown op", out);
+}
+
+// ================= Streams ==================
+
+static int write_all(int fd, const char* data, size_t length) {
+  while (length) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+size_t answer_query_batch(QueryScratch_t* scratch, QueryStream_t* stream, bool end_of_input, char* out) {
+  char* in = stream->in;
+  size_t answered = 0, start = 0;
+  unsigned long long queries = 0;
+  bool full = false;
+  for (size_t i = 0; i < stream->used && !full; i++) {
+    if (in[i] != '\n') continue;
+    if (!stream->skipping) {
+      answered += answer_query_line(scratch, in + start, i - start, out + answered);
+      queries++;
+    }
+    stream->skipping = false;
+    start = i + 1;
+    // Leave room for one more answer
+    full = answered > QUERY_STREAM_BUFFER - QUERY_MAX_ANSWER;
+  }
+  memmove(in, in + start, stream->used - start);
+  stream->used -= start;
+
+  // What is left is a partial line, unless out filled up first
+  if (!full && stream->skipping) {
+    stream->used = 0;
+  } else if (!full && stream->used > QUERY_MAX_LINE) {
+    static const char too_long[] = "{\"error\":\"line too long\"}\n";
+    memcpy(out + answered, too_long, sizeof(too_long) - 1);
+    answered += sizeof(too_long) - 1;
+    stream->skipping = true;
+    stream->used = 0;
+  } else if (!full && end_of_input && stream->used) {
+    answered += answer_query_line(scratch, in, stream->used, out + answered);
+    queries++;
+    stream->used = 0;
+  }
+
+  // One shared add per batch, not per query
+  if (queries) metrics_add(&metrics.queries, queries);
+  return answered;
+}
+
+bool query_stream_ready(const QueryStream_t* stream, bool end_of_input) {
+  if (!stream->used) return false;
+  return end_of_input || stream->skipping || stream->used > QUERY_MAX_LINE ||
+         memchr(stream->in, '\n', stream->used);
+}
+
+int serve_query_stream(QueryScratch_t* scratch, int in_fd, int out_fd, char* in, char* out) {
+  QueryStream_t stream = { .in = in };
+
+  for (;;) {
+    ssize_t got = read(in_fd, in + stream.used, QUERY_STREAM_BUFFER - stream.used);
+    if (got < 0 && errno == EINTR) continue;
+    if (got < 0) return -1;
+    stream.used += got;
+
+    do {
+      size_t answered = answer_query_batch(scratch, &stream, got == 0, out);
+      if (answered && write_all(out_fd, out, answered) != 0) return -1;
+    } while (query_stream_ready(&stream, got == 0));
+    if (got == 0) return 0;
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "cuda_arch.h"
+#include "occupancy.h"
+
+// Longest accepted query line and longest answer, both including '\n'
+#define QUERY_MAX_LINE 1024
+#define QUERY_MAX_ANSWER 256
+
+// Bytes read from a stream at once, and most bytes of answers written at once
+#define QUERY_STREAM_BUFFER (64 * 1024)
+
+// ================= Type Declaration ==================
+
+typedef enum QUERY_OP {
+  QUERY_OCCUPANCY,        // blocks of one shape an empty SM holds, and its occupancy
+  QUERY_BEST_BLOCK_SIZE,  // threads per block with the highest occupancy
+  QUERY_PLACEMENT,        // where the blocks of one kernel land on an empty GPU
+  QUERY_GPU               // limits of one GPU
+} QueryOp_t;
+
+/*
+ * One query line, a flat JSON object such as
+ *   {"id":7,"op":"occupancy","gpu":"GPU_mid_resources","threads":256,"registers":32,"shared_mem":4096}
+ * The kernel fields of config.json are accepted as well, so a kernel entry
+ * can be sent as is. Without "op", a query with "blocks" is a placement and
+ * any other an occupancy query; without "gpu", the first GPU is used.
+ */
+typedef struct QUERY {
+  QueryOp_t op;
+  const char* gpu;          // points into the line, not terminated
+  size_t gpu_length;
+  bool has_id;
+  long long id;
+
+  unsigned int threads;
+  unsigned int registers;
+  unsigned int shared_mem;
+  unsigned int blocks;
+} Query_t;
+
+// Read-only state shared by every thread answering queries
+typedef struct QUERY_ENGINE {
+  int gpu_count;
+  const Gpu_t* gpus;           // only the limits and names are used
+  OccupancyTable_t* tables;
+} QueryEngine_t;
+
+// Per-thread state; placement GPUs are built on first use and then reused
+typedef struct QUERY_SCRATCH {
+  const QueryEngine_t* engine;
+  Gpu_t* gpus;
+} QueryScratch_t;
+
+// Input of one query stream: lines read but not answered yet
+typedef struct QUERY_STREAM {
+  char* in;                 // QUERY_STREAM_BUFFER bytes
+  size_t used;
+  bool skipping;            // inside a line too long to answer
+} QueryStream_t;
+
+// ================= Function Declarations ==================
+
+int new_query_engine(QueryEngine_t* engine, const Gpu_t* gpus, int gpu_count);
+
+void free_query_engine(QueryEngine_t* engine);
+
+int new_query_scratch(QueryScratch_t* scratch, const QueryEngine_t* engine);
+
+void free_query_scratch(QueryScratch_t* scratch);
+
+// Returns 0, or -1 with *error set to a static message
+int parse_query(const char* line, size_t length, Query_t* query, const char** error);
+
+/*
+ * Answers one query line (without its '\n') into out, which must hold
+ * QUERY_MAX_ANSWER bytes, as one JSON line ending in '\n'. Failures are
+ * answered with {"error":...}. Returns the length written. Does not
+ * allocate once the placement GPU of the query exists.
+ */
+size_t answer_query_line(QueryScratch_t* scratch, const char* line, size_t length, char* out);
+
+/*
+ * Answers the complete lines of stream into out, QUERY_STREAM_BUFFER
+ * bytes, and returns the length written. Stops early when out is full,
+ * leaving the rest for another call. Once every complete line is
+ * answered, a partial line longer than QUERY_MAX_LINE is answered with
+ * an error and skipped, and at end of input a last line without its
+ * newline is answered too.
+ */
+size_t answer_query_batch(QueryScratch_t* scratch, QueryStream_t* stream, bool end_of_input, char* out);
+
+// True while answer_query_batch() has something to answer or skip
+bool query_stream_ready(const QueryStream_t* stream, bool end_of_input);
+
+/*
+ * Answers query lines read from in_fd on out_fd until end of input. All
+ * complete lines of a read are answered into one buffer that is written
+ * at once, so answers are flushed in batches. in and out are caller-owned
+ * buffers of QUERY_STREAM_BUFFER bytes. Returns 0 at end of input, or -1
+ * when reading or writing fails.
+ */
+int serve_query_stream(QueryScratch_t* scratch, int in_fd, int out_fd, char* in, char* out);
+
+#endif // QUERY_H
@@ -0,0 +1,155 @@
+/*
+ * Minimal client of the GPU_sim query server:
+ *   gpusim_client [-s SOCKET] [QUERY...]
+ * Sends each QUERY argument, or else every line of stdin, and prints one
+ * answer line per query. Queries are pipelined: stdin keeps flowing to the
+ * server while answers are copied to stdout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+static int write_all(int fd, const char* data, size_t length) {
+  while (length) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+static int connect_to(const char* path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Error: socket path %s is too long\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "Error: could not connect to %s: %s\n", path, strerror(errno));
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * Sends queries, first data and then every read of in_fd unless it is
+ * -1, while copying answers to stdout until the server closes. The
+ * socket does not block: only what it accepts is sent, and answers are
+ * read in between, so neither side waits on a full socket buffer.
+ */
+static int exchange(int fd, const char* data, size_t length, int in_fd) {
+  static char in[64 * 1024];
+  static char answers[64 * 1024];
+  const char* pending = data;
+  size_t left = length;
+  bool sending = true;
+  if (fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+    perror("fcntl");
+    return 1;
+  }
+
+  for (;;) {
+    // All queries sent; the server closes once it has answered them
+    if (sending && !left && in_fd < 0) {
+      shutdown(fd, SHUT_WR);
+      sending = false;
+    }
+
+    struct pollfd fds[2] = {
+      { .fd = sending && !left ? in_fd : -1, .events = POLLIN },
+      { .fd = fd, .events = POLLIN | (left ? POLLOUT : 0) },
+    };
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      return 1;
+    }
+
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t got = read(fd, answers, sizeof(answers));
+      if (got == 0) return 0;
+      if (got < 0 && errno != EINTR && errno != EAGAIN) {
+        perror("Failed to read answers");
+        return 1;
+      }
+      if (got > 0 && write_all(STDOUT_FILENO, answers, got) != 0) return 1;
+    }
+
+    if (left && (fds[1].revents & POLLOUT)) {
+      ssize_t sent = send(fd, pending, left, MSG_NOSIGNAL);
+      if (sent < 0 && errno != EINTR && errno != EAGAIN) {
+        perror("Failed to send queries");
+        return 1;
+      }
+      if (sent > 0) {
+        pending += sent;
+        left -= sent;
+      }
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t got = read(in_fd, in, sizeof(in));
+      if (got > 0) {
+        pending = in;
+        left = got;
+      } else if (got == 0 || errno != EINTR) {
+        in_fd = -1;
+      }
+    }
+  }
+}
+
+static int send_arguments(int fd, int count, char** queries) {
+  size_t length = 0;
+  for (int i = 0; i < count; i++) {
+    length += strlen(queries[i]) + 1;
+  }
+  char* data = malloc(length ? length : 1);
+  if (!data) {
+    perror("Memory allocation failed");
+    return 1;
+  }
+  char* p = data;
+  for (int i = 0; i < count; i++) {
+    size_t n = strlen(queries[i]);
+    memcpy(p, queries[i], n);
+    p[n] = '\n';
+    p += n + 1;
+  }
+  int status = exchange(fd, data, length, -1);
+  free(data);
+  return status;
+}
+
+int main(int argc, char** argv) {
+  const char* path = QUERY_SOCKET_FILE;
+  int first = 1;
+  if (argc > 2 && !strcmp(argv[1], "-s")) {
+    path = argv[2];
+    first = 3;
+  }
+
+  int fd = connect_to(path);
+  if (fd < 0) return 1;
+
+  int status = first < argc ? send_arguments(fd, argc - first, argv + first)
+                                : exchange(fd, NULL, 0, STDIN_FILENO);
+  close(fd);
+  return status;
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <string.h>
+#include "records.h"
+#include "occupancy.h"
+
+// Decimals of every occupancy in the records
+#define RECORD_DECIMALS 4
+
+int open_result_records(ResultRecords_t* records, bool json, bool csv) {
+  memset(records, 0, sizeof(*records));
+  if (ensure_results_dir() != 0) return -1;
+
+  if (json) {
+    if (open_writer(&records->json_out, RECORDS_JSON_FILE) != 0) return -1;
+    records->json = true;
+    json_begin_object(&records->json_out);
+    json_key(&records->json_out, "gpus");
+    json_begin_array(&records->json_out);
+  }
+
+  if (csv) {
+    if (open_writer(&records->gpu_csv, RECORDS_GPU_CSV_FILE) != 0) {
+      close_result_records(records);
+      return -1;
+    }
+    if (open_writer(&records->sm_csv, RECORDS_SM_CSV_FILE) != 0) {
+      close_writer(&records->gpu_csv);
+      close_result_records(records);
+      return -1;
+    }
+    if (open_writer(&records->kernel_csv, RECORDS_KERNEL_CSV_FILE) != 0) {
+      close_writer(&records->gpu_csv);
+      close_writer(&records->sm_csv);
+      close_result_records(records);
+      return -1;
+    }
+    records->csv = true;
+    write_text(&records->gpu_csv,
+      "name,memory_bytes,num_sms,shared_mem_per_sm,registers_per_sm,max_warps_per_sm,"
+      "max_blocks_per_sm,blocks_placed,sms_used,average_occupancy\n");
+    write_text(&records->sm_csv,
+      "gpu,sm,blocks,warps_used,registers_used,shared_mem_used,occupancy\n");
+    write_text(&records->kernel_csv,
+      "gpu,name,stream_id,number_of_blocks,threads_per_block,shared_mem_used_in_bytes_per_block,"
+      "registers_per_thread,placed,dropped,theoretical_occupancy,blocks_per_sm,limit\n");
+  }
+  return 0;
+}
+
+int close_result_records(ResultRecords_t* records) {
+  int status = 0;
+  if (records->json) {
+    json_end_array(&records->json_out);
+    json_end_object(&records->json_out);
+    write_text(&records->json_out, "\n");
+    if (close_writer(&records->json_out) != 0) status = -1;
+  }
+  if (records->csv) {
+    if (close_writer(&records->gpu_csv) != 0) status = -1;
+    if (close_writer(&records->sm_csv) != 0) status = -1;
+    if (close_writer(&records->kernel_csv) != 0) status = -1;
+  }
+  records->json = records->csv = false;
+  return status;
+}
+
+// What one SM has in use, from its free resources
+typedef struct SM_USAGE {
+  unsigned int blocks;
+  unsigned int warps;
+  unsigned int registers;
+  unsigned int shared_mem;
+  double occupancy;
+} SMUsage_t;
+
+static SMUsage_t usage_of_SM(Gpu_t* gpu, int i) {
+  const SMResources_t* res = &gpu->free_resources;
+  SMUsage_t usage = {
+    .blocks = gpu->list_of_SMs[i].number_of_blocks,
+    .warps = gpu->maximum_number_of_warps_per_SM - res->free_warps[i],
+    .registers = gpu->number_of_registers_per_SM - res->free_registers[i],
+    .shared_mem = gpu->shared_mem_size_in_bytes_per_SM - res->free_shared_mem[i],
+    .occupancy = calculate_occupancy_of_SM(gpu, i),
+  };
+  return usage;
+}
+
+static void write_SM_records(ResultRecords_t* records, Gpu_t* gpu, int i, const SMUsage_t* usage) {
+  if (records->json) {
+    Writer_t* w = &records->json_out;
+    json_begin_object(w);
+    json_key(w, "sm");              json_uint(w, i);
+    json_key(w, "blocks");          json_uint(w, usage->blocks);
+    json_key(w, "warps_used");      json_uint(w, usage->warps);
+    json_key(w, "registers_used");  json_uint(w, usage->registers);
+    json_key(w, "shared_mem_used"); json_uint(w, usage->shared_mem);
+    json_key(w, "occupancy");       json_fixed(w, usage->occupancy, RECORD_DECIMALS);
+    json_end_object(w);
+  }
+  if (records->csv) {
+    Writer_t* w = &records->sm_csv;
+    csv_string(w, gpu->name, true);
+    csv_uint(w, i, false);
+    csv_uint(w, usage->blocks, false);
+    csv_uint(w, usage->warps, false);
+    csv_uint(w, usage->registers, false);
+    csv_uint(w, usage->shared_mem, false);
+    csv_fixed(w, usage->occupancy, RECORD_DECIMALS, false);
+    csv_end_row(w);
+  }
+}
+
+static void write_kernel_records(ResultRecords_t* records, Gpu_t* gpu, const OccupancyTable_t* table,
+                                 const Kernel_t* kernel, unsigned int dropped) {
+  float occupancy;
+  unsigned char limit;
+  unsigned short blocks_per_SM;
+  occupancy_of_shape(table, kernel->threads_per_block, kernel->registers_per_thread,
+                     kernel->shared_mem_used_in_bytes_per_block, &occupancy, &limit, &blocks_per_SM);
+
+  if (records->json) {
+    Writer_t* w = &records->json_out;
+    json_begin_object(w);
+    json_key(w, "name");                               json_string(w, kernel->name);
+    json_key(w, "stream_id");                          json_uint(w, kernel->stream_id);
+    json_key(w, "number_of_blocks");                   json_uint(w, kernel->number_of_blocks);
+    json_key(w, "threads_per_block");                  json_uint(w, kernel->threads_per_block);
+    json_key(w, "shared_mem_used_in_bytes_per_block"); json_uint(w, kernel->shared_mem_used_in_bytes_per_block);
+    json_key(w, "registers_per_thread");               json_uint(w, kernel->registers_per_thread);
+    json_key(w, "placed");                             json_uint(w, kernel->number_of_blocks - dropped);
+    json_key(w, "dropped");                            json_uint(w, dropped);
+    json_key(w, "theoretical_occupancy");              json_fixed(w, occupancy, RECORD_DECIMALS);
+    json_key(w, "blocks_per_sm");                      json_uint(w, blocks_per_SM);
+    json_key(w, "limit");                              json_string(w, limit_name(limit));
+    json_end_object(w);
+  }
+  if (records->csv) {
+    Writer_t* w = &records->kernel_csv;
+    csv_string(w, gpu->name, true);
+    csv_string(w, kernel->name, false);
+    csv_uint(w, kernel->stream_id, false);
+    csv_uint(w, kernel->number_of_blocks, false);
+    csv_uint(w, kernel->threads_per_block, false);
+    csv_uint(w, kernel->shared_mem_used_in_bytes_per_block, false);
+    csv_uint(w, kernel->registers_per_thread, false);
+    csv_uint(w, kernel->number_of_blocks - dropped, false);
+    csv_uint(w, dropped, false);
+    csv_fixed(w, occupancy, RECORD_DECIMALS, false);
+    csv_uint(w, blocks_per_SM, false);
+    csv_string(w, limit_name(limit), false);
+    csv_end_row(w);
+  }
+}
+
+void write_GPU_records(
+  ResultRecords_t* records,
+  Gpu_t* gpu,
+  Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+) {
+  if (!records->json && !records->csv) return;
+  Writer_t* w = &records->json_out;
+
+  if (records->json) {
+    json_begin_object(w);
+    json_key(w, "name");              json_string(w, gpu->name);
+    json_key(w, "memory_bytes");      json_uint(w, gpu->global_mem_size_in_bytes);
+    json_key(w, "num_sms");           json_uint(w, gpu->number_of_SMs);
+    json_key(w, "shared_mem_per_sm"); json_uint(w, gpu->shared_mem_size_in_bytes_per_SM);
+    json_key(w, "registers_per_sm");  json_uint(w, gpu->number_of_registers_per_SM);
+    json_key(w, "max_warps_per_sm");  json_uint(w, gpu->maximum_number_of_warps_per_SM);
+    json_key(w, "max_blocks_per_sm"); json_uint(w, gpu->maximum_number_of_blocks_per_SM);
+    json_key(w, "sms");
+    json_begin_array(w);
+  }
+
+  // The GPU totals are only known after the SMs, so in JSON they follow them
+  unsigned long long blocks_placed = 0;
+  unsigned int sms_used = 0;
+  double occupancy = 0.0;
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    SMUsage_t usage = usage_of_SM(gpu, i);
+    blocks_placed += usage.blocks;
+    sms_used += usage.blocks != 0;
+    occupancy += usage.occupancy;
+    write_SM_records(records, gpu, i, &usage);
+  }
+  if (gpu->number_of_SMs) occupancy /= gpu->number_of_SMs;
+
+  if (records->json) {
+    json_end_array(w);
+    json_key(w, "blocks_placed");     json_uint(w, blocks_placed);
+    json_key(w, "sms_used");          json_uint(w, sms_used);
+    json_key(w, "average_occupancy"); json_fixed(w, occupancy, RECORD_DECIMALS);
+    json_key(w, "kernels");
+    json_begin_array(w);
+  }
+
+  OccupancyTable_t table = new_occupancy_table(gpu);
+  for (int k = 0; k < kernel_count; k++) {
+    write_kernel_records(records, gpu, &table, &kernels[k], dropped ? dropped[k] : 0);
+  }
+
+  if (records->json) {
+    json_end_array(w);
+    json_end_object(w);
+  }
+
+  if (records->csv) {
+    Writer_t* c = &records->gpu_csv;
+    csv_string(c, gpu->name, true);
+    csv_uint(c, gpu->global_mem_size_in_bytes, false);
+    csv_uint(c, gpu->number_of_SMs, false);
+    csv_uint(c, gpu->shared_mem_size_in_bytes_per_SM, false);
+    csv_uint(c, gpu->number_of_registers_per_SM, false);
+    csv_uint(c, gpu->maximum_number_of_warps_per_SM, false);
+    csv_uint(c, gpu->maximum_number_of_blocks_per_SM, false);
+    csv_uint(c, blocks_placed, false);
+    csv_uint(c, sms_used, false);
+    csv_fixed(c, occupancy, RECORD_DECIMALS, false);
+    csv_end_row(c);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <stdbool.h>
+#include "cuda_arch.h"
+#include "writer.h"
+
+#define RECORDS_JSON_FILE "results/results.json"
+#define RECORDS_GPU_CSV_FILE "results/gpus.csv"
+#define RECORDS_SM_CSV_FILE "results/sms.csv"
+#define RECORDS_KERNEL_CSV_FILE "results/kernels.csv"
+
+/*
+ * Machine-readable results of a run, one record per GPU, per SM and per
+ * kernel on each GPU, written as each GPU finishes:
+ *   results.json   {"gpus":[{GPU fields, "sms":[...], "kernels":[...]}, ...]}
+ *   gpus.csv, sms.csv, kernels.csv   the same records as flat tables
+ * Field names follow config.json where one exists.
+ */
+typedef struct RESULT_RECORDS {
+  bool json;
+  bool csv;
+  Writer_t json_out;
+  Writer_t gpu_csv;
+  Writer_t sm_csv;
+  Writer_t kernel_csv;
+} ResultRecords_t;
+
+int open_result_records(ResultRecords_t* records, bool json, bool csv);
+
+// dropped[k] is the number of blocks of kernels[k] that did not fit
+void write_GPU_records(
+  ResultRecords_t* records,
+  Gpu_t* gpu,
+  Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+);
+
+// Returns -1 when any file could not be written
+int close_result_records(ResultRecords_t* records);
+
+#endif // RECORDS_H
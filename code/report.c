@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "report.h"
+#include "writer.h"
+
+// Mark the <html> tag of compact reports, so the mode can be told on disk
+#define COMPACT_HTML_TAG "<html lang='en' class='compact'>"
+#define COMPACT_DETAILS_HTML_TAG "<html lang='en' class='compact details'>"
+
+int parse_html_mode(const char* name, HtmlMode_t* mode) {
+  if (!strcmp(name, "full")) {
+    *mode = HTML_FULL;
+  } else if (!strcmp(name, "compact")) {
+    *mode = HTML_COMPACT;
+  } else if (!strcmp(name, "compact,details")) {
+    *mode = HTML_COMPACT_DETAILS;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+void export_GPU_report(Gpu_t* gpu, HtmlMode_t mode) {
+  if (mode == HTML_COMPACT || mode == HTML_COMPACT_DETAILS) {
+    export_GPU_to_compact_HTML(gpu, mode == HTML_COMPACT_DETAILS);
+  } else {
+    export_GPU_to_HTML(gpu);
+  }
+}
+
+bool report_exists(Gpu_t* gpu, HtmlMode_t mode) {
+  char filepath[512];
+  results_path_of_GPU(gpu, ".html", filepath, sizeof(filepath));
+  FILE* f = fopen(filepath, "r");
+  if (!f) return false;
+
+  char head[128];
+  size_t length = fread(head, 1, sizeof(head) - 1, f);
+  fclose(f);
+  head[length] = '\0';
+  HtmlMode_t on_disk = strstr(head, COMPACT_HTML_TAG) ? HTML_COMPACT
+    : strstr(head, COMPACT_DETAILS_HTML_TAG) ? HTML_COMPACT_DETAILS
+    : HTML_FULL;
+  return on_disk == mode;
+}
+
+// Text escaped for use in HTML content and quoted attributes
+static void html_text(Writer_t* w, const char* text) {
+  const char* run = text;
+  for (const char* p = text; *p; p++) {
+    const char* entity;
+    switch (*p) {
+      case '&':  entity = "&amp;";  break;
+      case '<':  entity = "&lt;";   break;
+      case '>':  entity = "&gt;";   break;
+      case '\'': entity = "&#39;";  break;
+      case '"':  entity = "&quot;"; break;
+      default: continue;
+    }
+    write_bytes(w, run, p - run);
+    write_text(w, entity);
+    run = p + 1;
+  }
+  write_text(w, run);
+}
+
+// Blocks of one kernel, on one SM or on the whole GPU
+typedef struct KERNEL_SHARE {
+  const char* name;
+  unsigned int blocks;
+  unsigned int warps;
+  unsigned int registers;
+  unsigned int shared_mem;
+} KernelShare_t;
+
+typedef struct KERNEL_SHARES {
+  int count;
+  int capacity;
+  KernelShare_t* kernels;
+  int last;             // kernel of the previous block, usually the next one's too
+} KernelShares_t;
+
+// Position of the kernel of this block, added when first seen; -1 if out of memory
+static int kernel_of_block(KernelShares_t* shares, const Block_t* block) {
+  if (shares->last < shares->count && shares->kernels[shares->last].name == block->kernel_name) {
+    return shares->last;
+  }
+  for (int k = 0; k < shares->count; k++) {
+    if (shares->kernels[k].name == block->kernel_name ||
+        !strcmp(shares->kernels[k].name, block->kernel_name)) {
+      return shares->last = k;
+    }
+  }
+
+  if (shares->count == shares->capacity) {
+    int capacity = shares->capacity ? shares->capacity * 2 : 8;
+    KernelShare_t* kernels = realloc(shares->kernels, capacity * sizeof(KernelShare_t));
+    if (!kernels) return -1;
+    shares->kernels = kernels;
+    shares->capacity = capacity;
+  }
+  shares->kernels[shares->count] = (KernelShare_t){ .name = block->kernel_name };
+  return shares->last = shares->count++;
+}
+
+static void add_block(KernelShare_t* share, const Block_t* block) {
+  share->blocks++;
+  share->warps += (block->number_of_thread + 31) / 32;
+  share->registers += block->number_of_registers_used_per_thread * block->number_of_thread;
+  share->shared_mem += block->shared_mem_used_in_bytes;
+}
+
+static void write_header(Writer_t* w, Gpu_t* gpu, bool details) {
+  write_text(w, "<!DOCTYPE html>\n");
+  write_text(w, details ? COMPACT_DETAILS_HTML_TAG "\n" : COMPACT_HTML_TAG "\n");
+  write_text(w,
+             "<head>\n"
+             "  <meta charset='UTF-8'>\n"
+             "  <meta name='viewport' content='width=device-width, initial-scale=1.0'>\n"
+             "  <title>GPU: ");
+  html_text(w, gpu->name);
+  write_text(w,
+             "</title>\n"
+             "  <link rel='stylesheet' href='../gpu_style.css'>\n"
+             "</head>\n"
+             "<body>\n"
+             "  <h1>GPU: ");
+  html_text(w, gpu->name);
+  write_format(w,
+               "</h1>\n"
+               "  <div class='gpu-container'>\n"
+               "    <div class='gpu-header'>Global Memory: %.2f GB | SMs: %u | Shared Mem/SM: %.2f KB | Registers/SM: %u</div>\n",
+               (double)gpu->global_mem_size_in_bytes / (1024.0 * 1024.0 * 1024.0),
+               gpu->number_of_SMs,
+               (double)gpu->shared_mem_size_in_bytes_per_SM / 1024.0,
+               gpu->number_of_registers_per_SM);
+}
+
+// One swatch per kernel with its blocks on the whole GPU
+static void write_legend(Writer_t* w, const KernelShares_t* gpu_shares) {
+  write_text(w, "    <div class='legend'>\n");
+  for (int k = 0; k < gpu_shares->count; k++) {
+    write_format(w, "      <span class='legend-item'><span class='swatch k%d'></span>",
+                 k % REPORT_KERNEL_COLOURS);
+    html_text(w, gpu_shares->kernels[k].name);
+    write_format(w, " (%u blocks)</span>\n", gpu_shares->kernels[k].blocks);
+  }
+  write_text(w, "    </div>\n");
+}
+
+static void write_SM(Writer_t* w, Gpu_t* gpu, int i, const KernelShares_t* sm_shares,
+                     const int* colour_of, bool details) {
+  SM_t* sm = &gpu->list_of_SMs[i];
+  unsigned int total_shared = 0;
+  unsigned int total_regs = 0;
+  for (int k = 0; k < sm_shares->count; k++) {
+    total_shared += sm_shares->kernels[k].shared_mem;
+    total_regs += sm_shares->kernels[k].registers;
+  }
+  double occ = 0.0;
+  if (gpu->maximum_number_of_warps_per_SM > 0)
+    occ = calculate_occupancy_of_SM(gpu, i) * 100.0;
+
+  write_format(w,
+               "      <div class='sm'>\n"
+               "        <h3 class='sm_text'>SM #%d</h3>\n"
+               "        <div class='sm-summary'>Occupancy: %.2f%% | Blocks: %hu / %hu<br>"
+               "Shared Mem: %.2f%% | Registers: %.2f%%</div>\n"
+               "        <div class='seg-bar'>",
+               i,
+               occ,
+               sm->number_of_blocks,
+               gpu->maximum_number_of_blocks_per_SM,
+               (double)100.0 * total_shared / gpu->shared_mem_size_in_bytes_per_SM,
+               (double)100.0 * total_regs / gpu->number_of_registers_per_SM);
+
+  // Segments are sized by the share of the SM's warps each kernel holds
+  for (int k = 0; k < sm_shares->count; k++) {
+    const KernelShare_t* share = &sm_shares->kernels[k];
+    double width = gpu->maximum_number_of_warps_per_SM
+      ? 100.0 * share->warps / gpu->maximum_number_of_warps_per_SM : 0.0;
+    write_format(w, "<span class='seg k%d' style='width:%.2f%%' title='",
+                 colour_of[k] % REPORT_KERNEL_COLOURS, width);
+    html_text(w, share->name);
+    write_format(w, ": %u blocks, %u warps'></span>", share->blocks, share->warps);
+  }
+  write_text(w, "</div>\n");
+
+  if (details && sm_shares->count) {
+    write_text(w,
+               "        <details>\n"
+               "          <summary>Kernels</summary>\n"
+               "          <table class='seg-table'>\n"
+               "            <tr><th>Kernel</th><th>Blocks</th><th>Warps</th><th>Regs</th><th>Shared</th></tr>\n");
+    for (int k = 0; k < sm_shares->count; k++) {
+      const KernelShare_t* share = &sm_shares->kernels[k];
+      write_text(w, "            <tr><td>");
+      html_text(w, share->name);
+      write_format(w, "</td><td>%u</td><td>%u</td><td>%.1fK</td><td>%.1f KB</td></tr>\n",
+                   share->blocks,
+                   share->warps,
+                   (double)share->registers / 1000.0,
+                   (double)share->shared_mem / 1024.0);
+    }
+    write_text(w, "          </table>\n        </details>\n");
+  }
+  write_text(w, "      </div>\n");
+}
+
+// Adds the blocks of an SM to shares; returns -1 when out of memory
+static int tally_SM(KernelShares_t* shares, const SM_t* sm) {
+  for (int b = 0; b < sm->number_of_blocks; b++) {
+    int k = kernel_of_block(shares, &sm->list_of_blocks[b]);
+    if (k < 0) return -1;
+    add_block(&shares->kernels[k], &sm->list_of_blocks[b]);
+  }
+  return 0;
+}
+
+static int write_compact_report(Writer_t* w, Gpu_t* gpu, KernelShares_t* gpu_shares, bool details) {
+  KernelShares_t sm_shares = {0};
+  int* colour_of = malloc((gpu_shares->count ? gpu_shares->count : 1) * sizeof(int));
+  if (!colour_of) return -1;
+
+  write_header(w, gpu, details);
+  write_legend(w, gpu_shares);
+  write_text(w, "    <div class='sm-grid'>\n");
+
+  int status = 0;
+  for (unsigned int i = 0; i < gpu->number_of_SMs && status == 0; i++) {
+    sm_shares.count = 0;
+    sm_shares.last = 0;
+    status = tally_SM(&sm_shares, &gpu->list_of_SMs[i]);
+
+    // Colours follow the kernel's position on the whole GPU
+    for (int k = 0; k < sm_shares.count; k++) {
+      Block_t block = { .kernel_name = (char*)sm_shares.kernels[k].name };
+      colour_of[k] = kernel_of_block(gpu_shares, &block);
+    }
+    if (status == 0) write_SM(w, gpu, i, &sm_shares, colour_of, details);
+  }
+
+  write_text(w,
+             "    </div>\n"
+             "  </div>\n"
+             "</body>\n</html>\n");
+
+  free(colour_of);
+  free(sm_shares.kernels);
+  return status;
+}
+
+void export_GPU_to_compact_HTML(Gpu_t* gpu, bool details) {
+  if (!gpu) {
+    fprintf(stderr, "Error: GPU pointer is NULL.\n");
+    return;
+  }
+
+  if (ensure_results_dir() != 0) return;
+
+  char filepath[512];
+  results_path_of_GPU(gpu, ".html", filepath, sizeof(filepath));
+
+  // Kernels of the whole GPU first, so the legend and colours come before the SMs
+  KernelShares_t gpu_shares = {0};
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    if (tally_SM(&gpu_shares, &gpu->list_of_SMs[i]) != 0) {
+      perror("Failed to allocate compact report");
+      free(gpu_shares.kernels);
+      return;
+    }
+  }
+
+  Writer_t w;
+  if (open_writer(&w, filepath) != 0) {
+    free(gpu_shares.kernels);
+    return;
+  }
+  if (write_compact_report(&w, gpu, &gpu_shares, details) != 0) perror("Failed to allocate compact report");
+  if (close_writer(&w) == 0) printf("HTML visualization generated: %s\n", filepath);
+  free(gpu_shares.kernels);
+}
+
+// ================= Index ==================
+
+// Sorts the rows by the clicked column, numerically where cells carry data-sort
+static const char index_script[] =
+  "for (const header of document.querySelectorAll('.index-table th')) {\n"
+  "  header.addEventListener('click', () => {\n"
+  "    const column = header.cellIndex;\n"
+  "    const body = header.closest('table').tBodies[0];\n"
+  "    const ascending = header.dataset.order !== 'asc';\n"
+  "    for (const other of header.parentElement.cells) delete other.dataset.order;\n"
+  "    header.dataset.order = ascending ? 'asc' : 'desc';\n"
+  "    const key = row => {\n"
+  "      const cell = row.cells[column];\n"
+  "      return 'sort' in cell.dataset ? parseFloat(cell.dataset.sort) : cell.textContent;\n"
+  "    };\n"
+  "    const rows = Array.from(body.rows).sort((a, b) => {\n"
+  "      const x = key(a), y = key(b);\n"
+  "      const order = typeof x === 'number' ? x - y : x.localeCompare(y);\n"
+  "      return ascending ? order : -order;\n"
+  "    });\n"
+  "    body.append(...rows);\n"
+  "  });\n"
+  "}\n";
+
+int open_report_index(ReportIndex_t* index, const Kernel_t* kernels, int kernel_count) {
+  if (ensure_results_dir() != 0) return -1;
+  if (open_writer(&index->out, REPORT_INDEX_FILE) != 0) return -1;
+
+  Writer_t* w = &index->out;
+  write_text(w,
+             "<!DOCTYPE html>\n"
+             "<html lang='en'>\n"
+             "<head>\n"
+             "  <meta charset='UTF-8'>\n"
+             "  <meta name='viewport' content='width=device-width, initial-scale=1.0'>\n"
+             "  <title>GPU Fleet</title>\n"
+             "  <link rel='stylesheet' href='../gpu_style.css'>\n"
+             "</head>\n"
+             "<body>\n"
+             "  <h1>GPU Fleet</h1>\n"
+             "  <div class='gpu-container'>\n"
+             "    <table class='index-table'>\n"
+             "      <thead><tr><th>GPU</th><th>SMs</th><th>Mean Occupancy</th><th>Min Occupancy</th>"
+             "<th>Blocks Placed</th><th>Blocks Dropped</th><th>Most Used</th>");
+  for (int k = 0; k < kernel_count; k++) {
+    write_text(w, "<th>");
+    html_text(w, kernels[k].name);
+    write_text(w, "</th>");
+  }
+  write_text(w, "</tr></thead>\n      <tbody>\n");
+  return 0;
+}
+
+// Resource with the highest mean use over the SMs, and that mean
+static Limit_t most_used_resource(Gpu_t* gpu, double* share) {
+  const SMResources_t* res = &gpu->free_resources;
+  double used[4] = {0};
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    if (gpu->maximum_number_of_blocks_per_SM)
+      used[LIMIT_BLOCKS] += (double)gpu->list_of_SMs[i].number_of_blocks / gpu->maximum_number_of_blocks_per_SM;
+    if (gpu->maximum_number_of_warps_per_SM)
+      used[LIMIT_WARPS] += (double)(gpu->maximum_number_of_warps_per_SM - res->free_warps[i]) /
+        gpu->maximum_number_of_warps_per_SM;
+    if (gpu->number_of_registers_per_SM)
+      used[LIMIT_REGISTERS] += (double)(gpu->number_of_registers_per_SM - res->free_registers[i]) /
+        gpu->number_of_registers_per_SM;
+    if (gpu->shared_mem_size_in_bytes_per_SM)
+      used[LIMIT_SHARED_MEM] += (double)(gpu->shared_mem_size_in_bytes_per_SM - res->free_shared_mem[i]) /
+        gpu->shared_mem_size_in_bytes_per_SM;
+  }
+
+  Limit_t most = LIMIT_BLOCKS;
+  for (Limit_t limit = LIMIT_WARPS; limit <= LIMIT_SHARED_MEM; limit++) {
+    if (used[limit] > used[most]) most = limit;
+  }
+  *share = gpu->number_of_SMs ? used[most] / gpu->number_of_SMs : 0.0;
+  return most;
+}
+
+void add_GPU_to_report_index(
+  ReportIndex_t* index,
+  Gpu_t* gpu,
+  const Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+) {
+  double mean = 0.0, min = gpu->number_of_SMs ? 1.0 : 0.0;
+  unsigned long long placed = 0;
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    double occupancy = calculate_occupancy_of_SM(gpu, i);
+    mean += occupancy;
+    if (occupancy < min) min = occupancy;
+    placed += gpu->list_of_SMs[i].number_of_blocks;
+  }
+  if (gpu->number_of_SMs) mean /= gpu->number_of_SMs;
+
+  unsigned long long total_dropped = 0;
+  for (int k = 0; k < kernel_count; k++) total_dropped += dropped ? dropped[k] : 0;
+
+  double share;
+  Limit_t most_used = most_used_resource(gpu, &share);
+
+  char filepath[512];
+  results_path_of_GPU(gpu, ".html", filepath, sizeof(filepath));
+  const char* link = strrchr(filepath, '/') ? strrchr(filepath, '/') + 1 : filepath;
+
+  Writer_t* w = &index->out;
+  write_text(w, "        <tr><td><a href='");
+  html_text(w, link);
+  write_text(w, "'>");
+  html_text(w, gpu->name);
+  write_format(w,
+               "</a></td><td data-sort='%u'>%u</td>"
+               "<td data-sort='%.4f'>%.2f%%</td><td data-sort='%.4f'>%.2f%%</td>"
+               "<td data-sort='%llu'>%llu</td><td class='%s' data-sort='%llu'>%llu</td>"
+               "<td data-sort='%.4f'>%s (%.0f%%)</td>",
+               gpu->number_of_SMs, gpu->number_of_SMs,
+               mean, mean * 100.0, min, min * 100.0,
+               placed, placed, total_dropped ? "none" : "ok", total_dropped, total_dropped,
+               share, limit_name(most_used), share * 100.0);
+
+  // Share of each kernel's blocks that found an SM
+  for (int k = 0; k < kernel_count; k++) {
+    unsigned int blocks = kernels[k].number_of_blocks;
+    unsigned int fitted = blocks - (dropped ? dropped[k] : 0);
+    double success = blocks ? (double)fitted / blocks : 1.0;
+    write_format(w, "<td class='%s' data-sort='%.4f'>%u / %u</td>",
+                 fitted == blocks ? "ok" : fitted ? "partial" : "none",
+                 success, fitted, blocks);
+  }
+  write_text(w, "</tr>\n");
+}
+
+int close_report_index(ReportIndex_t* index) {
+  Writer_t* w = &index->out;
+  write_text(w,
+             "      </tbody>\n"
+             "    </table>\n"
+             "  </div>\n"
+             "  <script>\n");
+  write_text(w, index_script);
+  write_text(w,
+             "  </script>\n"
+             "</body>\n</html>\n");
+
+  if (close_writer(w) != 0) return -1;
+  printf("HTML visualization generated: %s\n", REPORT_INDEX_FILE);
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdbool.h>
+#include "cuda_arch.h"
+#include "writer.h"
+
+#define REPORT_INDEX_FILE "results/index.html"
+
+// Kernel colours of the compact report, reused in order past the last one
+#define REPORT_KERNEL_COLOURS 8
+
+// ================= Type Declaration ==================
+
+typedef enum HTML_MODE {
+  HTML_FULL,              // one element per resident block, with its own tooltip
+  HTML_COMPACT,           // one bar segment per kernel on each SM
+  HTML_COMPACT_DETAILS    // compact, plus a per-kernel table under each SM
+} HtmlMode_t;
+
+/*
+ * Overview page of every GPU of a run: one row per GPU, linking to its
+ * report, with the mean and lowest SM occupancy, blocks placed and
+ * dropped, the most used resource and the share of each kernel's blocks
+ * that were placed. Rows are written as GPUs finish; clicking a column
+ * header sorts the table.
+ */
+typedef struct REPORT_INDEX {
+  Writer_t out;
+} ReportIndex_t;
+
+// ================= Function Declarations ==================
+
+// Parses the value of --html= (full, compact or compact,details); returns -1 for an unknown mode
+int parse_html_mode(const char* name, HtmlMode_t* mode);
+
+// Writes results/<GPU name>.html in the given mode
+void export_GPU_report(Gpu_t* gpu, HtmlMode_t mode);
+
+/*
+ * Writes a report with one bar per SM, split into a segment per kernel
+ * sized by the warps its blocks hold. With details, each SM also gets a
+ * collapsed <details> table with the blocks, warps, registers and shared
+ * memory per kernel. The file grows with SMs x kernels rather than with
+ * resident blocks.
+ */
+void export_GPU_to_compact_HTML(Gpu_t* gpu, bool details);
+
+// True when the report of this GPU is on disk and was written in this mode
+bool report_exists(Gpu_t* gpu, HtmlMode_t mode);
+
+int open_report_index(ReportIndex_t* index, const Kernel_t* kernels, int kernel_count);
+
+// dropped[k] is the number of blocks of kernels[k] that did not fit
+void add_GPU_to_report_index(
+  ReportIndex_t* index,
+  Gpu_t* gpu,
+  const Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+);
+
+// Returns -1 when the page could not be written
+int close_report_index(ReportIndex_t* index);
+
+#endif // REPORT_H
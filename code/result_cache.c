@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "result_cache.h"
+#include "devmem.h"
+
+static size_t cache_file_size(uint32_t slot_count, uint64_t data_words) {
+  return sizeof(CacheHeader_t) + sizeof(CacheSlot_t) * slot_count + sizeof(uint32_t) * data_words;
+}
+
+// FNV-1a; zero marks an empty slot so it is never returned
+static uint64_t hash_words(const uint32_t* words, size_t count) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  const unsigned char* bytes = (const unsigned char*)words;
+  for (size_t i = 0; i < count * sizeof(uint32_t); i++) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ull;
+  }
+  return h ? h : 1;
+}
+
+int open_result_cache(const char* path, ResultCache_t* cache) {
+  memset(cache, 0, sizeof(*cache));
+  cache->fd = -1;
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: could not open cache %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  // Whoever creates the file initializes it while holding the lock
+  flock(fd, LOCK_EX);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, "Error: could not stat cache %s: %s\n", path, strerror(errno));
+    flock(fd, LOCK_UN);
+    close(fd);
+    return -1;
+  }
+
+  size_t size = st.st_size;
+  if (size == 0) {
+    size = cache_file_size(RESULT_CACHE_SLOTS, RESULT_CACHE_DATA_WORDS);
+    CacheHeader_t header = {
+      .version = RESULT_CACHE_VERSION,
+      .slot_count = RESULT_CACHE_SLOTS,
+      .data_words = RESULT_CACHE_DATA_WORDS,
+      .data_used = 0,
+    };
+    memcpy(header.magic, RESULT_CACHE_MAGIC, sizeof(header.magic));
+    if (ftruncate(fd, size) != 0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      fprintf(stderr, "Error: could not create cache %s: %s\n", path, strerror(errno));
+      flock(fd, LOCK_UN);
+      close(fd);
+      return -1;
+    }
+  }
+  flock(fd, LOCK_UN);
+
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "Error: could not map cache %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  CacheHeader_t* header = base;
+  if (size < sizeof(CacheHeader_t) || memcmp(header->magic, RESULT_CACHE_MAGIC, 4) != 0 ||
+      header->version != RESULT_CACHE_VERSION ||
+      size != cache_file_size(header->slot_count, header->data_words)) {
+    fprintf(stderr, "Error: %s is not a result cache of this version\n", path);
+    munmap(base, size);
+    close(fd);
+    return -1;
+  }
+
+  cache->fd = fd;
+  cache->size = size;
+  cache->base = base;
+  cache->header = header;
+  cache->slots = (CacheSlot_t*)(header + 1);
+  cache->data = (uint32_t*)(cache->slots + header->slot_count);
+  return 0;
+}
+
+void close_result_cache(ResultCache_t* cache) {
+  if (cache->base) munmap(cache->base, cache->size);
+  if (cache->fd >= 0) close(cache->fd);
+  memset(cache, 0, sizeof(*cache));
+  cache->fd = -1;
+}
+
+uint32_t* cache_key_of_GPU(Gpu_t* gpu, Kernel_t* kernels, int kernel_count, size_t* out_words) {
+  bool memory = kernels_use_device_memory(kernels, kernel_count);
+  size_t words = 6 + 4 * (size_t)kernel_count + (memory ? 3 + 3 * (size_t)kernel_count : 0);
+  uint32_t* key = malloc(sizeof(uint32_t) * words);
+  if (!key) {
+    perror("Failed to allocate cache key");
+    return NULL;
+  }
+
+  key[0] = gpu->number_of_SMs;
+  key[1] = gpu->shared_mem_size_in_bytes_per_SM;
+  key[2] = gpu->number_of_registers_per_SM;
+  key[3] = gpu->maximum_number_of_warps_per_SM;
+  key[4] = gpu->maximum_number_of_blocks_per_SM;
+  key[5] = kernel_count;
+  for (int k = 0; k < kernel_count; k++) {
+    key[6 + 4 * k] = kernels[k].number_of_blocks;
+    key[6 + 4 * k + 1] = kernels[k].threads_per_block;
+    key[6 + 4 * k + 2] = kernels[k].shared_mem_used_in_bytes_per_block;
+    key[6 + 4 * k + 3] = kernels[k].registers_per_thread;
+  }
+
+  if (memory) {
+    uint32_t* tail = key + 6 + 4 * (size_t)kernel_count;
+    tail[0] = (uint32_t)gpu->global_mem_size_in_bytes;
+    tail[1] = (uint32_t)((uint64_t)gpu->global_mem_size_in_bytes >> 32);
+    tail[2] = gpu->allocator;
+    for (int k = 0; k < kernel_count; k++) {
+      tail[3 + 3 * k] = (uint32_t)kernels[k].memory_bytes;
+      tail[3 + 3 * k + 1] = (uint32_t)(kernels[k].memory_bytes >> 32);
+      tail[3 + 3 * k + 2] = memory_hash_of_kernel(&kernels[k]);
+    }
+  }
+
+  *out_words = words;
+  return key;
+}
+
+// Slot holding the key, or the empty slot where it would go, or NULL if full
+static CacheSlot_t* probe(ResultCache_t* cache, uint64_t hash, const uint32_t* key, size_t key_words) {
+  uint32_t slot_count = cache->header->slot_count;
+  for (uint32_t i = 0; i < slot_count; i++) {
+    CacheSlot_t* slot = &cache->slots[(hash + i) % slot_count];
+    uint64_t slot_hash = __atomic_load_n(&slot->hash, __ATOMIC_ACQUIRE);
+    if (slot_hash == 0) return slot;
+    if (slot_hash == hash && slot->key_words == key_words &&
+        !memcmp(cache->data + slot->offset, key, sizeof(uint32_t) * key_words)) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+const uint32_t* result_cache_lookup(
+  ResultCache_t* cache,
+  const uint32_t* key,
+  size_t key_words,
+  size_t* value_words
+) {
+  if (!cache->base) return NULL;
+
+  uint64_t hash = hash_words(key, key_words);
+  CacheSlot_t* slot = probe(cache, hash, key, key_words);
+  if (!slot || __atomic_load_n(&slot->hash, __ATOMIC_ACQUIRE) == 0) return NULL;
+
+  *value_words = slot->value_words;
+  return cache->data + slot->offset + slot->key_words;
+}
+
+int result_cache_insert(
+  ResultCache_t* cache,
+  const uint32_t* key,
+  size_t key_words,
+  const uint32_t* value,
+  size_t value_words
+) {
+  if (!cache->base) return -1;
+
+  uint64_t hash = hash_words(key, key_words);
+  int status = -1;
+
+  flock(cache->fd, LOCK_EX);
+  CacheSlot_t* slot = probe(cache, hash, key, key_words);
+  if (slot && slot->hash == hash) {
+    status = 0;  // another process stored it first
+  } else if (slot && cache->header->data_used + key_words + value_words <= cache->header->data_words) {
+    uint64_t offset = cache->header->data_used;
+    memcpy(cache->data + offset, key, sizeof(uint32_t) * key_words);
+    memcpy(cache->data + offset + key_words, value, sizeof(uint32_t) * value_words);
+    cache->header->data_used = offset + key_words + value_words;
+
+    slot->offset = offset;
+    slot->key_words = (uint32_t)key_words;
+    slot->value_words = (uint32_t)value_words;
+    __atomic_store_n(&slot->hash, hash, __ATOMIC_RELEASE);
+    status = 0;
+  } else {
+    fprintf(stderr, "Warning: result cache is full, result not stored\n");
+  }
+  flock(cache->fd, LOCK_UN);
+
+  return status;
+}
@@ -0,0 +1,80 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cuda_arch.h"
+
+#define RESULT_CACHE_FILE "results/sim_cache.bin"
+#define RESULT_CACHE_MAGIC "GSRC"
+#define RESULT_CACHE_VERSION 1
+
+// Default capacity of a new cache file (sparse until used)
+#define RESULT_CACHE_SLOTS (1u << 16)
+#define RESULT_CACHE_DATA_WORDS (16u << 20)
+
+/*
+ * Content-addressed store of simulation results in a memory-mapped file:
+ * a header, an open-addressing table of slots, then a data area of 32-bit
+ * words. Each record holds its full key followed by its value, so a hash
+ * collision is detected by comparing keys.
+ *
+ * Records are only ever appended. A writer takes an exclusive flock(),
+ * copies the record, then publishes the slot by storing its hash last;
+ * readers take no lock and treat a zero hash as an empty slot.
+ */
+typedef struct CACHE_HEADER {
+  char magic[4];
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t reserved;
+  uint64_t data_words;
+  uint64_t data_used;
+} CacheHeader_t;
+
+typedef struct CACHE_SLOT {
+  uint64_t hash;
+  uint64_t offset;       // in words from the start of the data area
+  uint32_t key_words;
+  uint32_t value_words;
+} CacheSlot_t;
+
+typedef struct RESULT_CACHE {
+  int fd;
+  size_t size;
+  void* base;
+  CacheHeader_t* header;
+  CacheSlot_t* slots;
+  uint32_t* data;
+} ResultCache_t;
+
+int open_result_cache(const char* path, ResultCache_t* cache);
+
+void close_result_cache(ResultCache_t* cache);
+
+/*
+ * Key of a placement: the GPU's SM limits and the resource fields of every
+ * kernel in launch order. Names and streams do not change where blocks go.
+ * When kernels use device memory (devmem.h), the global memory size,
+ * allocator and each kernel's memory bytes and memory hash follow, since
+ * they decide which launches run at all.
+ */
+uint32_t* cache_key_of_GPU(Gpu_t* gpu, Kernel_t* kernels, int kernel_count, size_t* out_words);
+
+// Returns the stored value or NULL; the pointer stays valid until close
+const uint32_t* result_cache_lookup(
+  ResultCache_t* cache,
+  const uint32_t* key,
+  size_t key_words,
+  size_t* value_words
+);
+
+int result_cache_insert(
+  ResultCache_t* cache,
+  const uint32_t* key,
+  size_t key_words,
+  const uint32_t* value,
+  size_t value_words
+);
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "metrics.h"
+
+// ================= Workers ==================
+
+static void* worker_main(void* arg) {
+  QueryServer_t* server = arg;
+
+  QueryScratch_t scratch;
+  if (new_query_scratch(&scratch, server->engine) != 0) {
+    perror("Failed to start query worker");
+    return NULL;
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&server->lock);
+    while (!server->ready_head && !server->stopping) {
+      pthread_cond_wait(&server->ready, &server->lock);
+    }
+    if (server->stopping) {
+      pthread_mutex_unlock(&server->lock);
+      break;
+    }
+    ServerConnection_t* connection = server->ready_head;
+    server->ready_head = connection->next;
+    if (!server->ready_head) server->ready_tail = NULL;
+    server->ready_count--;
+    metrics_set(&metrics.query_backlog, server->ready_count);
+    pthread_mutex_unlock(&server->lock);
+
+    // One batch per turn, so a busy client cannot hold the worker
+    connection->out_used = answer_query_batch(&scratch, &connection->stream,
+                                              connection->end_of_input, connection->out);
+    connection->out_sent = 0;
+
+    pthread_mutex_lock(&server->lock);
+    connection->next = server->done;
+    server->done = connection;
+    pthread_mutex_unlock(&server->lock);
+    (void)!write(server->wake[1], "", 1);
+  }
+
+  free_query_scratch(&scratch);
+  return NULL;
+}
+
+// ================= Connections ==================
+
+static void add_connection(QueryServer_t* server, int fd) {
+  ServerConnection_t* connection = calloc(1, sizeof(ServerConnection_t));
+  char* in = malloc(QUERY_STREAM_BUFFER);
+  char* out = malloc(QUERY_STREAM_BUFFER);
+  if (!connection || !in || !out) {
+    perror("Failed to allocate query connection");
+    free(connection);
+    free(in);
+    free(out);
+    close(fd);
+    return;
+  }
+  connection->fd = fd;
+  connection->stream.in = in;
+  connection->out = out;
+  server->connections[server->connection_count++] = connection;
+  metrics_add_connections(1);
+}
+
+static void free_connection(ServerConnection_t* connection) {
+  close(connection->fd);
+  free(connection->stream.in);
+  free(connection->out);
+  free(connection);
+  metrics_add_connections(-1);
+}
+
+static void hand_to_worker(QueryServer_t* server, ServerConnection_t* connection) {
+  connection->busy = true;
+  connection->next = NULL;
+  pthread_mutex_lock(&server->lock);
+  if (server->ready_tail) server->ready_tail->next = connection;
+  else server->ready_head = connection;
+  server->ready_tail = connection;
+  server->ready_count++;
+  metrics_set(&metrics.query_backlog, server->ready_count);
+  pthread_cond_signal(&server->ready);
+  pthread_mutex_unlock(&server->lock);
+}
+
+// Writes pending answers, then hands over what is ready to answer.
+// Returns -1 when the connection is finished or broken.
+static int advance_connection(QueryServer_t* server, ServerConnection_t* connection) {
+  if (connection->busy) return 0;
+
+  while (connection->out_sent < connection->out_used) {
+    ssize_t sent = send(connection->fd, connection->out + connection->out_sent,
+                        connection->out_used - connection->out_sent, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    connection->out_sent += sent;
+  }
+
+  if (query_stream_ready(&connection->stream, connection->end_of_input)) {
+    hand_to_worker(server, connection);
+    return 0;
+  }
+  return connection->end_of_input ? -1 : 0;
+}
+
+static int read_connection(ServerConnection_t* connection) {
+  QueryStream_t* stream = &connection->stream;
+  for (;;) {
+    ssize_t got = read(connection->fd, stream->in + stream->used, QUERY_STREAM_BUFFER - stream->used);
+    if (got < 0 && errno == EINTR) continue;
+    if (got < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    if (got == 0) connection->end_of_input = true;
+    stream->used += got;
+    return 0;
+  }
+}
+
+// ================= Acceptor ==================
+
+static void accept_connections(QueryServer_t* server) {
+  while (server->connection_count < SERVER_MAX_CONNECTIONS) {
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    add_connection(server, fd);
+  }
+}
+
+static void* acceptor_main(void* arg) {
+  QueryServer_t* server = arg;
+  struct pollfd* fds = malloc(sizeof(struct pollfd) * (SERVER_MAX_CONNECTIONS + 2));
+  if (!fds) {
+    perror("Failed to allocate query poll set");
+    return NULL;
+  }
+
+  for (;;) {
+    // A connection with a worker is left out; one with answers still
+    // to write waits for room rather than reading more
+    fds[0] = (struct pollfd){ .fd = server->wake[0], .events = POLLIN };
+    fds[1] = (struct pollfd){ .fd = server->listen_fd,
+                              .events = server->connection_count < SERVER_MAX_CONNECTIONS ? POLLIN : 0 };
+    for (int c = 0; c < server->connection_count; c++) {
+      ServerConnection_t* connection = server->connections[c];
+      if (connection->busy) {
+        fds[c + 2] = (struct pollfd){ .fd = -1 };
+      } else {
+        short events = connection->out_sent < connection->out_used ? POLLOUT : POLLIN;
+        fds[c + 2] = (struct pollfd){ .fd = connection->fd, .events = events };
+      }
+    }
+
+    if (poll(fds, server->connection_count + 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("Failed to poll query connections");
+      break;
+    }
+
+    // Batches answered by the workers come back first
+    if (fds[0].revents) {
+      char drain[64];
+      while (read(server->wake[0], drain, sizeof(drain)) > 0) {}
+      pthread_mutex_lock(&server->lock);
+      ServerConnection_t* done = server->done;
+      server->done = NULL;
+      bool stopping = server->stopping;
+      pthread_mutex_unlock(&server->lock);
+      if (stopping) break;
+      for (; done; done = done->next) {
+        done->busy = false;
+        done->answered = true;
+      }
+    }
+
+    for (int c = 0; c < server->connection_count; ) {
+      ServerConnection_t* connection = server->connections[c];
+      short revents = fds[c + 2].revents;
+      if (!revents && !connection->answered) {
+        c++;
+        continue;
+      }
+      connection->answered = false;
+
+      int status = 0;
+      if ((revents & (POLLIN | POLLHUP | POLLERR)) && connection->out_sent == connection->out_used) {
+        status = read_connection(connection);
+      }
+      if (status == 0) status = advance_connection(server, connection);
+      if (status != 0) {
+        free_connection(connection);
+        server->connection_count--;
+        server->connections[c] = server->connections[server->connection_count];
+        fds[c + 2] = fds[server->connection_count + 2];
+        continue;
+      }
+      c++;
+    }
+
+    if (fds[1].revents) accept_connections(server);
+  }
+
+  free(fds);
+  return NULL;
+}
+
+// ================= Server ==================
+
+int start_query_server(QueryServer_t* server, const char* path, const QueryEngine_t* engine, int worker_count) {
+  memset(server, 0, sizeof(*server));
+  server->engine = engine;
+  server->worker_count = worker_count > 0 ? worker_count : 1;
+
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Error: socket path %s is too long\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  strcpy(server->path, path);
+
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server->listen_fd < 0) {
+    perror("Failed to create query socket");
+    return -1;
+  }
+  unlink(path);
+  if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(server->listen_fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "Error: could not listen on %s: %s\n", path, strerror(errno));
+    close(server->listen_fd);
+    return -1;
+  }
+  // Neither end blocks: a full pipe already wakes the acceptor
+  if (pipe(server->wake) != 0 || fcntl(server->wake[0], F_SETFL, O_NONBLOCK) != 0 ||
+      fcntl(server->wake[1], F_SETFL, O_NONBLOCK) != 0) {
+    perror("Failed to create query server pipe");
+    close(server->listen_fd);
+    unlink(path);
+    return -1;
+  }
+
+  server->workers = malloc(sizeof(pthread_t) * server->worker_count);
+  if (!server->workers) {
+    perror("Failed to allocate query workers");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_init(&server->lock, NULL);
+  pthread_cond_init(&server->ready, NULL);
+
+  for (int i = 0; i < server->worker_count; i++) {
+    pthread_create(&server->workers[i], NULL, worker_main, server);
+  }
+  pthread_create(&server->acceptor, NULL, acceptor_main, server);
+  return 0;
+}
+
+void stop_query_server(QueryServer_t* server) {
+  pthread_mutex_lock(&server->lock);
+  server->stopping = 1;
+  pthread_cond_broadcast(&server->ready);
+  pthread_mutex_unlock(&server->lock);
+  (void)!write(server->wake[1], "", 1);
+
+  pthread_join(server->acceptor, NULL);
+  for (int i = 0; i < server->worker_count; i++) {
+    pthread_join(server->workers[i], NULL);
+  }
+
+  // Connections with a worker or waiting for one are in the list too
+  for (int c = 0; c < server->connection_count; c++) {
+    free_connection(server->connections[c]);
+  }
+  metrics_set(&metrics.query_backlog, 0);
+  close(server->listen_fd);
+  close(server->wake[0]);
+  close(server->wake[1]);
+  unlink(server->path);
+
+  pthread_mutex_destroy(&server->lock);
+  pthread_cond_destroy(&server->ready);
+  free(server->workers);
+}
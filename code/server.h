@@ -0,0 +1,63 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "query.h"
+
+#define QUERY_SOCKET_FILE "results/gpusim.sock"
+
+// Open connections; more wait in the listen backlog
+#define SERVER_MAX_CONNECTIONS 1024
+
+/*
+ * Answers JSON-lines queries (see query.h) over a Unix stream socket.
+ *
+ * The acceptor thread polls the listening socket and every connection.
+ * When a connection has complete lines it goes to a fixed pool of
+ * workers, which answer what was read as one batch into the connection's
+ * output buffer and hand it back; the acceptor then writes it out in a
+ * single system call when the socket allows, so pipelining clients pay
+ * one per batch rather than per query. Idle connections hold no worker,
+ * and a connection does not read more until its answers are written.
+ */
+typedef struct SERVER_CONNECTION {
+  int fd;
+  QueryStream_t stream;
+  char* out;                        // QUERY_STREAM_BUFFER bytes of answers
+  size_t out_used;
+  size_t out_sent;
+  bool end_of_input;
+  bool busy;                        // with a worker
+  bool answered;                    // back from a worker, not yet written
+  struct SERVER_CONNECTION* next;   // in the ready or done list
+} ServerConnection_t;
+
+typedef struct QUERY_SERVER {
+  const QueryEngine_t* engine;
+  char path[108];
+  int listen_fd;
+  int wake[2];              // pipe waking the acceptor for done batches and stop
+
+  pthread_t acceptor;
+  ServerConnection_t* connections[SERVER_MAX_CONNECTIONS];   // acceptor only
+  int connection_count;
+
+  int worker_count;
+  pthread_t* workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  ServerConnection_t* ready_head;   // waiting for a worker, in order
+  ServerConnection_t* ready_tail;
+  int ready_count;
+  ServerConnection_t* done;         // answered, back to the acceptor
+  int stopping;
+} QueryServer_t;
+
+int start_query_server(QueryServer_t* server, const char* path, const QueryEngine_t* engine, int worker_count);
+
+// Closes every connection, joins the threads and removes the socket file
+void stop_query_server(QueryServer_t* server);
+
+#endif // SERVER_H
@@ -0,0 +1,127 @@
+#include <limits.h>
+#include "cuda_arch.h"
+#include "stats.h"
+
+#if defined(__AVX512F__)
+  #include <immintrin.h>
+#elif defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+// Resources one block asks for, in the same units as SMResources_t
+typedef struct BLOCK_NEEDS {
+  int warps;
+  int shared_mem;
+  int registers;
+} BlockNeeds_t;
+
+static BlockNeeds_t needs_of_block(const Block_t* block) {
+  unsigned long regs = (unsigned long)block->number_of_registers_used_per_thread *
+    (unsigned long)block->number_of_thread;
+  unsigned long shared = block->shared_mem_used_in_bytes;
+  unsigned long warps = (block->number_of_thread + 31) / 32;
+
+  BlockNeeds_t needs = {
+    .warps = warps > INT_MAX ? INT_MAX : (int)warps,
+    .shared_mem = shared > INT_MAX ? INT_MAX : (int)shared,
+    .registers = regs > INT_MAX ? INT_MAX : (int)regs,
+  };
+  return needs;
+}
+
+// Bit n of the result is set when SM first_SM + n can take the block.
+// Bits past the last SM are always clear (padding has no free block slots).
+unsigned int fit_mask_of_SMs(const Gpu_t* gpu, int first_SM, const Block_t* block) {
+  const SMResources_t* res = &gpu->free_resources;
+  BlockNeeds_t needs = needs_of_block(block);
+  unsigned int mask = 0;
+
+#if defined(__AVX512F__)
+  __m512i w = _mm512_loadu_si512((const void*)(res->free_warps + first_SM));
+  __m512i s = _mm512_loadu_si512((const void*)(res->free_shared_mem + first_SM));
+  __m512i r = _mm512_loadu_si512((const void*)(res->free_registers + first_SM));
+  __m512i b = _mm512_loadu_si512((const void*)(res->free_block_slots + first_SM));
+
+  __mmask16 fail = _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(needs.warps), w)
+    | _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(needs.shared_mem), s)
+    | _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(needs.registers), r)
+    | _mm512_cmpgt_epi32_mask(_mm512_set1_epi32(1), b);
+  mask = (unsigned int)(~fail) & 0xFFFFu;
+#elif defined(__AVX2__)
+  __m256i need_w = _mm256_set1_epi32(needs.warps);
+  __m256i need_s = _mm256_set1_epi32(needs.shared_mem);
+  __m256i need_r = _mm256_set1_epi32(needs.registers);
+  __m256i need_b = _mm256_set1_epi32(1);
+
+  for (int lane = 0; lane < SM_SCAN_WIDTH; lane += 8) {
+    int pos = first_SM + lane;
+    __m256i w = _mm256_loadu_si256((const __m256i*)(res->free_warps + pos));
+    __m256i s = _mm256_loadu_si256((const __m256i*)(res->free_shared_mem + pos));
+    __m256i r = _mm256_loadu_si256((const __m256i*)(res->free_registers + pos));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(res->free_block_slots + pos));
+
+    __m256i fail = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpgt_epi32(need_w, w), _mm256_cmpgt_epi32(need_s, s)),
+      _mm256_or_si256(_mm256_cmpgt_epi32(need_r, r), _mm256_cmpgt_epi32(need_b, b)));
+    unsigned int fail_bits = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(fail));
+    mask |= (~fail_bits & 0xFFu) << lane;
+  }
+#elif defined(__SSE2__)
+  __m128i need_w = _mm_set1_epi32(needs.warps);
+  __m128i need_s = _mm_set1_epi32(needs.shared_mem);
+  __m128i need_r = _mm_set1_epi32(needs.registers);
+  __m128i need_b = _mm_set1_epi32(1);
+
+  for (int lane = 0; lane < SM_SCAN_WIDTH; lane += 4) {
+    int pos = first_SM + lane;
+    __m128i w = _mm_loadu_si128((const __m128i*)(res->free_warps + pos));
+    __m128i s = _mm_loadu_si128((const __m128i*)(res->free_shared_mem + pos));
+    __m128i r = _mm_loadu_si128((const __m128i*)(res->free_registers + pos));
+    __m128i b = _mm_loadu_si128((const __m128i*)(res->free_block_slots + pos));
+
+    __m128i fail = _mm_or_si128(
+      _mm_or_si128(_mm_cmpgt_epi32(need_w, w), _mm_cmpgt_epi32(need_s, s)),
+      _mm_or_si128(_mm_cmpgt_epi32(need_r, r), _mm_cmpgt_epi32(need_b, b)));
+    unsigned int fail_bits = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(fail));
+    mask |= (~fail_bits & 0xFu) << lane;
+  }
+#else
+  for (int lane = 0; lane < SM_SCAN_WIDTH; lane++) {
+    int pos = first_SM + lane;
+    bool fits = res->free_block_slots[pos] >= 1 &&
+      res->free_warps[pos] >= needs.warps &&
+      res->free_shared_mem[pos] >= needs.shared_mem &&
+      res->free_registers[pos] >= needs.registers;
+    mask |= (unsigned int)fits << lane;
+  }
+#endif
+
+  return mask;
+}
+
+// Returns the first SM at first_SM, first_SM + 2, first_SM + 4, ... that can
+// take the block, or -1. Stepping by two matches the even/odd passes of
+// launch_one_kernel().
+int find_fitting_SM(const Gpu_t* gpu, int first_SM, const Block_t* block) {
+  // Every other bit, starting at the SM the chunk begins with
+  const unsigned int same_parity = 0x5555u;
+
+  // Chunks and same-parity SMs scanned follow from where the scan stops,
+  // so the loop itself is not instrumented
+  for (int pos = first_SM; pos < (int)gpu->number_of_SMs; pos += SM_SCAN_WIDTH) {
+    unsigned int mask = fit_mask_of_SMs(gpu, pos, block) & same_parity;
+    if (mask) {
+      int sm_pos = pos + __builtin_ctz(mask);
+      STATS_ADD(STAT_SCAN_CHUNKS, (pos - first_SM) / SM_SCAN_WIDTH + 1);
+      STATS_ADD(STAT_SM_PROBES, (sm_pos - first_SM) / 2 + 1);
+      return sm_pos;
+    }
+  }
+  if (first_SM < (int)gpu->number_of_SMs) {
+    STATS_ADD(STAT_SCAN_CHUNKS, ((int)gpu->number_of_SMs - first_SM + SM_SCAN_WIDTH - 1) / SM_SCAN_WIDTH);
+    STATS_ADD(STAT_SM_PROBES, ((int)gpu->number_of_SMs - first_SM + 1) / 2);
+  }
+  return -1;
+}
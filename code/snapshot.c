@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+// Index of the kernel that owns the block, searching from the kernel of the
+// previous block since blocks are stored in launch order
+static int kernel_of_block(Block_t* block, Kernel_t* kernels, int kernel_count, int from) {
+  for (int k = from; k < kernel_count; k++) {
+    if (block->kernel_name == kernels[k].name) return k;
+  }
+  for (int k = 0; k < kernel_count; k++) {
+    if (!strcmp(block->kernel_name, kernels[k].name)) return k;
+  }
+  return -1;
+}
+
+unsigned int* encode_GPU_state(
+  Gpu_t* gpu,
+  Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped,
+  size_t* out_words
+) {
+  // Every block may start a run in the worst case
+  size_t blocks = 0;
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    blocks += gpu->list_of_SMs[i].number_of_blocks;
+  }
+
+  size_t max_words = SNAPSHOT_HEADER_WORDS + kernel_count + gpu->number_of_SMs + 1 + 2 * blocks;
+  unsigned int* state = malloc(sizeof(unsigned int) * max_words);
+  if (!state) {
+    perror("Failed to allocate GPU state");
+    return NULL;
+  }
+
+  unsigned int* offsets = state + SNAPSHOT_HEADER_WORDS + kernel_count;
+  unsigned int* runs = offsets + gpu->number_of_SMs + 1;
+  unsigned int run_count = 0;
+
+  state[0] = gpu->number_of_SMs;
+  state[1] = kernel_count;
+  for (int k = 0; k < kernel_count; k++) {
+    state[SNAPSHOT_HEADER_WORDS + k] = dropped ? dropped[k] : 0;
+  }
+
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    SM_t* sm = &gpu->list_of_SMs[i];
+    offsets[i] = run_count;
+
+    int k = 0;
+    for (int b = 0; b < sm->number_of_blocks; b++) {
+      k = kernel_of_block(&sm->list_of_blocks[b], kernels, kernel_count, k);
+      if (k < 0) {
+        fprintf(stderr, "Error: block of unknown kernel %s on SM %u\n", sm->list_of_blocks[b].kernel_name, i);
+        free(state);
+        return NULL;
+      }
+
+      if (run_count > offsets[i] && runs[2 * (run_count - 1)] == (unsigned int)k) {
+        runs[2 * (run_count - 1) + 1]++;
+      } else {
+        runs[2 * run_count] = k;
+        runs[2 * run_count + 1] = 1;
+        run_count++;
+      }
+    }
+  }
+  offsets[gpu->number_of_SMs] = run_count;
+  state[2] = run_count;
+
+  *out_words = SNAPSHOT_HEADER_WORDS + kernel_count + gpu->number_of_SMs + 1 + 2 * (size_t)run_count;
+  return state;
+}
+
+int restore_GPU_state(
+  Gpu_t* gpu,
+  Kernel_t* kernels,
+  int restore_count,
+  const unsigned int* state,
+  size_t words,
+  unsigned int* dropped
+) {
+  if (words < SNAPSHOT_HEADER_WORDS || state[0] != gpu->number_of_SMs ||
+      state[1] < (unsigned int)restore_count) {
+    return -1;
+  }
+
+  size_t kernel_count = state[1];
+  size_t run_count = state[2];
+  if (words != SNAPSHOT_HEADER_WORDS + kernel_count + gpu->number_of_SMs + 1 + 2 * run_count) {
+    return -1;
+  }
+
+  const unsigned int* offsets = state + SNAPSHOT_HEADER_WORDS + kernel_count;
+  const unsigned int* runs = offsets + gpu->number_of_SMs + 1;
+
+  reset_GPU(gpu);
+  for (int k = 0; k < restore_count; k++) {
+    dropped[k] = state[SNAPSHOT_HEADER_WORDS + k];
+  }
+
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > run_count) return -1;
+
+    for (unsigned int r = offsets[i]; r < offsets[i + 1]; r++) {
+      unsigned int k = runs[2 * r];
+      if (k >= (unsigned int)restore_count) continue;
+
+      Block_t block = {
+        .kernel_name = kernels[k].name,
+        .number_of_thread = kernels[k].threads_per_block,
+        .shared_mem_used_in_bytes = kernels[k].shared_mem_used_in_bytes_per_block,
+        .number_of_registers_used_per_thread = kernels[k].registers_per_thread,
+      };
+      for (unsigned int c = 0; c < runs[2 * r + 1]; c++) {
+        // Guards against a state written for different limits
+        if (!canFitBlock(gpu, i, &block)) return -1;
+        place_block_on_SM(gpu, i, &block);
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include "cuda_arch.h"
+
+/*
+ * Placement of every block on a GPU, encoded as a flat array of 32-bit words:
+ *   [0]              number of SMs
+ *   [1]              number of kernels
+ *   [2]              number of runs
+ *   [3, 3+K)         blocks of each kernel that did not fit
+ *   [.., +SMs+1)     index of the first run of each SM, plus the total
+ *   [.., +2*runs)    runs: kernel index, block count
+ * The blocks of a kernel sit next to each other on an SM, so a run of
+ * identical blocks is stored as one (kernel, count) pair.
+ */
+#define SNAPSHOT_HEADER_WORDS 3
+
+unsigned int* encode_GPU_state(
+  Gpu_t* gpu,
+  Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped,
+  size_t* out_words
+);
+
+/*
+ * Empties the GPU and places again the blocks of kernels [0, restore_count)
+ * recorded in the state, filling dropped[0, restore_count). Returns 0, or -1
+ * when the state does not belong to this GPU or kernel list.
+ */
+int restore_GPU_state(
+  Gpu_t* gpu,
+  Kernel_t* kernels,
+  int restore_count,
+  const unsigned int* state,
+  size_t words,
+  unsigned int* dropped
+);
+
+#endif // SNAPSHOT_H
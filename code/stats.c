@@ -0,0 +1,118 @@
+#include "stats.h"
+
+#ifdef GPUSIM_STATS
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+_Thread_local ThreadStats_t thread_stats;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static ThreadStats_t* running;          // registered blocks of live threads
+static ThreadStats_t exited;            // sum of the blocks of exited threads
+
+static void add_stats(ThreadStats_t* into, const ThreadStats_t* from) {
+  for (int c = 0; c < STAT_COUNTER_COUNT; c++) into->counters[c] += from->counters[c];
+  for (int p = 0; p < PHASE_COUNT; p++) into->phase_seconds[p] += from->phase_seconds[p];
+}
+
+// Runs at thread exit, before the thread's _Thread_local storage is freed
+static void merge_thread_stats(void* block) {
+  pthread_mutex_lock(&stats_lock);
+  add_stats(&exited, block);
+  for (ThreadStats_t** p = &running; *p; p = &(*p)->next) {
+    if (*p == block) {
+      *p = ((ThreadStats_t*)block)->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&stats_lock);
+}
+
+static void create_stats_key(void) {
+  pthread_key_create(&stats_key, merge_thread_stats);
+}
+
+void register_thread_stats(void) {
+  pthread_once(&stats_once, create_stats_key);
+  pthread_mutex_lock(&stats_lock);
+  thread_stats.registered = true;
+  thread_stats.next = running;
+  running = &thread_stats;
+  pthread_mutex_unlock(&stats_lock);
+  pthread_setspecific(stats_key, &thread_stats);
+}
+
+double stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char* const counter_keys[] = {
+  "scan_chunks", "sm_probes", "blocks_placed", "blocks_dropped",
+  "pass_switches", "clear_blocks_scanned", "clear_blocks_removed", "bytes_written",
+};
+
+static const char* const counter_labels[] = {
+  "SM scan chunks", "SM probes", "Blocks placed", "Blocks dropped",
+  "Even/odd pass switches", "Blocks scanned by clear", "Blocks cleared", "Bytes written",
+};
+
+static const char* const phase_keys[] = { "load", "placement", "reporting", "export" };
+
+static const char* const phase_labels[] = { "Load config", "Placement", "Reporting", "Export" };
+
+// Counters divided by the blocks placed, the cost of placing one block
+static const StatCounter_t per_block[] = { STAT_SCAN_CHUNKS, STAT_SM_PROBES, STAT_PASS_SWITCHES };
+#define PER_BLOCK_COUNT (int)(sizeof(per_block) / sizeof(per_block[0]))
+
+void print_stats(FILE* out, bool json) {
+  ThreadStats_t total;
+  memset(&total, 0, sizeof(total));
+  pthread_mutex_lock(&stats_lock);
+  add_stats(&total, &exited);
+  for (const ThreadStats_t* t = running; t; t = t->next) add_stats(&total, t);
+  pthread_mutex_unlock(&stats_lock);
+
+  double placed = total.counters[STAT_BLOCKS_PLACED];
+  if (json) {
+    fprintf(out, "{\"phases_ms\":{");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+      fprintf(out, "%s\"%s\":%.3f", p ? "," : "", phase_keys[p], total.phase_seconds[p] * 1e3);
+    }
+    fprintf(out, "},\"counters\":{");
+    for (int c = 0; c < STAT_COUNTER_COUNT; c++) {
+      fprintf(out, "%s\"%s\":%llu", c ? "," : "", counter_keys[c], total.counters[c]);
+    }
+    fprintf(out, "},\"per_placed_block\":{");
+    for (int i = 0; i < PER_BLOCK_COUNT; i++) {
+      fprintf(out, "%s\"%s\":%.3f", i ? "," : "", counter_keys[per_block[i]],
+              placed ? total.counters[per_block[i]] / placed : 0.0);
+    }
+    fprintf(out, "}}\n");
+    return;
+  }
+
+  fprintf(out, "\n============================================================\n");
+  fprintf(out, " SIMULATOR STATISTICS\n");
+  fprintf(out, "============================================================\n");
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    fprintf(out, "%-24s %12.3f ms\n", phase_labels[p], total.phase_seconds[p] * 1e3);
+  }
+  fprintf(out, "------------------------------------------------------------\n");
+  for (int c = 0; c < STAT_COUNTER_COUNT; c++) {
+    fprintf(out, "%-24s %12llu", counter_labels[c], total.counters[c]);
+    for (int i = 0; i < PER_BLOCK_COUNT; i++) {
+      if (per_block[i] == (StatCounter_t)c && placed) {
+        fprintf(out, "   (%.2f per placed block)", total.counters[c] / placed);
+      }
+    }
+    fprintf(out, "\n");
+  }
+}
+
+#endif // GPUSIM_STATS
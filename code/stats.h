@@ -0,0 +1,75 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+ * Hot-path counters and phase timers, compiled in with make STATS=1
+ * (-DGPUSIM_STATS) and printed by --stats. Without it every STATS_ macro
+ * expands to nothing and its arguments are not evaluated.
+ *
+ * Each thread counts into its own _Thread_local block, so the placement
+ * loops never share a cache line. Blocks are registered on first use and
+ * merged into the totals when their thread exits; print_stats() adds the
+ * blocks of threads still running.
+ */
+
+typedef enum STAT_COUNTER {
+  STAT_SCAN_CHUNKS,       // fit_mask_of_SMs() calls made by find_fitting_SM()
+  STAT_SM_PROBES,         // SMs of the searched parity those scans looked at
+  STAT_BLOCKS_PLACED,
+  STAT_BLOCKS_DROPPED,
+  STAT_PASS_SWITCHES,     // even/odd pass changes in place_kernel_blocks()
+  STAT_CLEAR_SCANNED,     // blocks looked at by clear_kernel_blocks()
+  STAT_CLEAR_REMOVED,
+  STAT_BYTES_WRITTEN,     // by the report, record and table exporters
+  STAT_COUNTER_COUNT
+} StatCounter_t;
+
+typedef enum STAT_PHASE {
+  PHASE_LOAD,             // load_config()
+  PHASE_PLACEMENT,        // simulation, including cache and run state reuse
+  PHASE_REPORTING,        // the GPU summary printed to the terminal
+  PHASE_EXPORT,           // HTML reports and every report covering all GPUs
+  PHASE_COUNT
+} StatPhase_t;
+
+#ifdef GPUSIM_STATS
+
+typedef struct THREAD_STATS {
+  unsigned long long counters[STAT_COUNTER_COUNT];
+  double phase_seconds[PHASE_COUNT];
+  bool registered;
+  struct THREAD_STATS* next;            // threads still running
+} ThreadStats_t;
+
+extern _Thread_local ThreadStats_t thread_stats;
+
+void register_thread_stats(void);
+
+double stats_now(void);
+
+static inline ThreadStats_t* local_stats(void) {
+  if (__builtin_expect(!thread_stats.registered, 0)) register_thread_stats();
+  return &thread_stats;
+}
+
+#define STATS_ADD(counter, n) (local_stats()->counters[counter] += (n))
+
+// Starts a timer; STATS_PHASE_END() adds the time since to a phase
+#define STATS_TIMER(name) double name = stats_now()
+#define STATS_PHASE_END(phase, timer) (local_stats()->phase_seconds[phase] += stats_now() - (timer))
+
+// Every thread's counters and timers, as text or one JSON line
+void print_stats(FILE* out, bool json);
+
+#else
+
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_TIMER(name)
+#define STATS_PHASE_END(phase, timer) ((void)0)
+
+#endif // GPUSIM_STATS
+
+#endif // STATS_H
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "timeline.h"
+#include "occupancy.h"
+
+// Slack when comparing parts of the GPU, which are sums of fractions
+#define WIDTH_EPSILON 1e-9
+
+const char* copy_kind_name(CopyKind_t kind) {
+  switch (kind) {
+    case COPY_H2D: return "h2d";
+    case COPY_D2H: return "d2h";
+    case COPY_D2D: return "d2d";
+  }
+  return "unknown";
+}
+
+int parse_copy_kind(const char* name, CopyKind_t* out) {
+  for (int kind = 0; kind < COPY_KINDS; kind++) {
+    if (!strcmp(name, copy_kind_name(kind))) {
+      *out = kind;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+bool kernels_use_timeline(const Kernel_t* kernels, int kernel_count) {
+  for (int k = 0; k < kernel_count; k++) {
+    if (kernels[k].copy_count || kernels[k].duration_us > 0) return true;
+  }
+  return false;
+}
+
+double copy_duration_us(const Gpu_t* gpu, const Copy_t* copy) {
+  double gbps = copy->kind == COPY_D2D ?
+    (gpu->device_bandwidth_gbps > 0 ? gpu->device_bandwidth_gbps : TIMELINE_DEVICE_BANDWIDTH_GBPS) :
+    (gpu->host_bandwidth_gbps > 0 ? gpu->host_bandwidth_gbps : TIMELINE_HOST_BANDWIDTH_GBPS);
+  // 1 GB/s moves 1000 bytes per microsecond
+  return copy->bytes / (gbps * 1e3);
+}
+
+// ================= Streams ==================
+
+// Where a stream is in the kernel at its head: steps run the copies before
+// the kernel, the kernel, then the copies after it
+typedef struct STREAM_STATE {
+  queue_kernel_t* queue;
+  Kernel_t kernel;
+  bool has_kernel;
+  int step;
+  int copies_before;
+
+  double duration_us;           // of the kernel
+  double width;                 // part of the GPU the kernel holds
+
+  unsigned long long submitted;  // operations the host has submitted
+  unsigned long long started;
+
+  bool running;
+  bool running_kernel;
+  CopyKind_t running_copy;
+  double ready_us;              // when the previous operation ended
+  double end_us;
+} StreamState_t;
+
+static int count_copies_before(const Kernel_t* kernel) {
+  int before = 0;
+  for (unsigned short c = 0; c < kernel->copy_count; c++) {
+    if (!kernel->copies[c].after) before++;
+  }
+  return before;
+}
+
+// Copy of step, or NULL for the kernel itself
+static const Copy_t* copy_of_step(const StreamState_t* s) {
+  int step = s->step;
+  bool after = step > s->copies_before;
+  int nth = after ? step - s->copies_before - 1 : step;
+  for (unsigned short c = 0; c < s->kernel.copy_count; c++) {
+    if (s->kernel.copies[c].after == after && nth-- == 0) return &s->kernel.copies[c];
+  }
+  return NULL;
+}
+
+// Run time and part of the GPU of a kernel, from the blocks one SM holds
+static void size_kernel(const Gpu_t* gpu, const OccupancyTable_t* table, const Kernel_t* kernel,
+                        double* duration_us, double* width) {
+  float occupancy;
+  unsigned char limit;
+  unsigned short blocks_per_SM = 0;
+  occupancy_of_shape(table, kernel->threads_per_block, kernel->registers_per_thread,
+                     kernel->shared_mem_used_in_bytes_per_block, &occupancy, &limit, &blocks_per_SM);
+
+  unsigned long long resident = (unsigned long long)blocks_per_SM * gpu->number_of_SMs;
+  if (resident == 0 || kernel->number_of_blocks == 0) {
+    // Nothing of it can run; only a given duration is kept
+    *width = 0.0;
+    *duration_us = kernel->duration_us;
+    return;
+  }
+  *width = kernel->number_of_blocks < resident ? (double)kernel->number_of_blocks / resident : 1.0;
+  unsigned long long waves = (kernel->number_of_blocks + resident - 1) / resident;
+  *duration_us = kernel->duration_us > 0 ? kernel->duration_us : waves * TIMELINE_WAVE_US;
+}
+
+// Moves to the next kernel of the stream once the last step is done
+static void next_kernel(StreamState_t* s, const Gpu_t* gpu, const OccupancyTable_t* table) {
+  s->has_kernel = !queue_kernel_empty(s->queue);
+  if (!s->has_kernel) return;
+  s->kernel = queue_kernel_dequeue(s->queue);
+  size_kernel(gpu, table, &s->kernel, &s->duration_us, &s->width);
+  s->step = 0;
+  s->copies_before = count_copies_before(&s->kernel);
+}
+
+// ================= Host ==================
+
+// The host thread: the next submission, and the one it is making
+typedef struct HOST_STATE {
+  int next;                     // first kernel not fully submitted
+  int step;                     // launches one by one: its next operation
+  bool busy;
+  double end_us;
+  int unit_kernels;             // graph: kernels of the submission
+  int unit_ops;
+  unsigned int kernels_submitted;
+} HostState_t;
+
+// Operations and host time of the next submission
+static double next_submission(const Kernel_t* kernels, int kernel_count, const TimelineStats_t* stats,
+                              HostState_t* host) {
+  if (!stats->graph_size) {
+    host->unit_kernels = 0;
+    host->unit_ops = 1;
+    return stats->launch_us;
+  }
+  int n = kernel_count - host->next < stats->graph_size ? kernel_count - host->next : stats->graph_size;
+  host->unit_kernels = n;
+  host->unit_ops = 0;
+  for (int k = host->next; k < host->next + n; k++) host->unit_ops += kernels[k].copy_count + 1;
+  return TIMELINE_GRAPH_LAUNCH_US + host->unit_ops * TIMELINE_GRAPH_NODE_US;
+}
+
+// Hands the submission's operations to their streams
+static void end_submission(const Kernel_t* kernels, const int* stream_of_id, StreamState_t* streams,
+                           HostState_t* host) {
+  host->busy = false;
+  if (host->unit_kernels) {
+    for (int k = host->next; k < host->next + host->unit_kernels; k++) {
+      streams[stream_of_id[kernels[k].stream_id]].submitted += kernels[k].copy_count + 1;
+    }
+    host->kernels_submitted += host->unit_kernels;
+    host->next += host->unit_kernels;
+    return;
+  }
+  const Kernel_t* kernel = &kernels[host->next];
+  streams[stream_of_id[kernel->stream_id]].submitted++;
+  if (host->step == count_copies_before(kernel)) host->kernels_submitted++;
+  if (++host->step > kernel->copy_count) {
+    host->next++;
+    host->step = 0;
+  }
+}
+
+int simulate_timeline(const Gpu_t* gpu, Kernel_t* kernels, int kernel_count, TimelineStats_t* out) {
+  memset(out, 0, sizeof(*out));
+  out->copy_engines = gpu->copy_engines ? gpu->copy_engines : TIMELINE_COPY_ENGINES;
+  out->launch_us = gpu->launch_us > 0 ? gpu->launch_us : TIMELINE_LAUNCH_US;
+  out->queue_depth = gpu->launch_queue_depth ? gpu->launch_queue_depth : TIMELINE_QUEUE_DEPTH;
+  out->graph_size = gpu->graph_size;
+
+  StreamQueue_t* queues;
+  int stream_count;
+  make_stream_queues(kernels, kernel_count, &queues, &stream_count);
+  StreamState_t* streams = calloc(stream_count ? stream_count : 1, sizeof(StreamState_t));
+  // Queues are in stream id order
+  int* stream_of_id = calloc(USHRT_MAX + 1, sizeof(int));
+  if (!streams || !stream_of_id) {
+    for (int s = 0; s < stream_count; s++) {
+      queue_kernel_free(&queues[s].queue);
+    }
+    free(queues);
+    free(streams);
+    free(stream_of_id);
+    return -1;
+  }
+  OccupancyTable_t table = new_occupancy_table(gpu);
+  for (int s = 0; s < stream_count; s++) {
+    streams[s].queue = &queues[s].queue;
+    stream_of_id[queues[s].stream_id] = s;
+    next_kernel(&streams[s], gpu, &table);
+  }
+
+  int engines_free = out->copy_engines;
+  double compute_free = 1.0;
+  int kernels_running = 0, copies_running = 0;
+  int copies_of_kind[COPY_KINDS] = {0};
+  HostState_t host = {0};
+  unsigned long long in_flight = 0;
+  bool launch_idle = false;
+  double now = 0.0;
+
+  for (;;) {
+    // The host submits when the driver queue has room, or is empty
+    if (!host.busy && host.next < kernel_count) {
+      double cost = next_submission(kernels, kernel_count, out, &host);
+      if (!in_flight || in_flight + host.unit_ops <= out->queue_depth) {
+        host.busy = true;
+        host.end_us = now + cost;
+        in_flight += host.unit_ops;
+        out->host_busy_us += cost;
+        out->submissions++;
+      }
+    }
+
+    // Start what can start, streams in id order
+    for (int s = 0; s < stream_count; s++) {
+      StreamState_t* st = &streams[s];
+      if (st->running || !st->has_kernel || st->started == st->submitted || st->ready_us > now) continue;
+
+      const Copy_t* copy = copy_of_step(st);
+      if (copy) {
+        // Each direction of the host link carries one copy at a time
+        if (!engines_free || (copy->kind != COPY_D2D && copies_of_kind[copy->kind])) continue;
+        double duration = copy_duration_us(gpu, copy);
+        engines_free--;
+        copies_running++;
+        copies_of_kind[copy->kind]++;
+        st->running_kernel = false;
+        st->running_copy = copy->kind;
+        st->end_us = now + duration;
+        out->copy_us[copy->kind] += duration;
+        out->copies++;
+      } else {
+        if (st->width > compute_free + WIDTH_EPSILON) continue;
+        compute_free -= st->width;
+        kernels_running++;
+        st->running_kernel = true;
+        st->end_us = now + st->duration_us;
+        out->kernels++;
+      }
+      st->running = true;
+      st->started++;
+    }
+
+    // The next operation or submission to end
+    double next = host.busy ? host.end_us : -1.0;
+    for (int s = 0; s < stream_count; s++) {
+      if (streams[s].running && (next < 0 || streams[s].end_us < next)) next = streams[s].end_us;
+    }
+    if (next < 0) break;
+
+    double span = next - now;
+    if (kernels_running) {
+      out->compute_busy_us += span;
+      out->hidden_copy_us += span * copies_running;
+    }
+    if (!host.busy && host.next < kernel_count) out->host_blocked_us += span;
+    // Idle SMs wait for the host when every submitted kernel has started
+    if (span > 0) {
+      bool waiting = !kernels_running && host.kernels_submitted < (unsigned int)kernel_count &&
+                     host.kernels_submitted == out->kernels;
+      if (waiting) {
+        out->launch_idle_us += span;
+        if (!launch_idle) out->launch_gaps++;
+      }
+      launch_idle = waiting;
+    }
+    now = next;
+
+    if (host.busy && host.end_us <= now) end_submission(kernels, stream_of_id, streams, &host);
+    for (int s = 0; s < stream_count; s++) {
+      StreamState_t* st = &streams[s];
+      if (!st->running || st->end_us > now) continue;
+      st->running = false;
+      in_flight--;
+      st->ready_us = now;
+      if (st->running_kernel) {
+        compute_free += st->width;
+        kernels_running--;
+      } else {
+        engines_free++;
+        copies_running--;
+        copies_of_kind[st->running_copy]--;
+      }
+      if (++st->step > st->kernel.copy_count) next_kernel(st, gpu, &table);
+    }
+  }
+  out->makespan_us = now;
+
+  for (int s = 0; s < stream_count; s++) {
+    queue_kernel_free(&queues[s].queue);
+  }
+  free(queues);
+  free(streams);
+  free(stream_of_id);
+  return 0;
+}
+
+void print_timeline(const Gpu_t* gpu, const TimelineStats_t* stats) {
+  double copy_us = 0.0;
+  for (int kind = 0; kind < COPY_KINDS; kind++) copy_us += stats->copy_us[kind];
+  double span = stats->makespan_us > 0 ? stats->makespan_us : 1.0;
+
+  printf("\nTimeline of %s (copy engines: %hu): %.1f us\n", gpu->name, stats->copy_engines, stats->makespan_us);
+  printf("  %u kernels, compute busy %.1f us (%.1f%%)\n",
+         stats->kernels, stats->compute_busy_us, 100.0 * stats->compute_busy_us / span);
+  printf("  %u copies, %.1f us of copy engine time (H2D %.1f, D2H %.1f, D2D %.1f)\n",
+         stats->copies, copy_us, stats->copy_us[COPY_H2D], stats->copy_us[COPY_D2H], stats->copy_us[COPY_D2D]);
+  printf("  transfer time hidden behind compute %.1f us (%.1f%%), exposed %.1f us\n",
+         stats->hidden_copy_us, copy_us > 0 ? 100.0 * stats->hidden_copy_us / copy_us : 0.0,
+         copy_us - stats->hidden_copy_us);
+  if (stats->graph_size) {
+    printf("  host: %u graph launches of up to %hu kernels, %.1f us (%.1f%%)",
+           stats->submissions, stats->graph_size, stats->host_busy_us, 100.0 * stats->host_busy_us / span);
+  } else {
+    printf("  host: %u launch and copy calls of %.1f us, %.1f us (%.1f%%)",
+           stats->submissions, stats->launch_us, stats->host_busy_us, 100.0 * stats->host_busy_us / span);
+  }
+  printf(", blocked %.1f us on a full driver queue (depth %u)\n", stats->host_blocked_us, stats->queue_depth);
+  printf("  SMs idle waiting for launches %.1f us (%.1f%%) in %u gap%s\n",
+         stats->launch_idle_us, 100.0 * stats->launch_idle_us / span, stats->launch_gaps,
+         stats->launch_gaps == 1 ? "" : "s");
+}
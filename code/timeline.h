@@ -0,0 +1,80 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdbool.h>
+#include "cuda_arch.h"
+
+/*
+ * Time model of a GPU's streams, next to the placement model which has no
+ * clock. Every kernel brings the copies listed in its "copies", so the
+ * per-stream queues of make_stream_queues() hold, in order, each kernel's
+ * copies before it, the kernel, and its copies after it. A stream runs one
+ * operation at a time, in order. Copies take one of the GPU's copy engines
+ * for bytes / bandwidth, and the host link carries one copy each way at a
+ * time. Kernels share the SMs: a kernel needs the part of the GPU its
+ * blocks fill when every SM holds as many as fit, so small kernels of
+ * different streams run side by side and large ones in turn.
+ * Kernels last duration_us, or TIMELINE_WAVE_US per wave of blocks.
+ *
+ * Nothing runs before the host submits it. One host thread walks the
+ * kernels in launch order and spends launch_us on each launch and copy
+ * call, or with graph_size launches graphs of that many kernels for
+ * TIMELINE_GRAPH_LAUNCH_US plus TIMELINE_GRAPH_NODE_US per operation.
+ * The driver holds launch_queue_depth operations that have not ended; a
+ * submission blocks until its operations fit.
+ *
+ * The model answers how much of the transfer time compute hides, to pick
+ * stream counts and chunk sizes, and how long the SMs wait for the host. Blocks finish here, unlike in the
+ * placement model, so dropped blocks play no part.
+ */
+
+#define TIMELINE_COPY_ENGINES 2
+#define TIMELINE_HOST_BANDWIDTH_GBPS 25.0     // PCIe 4.0 x16
+#define TIMELINE_DEVICE_BANDWIDTH_GBPS 900.0
+#define TIMELINE_WAVE_US 10.0
+#define TIMELINE_LAUNCH_US 4.0              // host time of a launch or async copy call
+#define TIMELINE_QUEUE_DEPTH 1024
+#define TIMELINE_GRAPH_LAUNCH_US 8.0
+#define TIMELINE_GRAPH_NODE_US 0.2
+
+#define COPY_KINDS 3
+
+// ================= Type Declaration ==================
+
+typedef struct TIMELINE_STATS {
+  double makespan_us;                 // until the last operation ends
+  double compute_busy_us;             // some kernel running
+  double copy_us[COPY_KINDS];         // engine time by kind
+  double hidden_copy_us;              // engine time while some kernel ran
+  double host_busy_us;                // submitting
+  double host_blocked_us;             // waiting for room in the driver queue
+  double launch_idle_us;              // no kernel running or submitted, more to come
+  unsigned int launch_gaps;           // times the SMs went idle that way
+  unsigned int kernels;
+  unsigned int copies;
+  unsigned int submissions;           // launch and copy calls, or graph launches
+  unsigned int queue_depth;
+  double launch_us;
+  unsigned short graph_size;          // 0 for launches one by one
+  unsigned short copy_engines;
+} TimelineStats_t;
+
+// ================= Function Declarations ==================
+
+const char* copy_kind_name(CopyKind_t kind);
+
+// "h2d", "d2h" or "d2d"; returns -1 for anything else
+int parse_copy_kind(const char* name, CopyKind_t* out);
+
+// True when a kernel has copies or a duration, so the timeline is wanted
+bool kernels_use_timeline(const Kernel_t* kernels, int kernel_count);
+
+double copy_duration_us(const Gpu_t* gpu, const Copy_t* copy);
+
+// Runs the streams of the kernels, in launch order, on an idle GPU.
+// Returns -1 when memory runs out.
+int simulate_timeline(const Gpu_t* gpu, Kernel_t* kernels, int kernel_count, TimelineStats_t* out);
+
+void print_timeline(const Gpu_t* gpu, const TimelineStats_t* stats);
+
+#endif // TIMELINE_H
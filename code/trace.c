@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "trace.h"
+
+// Stream tracks are sorted by stream id, then come the block slots
+#define TRACE_SLOT_SORT_INDEX 65536
+
+int open_trace(Trace_t* trace) {
+  memset(trace, 0, sizeof(*trace));
+  if (ensure_results_dir() != 0) return -1;
+  if (open_writer(&trace->out, TRACE_FILE) != 0) return -1;
+
+  json_begin_object(&trace->out);
+  json_key(&trace->out, "displayTimeUnit"); json_string(&trace->out, "ms");
+  json_key(&trace->out, "traceEvents");
+  json_begin_array(&trace->out);
+  return 0;
+}
+
+// Starts an event; the caller adds its other fields and ends the object
+static void begin_event(Writer_t* w, const char* phase, const char* name, int pid, long long tid,
+                        unsigned long long ts) {
+  write_text(w, "\n");
+  json_begin_object(w);
+  json_key(w, "ph");   json_string(w, phase);
+  json_key(w, "name"); json_string(w, name);
+  json_key(w, "pid");  json_uint(w, pid);
+  json_key(w, "tid");  json_uint(w, tid);
+  json_key(w, "ts");   json_uint(w, ts);
+}
+
+static void name_track(Writer_t* w, const char* what, int pid, long long tid, const char* name,
+                       unsigned long long sort_index) {
+  char key[32];
+  begin_event(w, "M", what, pid, tid, 0);
+  json_key(w, "args");
+  json_begin_object(w);
+  json_key(w, "name"); json_string(w, name);
+  json_end_object(w);
+  json_end_object(w);
+
+  snprintf(key, sizeof(key), "%s_sort_index", !strcmp(what, "process_name") ? "process" : "thread");
+  begin_event(w, "M", key, pid, tid, 0);
+  json_key(w, "args");
+  json_begin_object(w);
+  json_key(w, "sort_index"); json_uint(w, sort_index);
+  json_end_object(w);
+  json_end_object(w);
+}
+
+static int kernel_of_block(const Block_t* block, const Kernel_t* kernels, int kernel_count, int hint) {
+  if (hint < kernel_count && block->kernel_name == kernels[hint].name) return hint;
+  for (int k = 0; k < kernel_count; k++) {
+    if (block->kernel_name == kernels[k].name || !strcmp(block->kernel_name, kernels[k].name)) return k;
+  }
+  return -1;
+}
+
+// What an SM holds, to follow its occupancy as its blocks arrive
+typedef struct SM_LOAD {
+  unsigned int blocks;
+  unsigned int warps;
+  unsigned int registers;
+  unsigned int shared_mem;
+} SMLoad_t;
+
+// Same as calculate_occupancy_of_SM(), for the blocks counted so far
+static double occupancy_of_load(const Gpu_t* gpu, const SMLoad_t* load) {
+  double occupancy = (double)load->warps / gpu->maximum_number_of_warps_per_SM;
+  double registers = (double)load->registers / gpu->number_of_registers_per_SM;
+  double shared = (double)load->shared_mem / gpu->shared_mem_size_in_bytes_per_SM;
+  double blocks = (double)load->blocks / gpu->maximum_number_of_blocks_per_SM;
+  if (registers > occupancy) occupancy = registers;
+  if (shared > occupancy) occupancy = shared;
+  if (blocks > occupancy) occupancy = blocks;
+  return occupancy > 1.0 ? 1.0 : occupancy;
+}
+
+// Per launch changes of the GPU counters, summed into values after each launch
+typedef struct TRACE_COUNTERS {
+  double* occupancy;
+  long long* registers;
+  long long* shared_mem;
+} TraceCounters_t;
+
+static void write_block_events(Writer_t* w, int pid, Gpu_t* gpu, const Kernel_t* kernels,
+                               int kernel_count, TraceCounters_t* counters) {
+  unsigned long long end = (unsigned long long)kernel_count * TRACE_TICK_US;
+  char track[64];
+
+  for (unsigned int i = 0; i < gpu->number_of_SMs; i++) {
+    SM_t* sm = &gpu->list_of_SMs[i];
+    SMLoad_t load = {0};
+    double occupancy = 0.0;
+    int k = 0;
+
+    for (int b = 0; b < sm->number_of_blocks; b++) {
+      const Block_t* block = &sm->list_of_blocks[b];
+      k = kernel_of_block(block, kernels, kernel_count, k);
+      if (k < 0) {
+        k = 0;
+        continue;
+      }
+
+      long long tid = (long long)i * gpu->maximum_number_of_blocks_per_SM + b;
+      snprintf(track, sizeof(track), "SM %u slot %d", i, b);
+      name_track(w, "thread_name", pid, tid, track, TRACE_SLOT_SORT_INDEX + tid);
+
+      unsigned long long start = (unsigned long long)k * TRACE_TICK_US;
+      begin_event(w, "X", block->kernel_name, pid, tid, start);
+      json_key(w, "dur"); json_uint(w, end - start);
+      json_key(w, "cat"); json_string(w, "block");
+      json_key(w, "args");
+      json_begin_object(w);
+      json_key(w, "stream");               json_uint(w, kernels[k].stream_id);
+      json_key(w, "threads");              json_uint(w, block->number_of_thread);
+      json_key(w, "registers_per_thread"); json_uint(w, block->number_of_registers_used_per_thread);
+      json_key(w, "shared_mem");           json_uint(w, block->shared_mem_used_in_bytes);
+      json_end_object(w);
+      json_end_object(w);
+
+      unsigned int registers = block->number_of_registers_used_per_thread * block->number_of_thread;
+      load.blocks++;
+      load.warps += (block->number_of_thread + 31) / 32;
+      load.registers += registers;
+      load.shared_mem += block->shared_mem_used_in_bytes;
+      double next = occupancy_of_load(gpu, &load);
+      counters->occupancy[k] += next - occupancy;
+      occupancy = next;
+      counters->registers[k] -= registers;
+      counters->shared_mem[k] -= block->shared_mem_used_in_bytes;
+    }
+  }
+}
+
+static void write_launch_events(Writer_t* w, int pid, Gpu_t* gpu, const Kernel_t* kernels,
+                                int kernel_count, const unsigned int* dropped) {
+  // Stream tracks come after every possible block slot
+  long long first_tid = (long long)gpu->number_of_SMs * gpu->maximum_number_of_blocks_per_SM;
+  char track[32];
+  // One bit per stream id, set once its track is named
+  uint64_t named[(USHRT_MAX + 1) / 64] = {0};
+
+  for (int k = 0; k < kernel_count; k++) {
+    unsigned short stream = kernels[k].stream_id;
+    long long tid = first_tid + stream;
+    if (!(named[stream / 64] & (1ull << (stream % 64)))) {
+      named[stream / 64] |= 1ull << (stream % 64);
+      snprintf(track, sizeof(track), "Stream %hu", kernels[k].stream_id);
+      name_track(w, "thread_name", pid, tid, track, kernels[k].stream_id);
+    }
+
+    unsigned int missed = dropped ? dropped[k] : 0;
+    begin_event(w, "X", kernels[k].name, pid, tid, (unsigned long long)k * TRACE_TICK_US);
+    json_key(w, "dur"); json_uint(w, TRACE_TICK_US);
+    json_key(w, "cat"); json_string(w, "launch");
+    json_key(w, "args");
+    json_begin_object(w);
+    json_key(w, "launch");        json_uint(w, k);
+    json_key(w, "blocks");        json_uint(w, kernels[k].number_of_blocks);
+    json_key(w, "blocks_placed"); json_uint(w, kernels[k].number_of_blocks - missed);
+    json_key(w, "dropped");       json_uint(w, missed);
+    json_end_object(w);
+    json_end_object(w);
+  }
+}
+
+static void write_counter(Writer_t* w, int pid, const char* name, unsigned long long ts,
+                          double value, int decimals) {
+  begin_event(w, "C", name, pid, 0, ts);
+  json_key(w, "args");
+  json_begin_object(w);
+  json_key(w, "value");
+  json_fixed(w, value, decimals);
+  json_end_object(w);
+  json_end_object(w);
+}
+
+static void write_counter_events(Writer_t* w, int pid, Gpu_t* gpu, int kernel_count,
+                                 const TraceCounters_t* counters) {
+  double occupancy = 0.0;
+  long long registers = (long long)gpu->number_of_registers_per_SM * gpu->number_of_SMs;
+  long long shared_mem = (long long)gpu->shared_mem_size_in_bytes_per_SM * gpu->number_of_SMs;
+
+  // Values after each launch, and once more at the end so the last step shows
+  for (int k = 0; k <= kernel_count; k++) {
+    if (k < kernel_count) {
+      occupancy += counters->occupancy[k];
+      registers += counters->registers[k];
+      shared_mem += counters->shared_mem[k];
+    }
+    unsigned long long ts = (unsigned long long)k * TRACE_TICK_US;
+    double mean = gpu->number_of_SMs ? occupancy / gpu->number_of_SMs : 0.0;
+    write_counter(w, pid, "Occupancy", ts, mean < 0.0 ? 0.0 : mean, 4);
+    write_counter(w, pid, "Free registers", ts, registers, 0);
+    write_counter(w, pid, "Free shared mem", ts, shared_mem, 0);
+  }
+}
+
+void add_GPU_to_trace(
+  Trace_t* trace,
+  Gpu_t* gpu,
+  const Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+) {
+  size_t slots = kernel_count ? kernel_count : 1;
+  TraceCounters_t counters = {
+    .occupancy = calloc(slots, sizeof(double)),
+    .registers = calloc(slots, sizeof(long long)),
+    .shared_mem = calloc(slots, sizeof(long long)),
+  };
+  if (!counters.occupancy || !counters.registers || !counters.shared_mem) {
+    perror("Failed to allocate trace counters");
+  } else {
+    Writer_t* w = &trace->out;
+    int pid = trace->gpu_count++;
+    name_track(w, "process_name", pid, 0, gpu->name, pid);
+    write_launch_events(w, pid, gpu, kernels, kernel_count, dropped);
+    write_block_events(w, pid, gpu, kernels, kernel_count, &counters);
+    write_counter_events(w, pid, gpu, kernel_count, &counters);
+  }
+  free(counters.occupancy);
+  free(counters.registers);
+  free(counters.shared_mem);
+}
+
+int close_trace(Trace_t* trace) {
+  Writer_t* w = &trace->out;
+  write_text(w, "\n");
+  json_end_array(w);
+  json_end_object(w);
+  write_text(w, "\n");
+
+  if (close_writer(w) != 0) return -1;
+  printf("Trace generated: %s\n", TRACE_FILE);
+  return 0;
+}
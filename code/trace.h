@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "cuda_arch.h"
+#include "writer.h"
+
+#define TRACE_FILE "results/trace.json"
+
+// Microseconds of trace time given to each kernel launch
+#define TRACE_TICK_US 1000
+
+/*
+ * Chrome trace-event JSON of a run, for chrome://tracing or Perfetto, with
+ * one process per GPU holding:
+ *   - a track per SM block slot, with each resident block as a duration
+ *     event named by its kernel
+ *   - a track per stream, with each kernel launch
+ *   - counter tracks of the mean SM occupancy and the free registers and
+ *     shared memory of the whole GPU
+ * The simulator has no clock: launch k starts at tick k and every block
+ * stays resident until the end of the run, so event lengths show launch
+ * order and residency rather than durations. Events are written as each
+ * GPU finishes; only per-kernel counters are held in memory.
+ */
+typedef struct TRACE {
+  Writer_t out;
+  int gpu_count;            // process id of the next GPU
+} Trace_t;
+
+int open_trace(Trace_t* trace);
+
+// dropped[k] is the number of blocks of kernels[k] that did not fit
+void add_GPU_to_trace(
+  Trace_t* trace,
+  Gpu_t* gpu,
+  const Kernel_t* kernels,
+  int kernel_count,
+  const unsigned int* dropped
+);
+
+// Returns -1 when the file could not be written
+int close_trace(Trace_t* trace);
+
+#endif // TRACE_H
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "writer.h"
+#include "stats.h"
+
+int open_writer(Writer_t* w, const char* path) {
+  memset(w, 0, sizeof(*w));
+  w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (w->fd < 0) {
+    fprintf(stderr, "Error: could not open file %s for writing.\n", path);
+    return -1;
+  }
+  w->path = strdup(path);
+  w->buffer = malloc(WRITER_BUFFER);
+  if (!w->path || !w->buffer) {
+    perror("Failed to allocate writer");
+    close(w->fd);
+    free(w->path);
+    free(w->buffer);
+    return -1;
+  }
+  return 0;
+}
+
+static void write_out(Writer_t* w, const char* data, size_t length) {
+  while (length && !w->failed) {
+    ssize_t written = write(w->fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      w->failed = true;
+      break;
+    }
+    STATS_ADD(STAT_BYTES_WRITTEN, written);
+    data += written;
+    length -= written;
+  }
+}
+
+static void flush_writer(Writer_t* w) {
+  write_out(w, w->buffer, w->used);
+  w->used = 0;
+}
+
+int close_writer(Writer_t* w) {
+  flush_writer(w);
+  if (close(w->fd) != 0) w->failed = true;
+  if (w->failed) fprintf(stderr, "Error: could not write %s: %s\n", w->path, strerror(errno));
+
+  int status = w->failed ? -1 : 0;
+  free(w->path);
+  free(w->buffer);
+  memset(w, 0, sizeof(*w));
+  w->fd = -1;
+  return status;
+}
+
+void write_bytes(Writer_t* w, const char* data, size_t length) {
+  if (length > WRITER_BUFFER - w->used) {
+    flush_writer(w);
+    // Too big to buffer: goes out on its own
+    if (length > WRITER_BUFFER) {
+      write_out(w, data, length);
+      return;
+    }
+  }
+  memcpy(w->buffer + w->used, data, length);
+  w->used += length;
+}
+
+void write_text(Writer_t* w, const char* text) {
+  write_bytes(w, text, strlen(text));
+}
+
+void write_uint(Writer_t* w, unsigned long long value) {
+  char digits[20];
+  int n = sizeof(digits);
+  do {
+    digits[--n] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  write_bytes(w, digits + n, sizeof(digits) - n);
+}
+
+void write_fixed(Writer_t* w, double value, int decimals) {
+  char text[64];
+  int length = snprintf(text, sizeof(text), "%.*f", decimals, value);
+  write_bytes(w, text, length);
+}
+
+void write_base64(Writer_t* w, const unsigned char* data, size_t length) {
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char chunk[256];
+  size_t used = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    unsigned int bits = data[i] << 16;
+    if (i + 1 < length) bits |= data[i + 1] << 8;
+    if (i + 2 < length) bits |= data[i + 2];
+    chunk[used++] = digits[bits >> 18];
+    chunk[used++] = digits[(bits >> 12) & 63];
+    chunk[used++] = i + 1 < length ? digits[(bits >> 6) & 63] : '=';
+    chunk[used++] = i + 2 < length ? digits[bits & 63] : '=';
+    if (used == sizeof(chunk)) {
+      write_bytes(w, chunk, used);
+      used = 0;
+    }
+  }
+  write_bytes(w, chunk, used);
+}
+
+void write_format(Writer_t* w, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  size_t room = WRITER_BUFFER - w->used;
+  int length = vsnprintf(w->buffer + w->used, room, format, args);
+  va_end(args);
+  if (length < 0) return;
+  if ((size_t)length < room) {
+    w->used += length;
+    return;
+  }
+
+  // Did not fit: format again into an empty buffer, or on its own if too big
+  flush_writer(w);
+  char* text = (size_t)length < WRITER_BUFFER ? w->buffer : malloc(length + 1);
+  if (!text) {
+    w->failed = true;
+    return;
+  }
+  va_start(args, format);
+  vsnprintf(text, length + 1, format, args);
+  va_end(args);
+  if (text == w->buffer) {
+    w->used = length;
+  } else {
+    write_out(w, text, length);
+    free(text);
+  }
+}
+
+// ================= JSON ==================
+
+// Comma before every value of an object or array but the first
+static void json_before_value(Writer_t* w) {
+  if (w->after_key) {
+    w->after_key = false;
+    return;
+  }
+  if (w->has_items[w->depth]) write_bytes(w, ",", 1);
+  w->has_items[w->depth] = true;
+}
+
+static void json_escaped(Writer_t* w, const char* value) {
+  write_bytes(w, "\"", 1);
+  const char* run = value;
+  for (const char* p = value; *p; p++) {
+    unsigned char c = *p;
+    // '<' too, so the JSON can be embedded in a <script>
+    if (c != '"' && c != '\\' && c != '<' && c >= 0x20) continue;
+
+    write_bytes(w, run, p - run);
+    char escape[8];
+    int length = c == '"' ? snprintf(escape, sizeof(escape), "\\\"")
+      : c == '\\' ? snprintf(escape, sizeof(escape), "\\\\")
+      : snprintf(escape, sizeof(escape), "\\u%04x", c);
+    write_bytes(w, escape, length);
+    run = p + 1;
+  }
+  write_text(w, run);
+  write_bytes(w, "\"", 1);
+}
+
+static void json_open(Writer_t* w, char bracket) {
+  json_before_value(w);
+  write_bytes(w, &bracket, 1);
+  if (w->depth + 1 < WRITER_MAX_DEPTH) w->depth++;
+  w->has_items[w->depth] = false;
+}
+
+static void json_close(Writer_t* w, char bracket) {
+  if (w->depth > 0) w->depth--;
+  write_bytes(w, &bracket, 1);
+}
+
+void json_begin_object(Writer_t* w) { json_open(w, '{'); }
+void json_end_object(Writer_t* w)   { json_close(w, '}'); }
+void json_begin_array(Writer_t* w)  { json_open(w, '['); }
+void json_end_array(Writer_t* w)    { json_close(w, ']'); }
+
+void json_key(Writer_t* w, const char* key) {
+  json_before_value(w);
+  json_escaped(w, key);
+  write_bytes(w, ":", 1);
+  w->after_key = true;
+}
+
+void json_string(Writer_t* w, const char* value) {
+  json_before_value(w);
+  json_escaped(w, value ? value : "");
+}
+
+void json_uint(Writer_t* w, unsigned long long value) {
+  json_before_value(w);
+  write_uint(w, value);
+}
+
+void json_fixed(Writer_t* w, double value, int decimals) {
+  json_before_value(w);
+  write_fixed(w, value, decimals);
+}
+
+void json_base64(Writer_t* w, const unsigned char* data, size_t length) {
+  json_before_value(w);
+  write_bytes(w, "\"", 1);
+  write_base64(w, data, length);
+  write_bytes(w, "\"", 1);
+}
+
+// ================= CSV ==================
+
+void csv_string(Writer_t* w, const char* value, bool first) {
+  if (!first) write_bytes(w, ",", 1);
+  if (!value) return;
+  if (!strpbrk(value, ",\"\n\r")) {
+    write_text(w, value);
+    return;
+  }
+
+  write_bytes(w, "\"", 1);
+  for (const char* p = value; *p; p++) {
+    if (*p == '"') write_bytes(w, "\"", 1);
+    write_bytes(w, p, 1);
+  }
+  write_bytes(w, "\"", 1);
+}
+
+void csv_uint(Writer_t* w, unsigned long long value, bool first) {
+  if (!first) write_bytes(w, ",", 1);
+  write_uint(w, value);
+}
+
+void csv_fixed(Writer_t* w, double value, int decimals, bool first) {
+  if (!first) write_bytes(w, ",", 1);
+  write_fixed(w, value, decimals);
+}
+
+void csv_end_row(Writer_t* w) {
+  write_bytes(w, "\n", 1);
+}
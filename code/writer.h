@@ -0,0 +1,76 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bytes buffered before a write() to the file
+#define WRITER_BUFFER (256 * 1024)
+
+// Deepest nesting of JSON objects and arrays
+#define WRITER_MAX_DEPTH 16
+
+/*
+ * Buffered output file with JSON and CSV helpers. Values go straight into
+ * the buffer, which is written out whenever it fills, so output of any
+ * size costs one pass and WRITER_BUFFER bytes of memory. Errors are
+ * remembered and reported once by close_writer().
+ *
+ * JSON calls track whether a comma is needed at each nesting level:
+ *   json_begin_object(w);
+ *   json_key(w, "sms"); json_uint(w, 80);
+ *   json_end_object(w);
+ */
+typedef struct WRITER {
+  int fd;
+  char* path;
+  char* buffer;
+  size_t used;
+  bool failed;
+
+  int depth;
+  bool has_items[WRITER_MAX_DEPTH];   // a value was written at this level
+  bool after_key;
+} Writer_t;
+
+int open_writer(Writer_t* w, const char* path);
+
+// Flushes and closes; returns -1 when anything failed since open
+int close_writer(Writer_t* w);
+
+void write_bytes(Writer_t* w, const char* data, size_t length);
+
+void write_text(Writer_t* w, const char* text);
+
+void write_uint(Writer_t* w, unsigned long long value);
+
+// Fixed number of decimals, for values that are not negative
+void write_fixed(Writer_t* w, double value, int decimals);
+
+void write_base64(Writer_t* w, const unsigned char* data, size_t length);
+
+// printf into the buffer, for text that is not worth assembling by hand
+void write_format(Writer_t* w, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// ================= JSON ==================
+
+void json_begin_object(Writer_t* w);
+void json_end_object(Writer_t* w);
+void json_begin_array(Writer_t* w);
+void json_end_array(Writer_t* w);
+void json_key(Writer_t* w, const char* key);
+void json_string(Writer_t* w, const char* value);
+void json_uint(Writer_t* w, unsigned long long value);
+void json_fixed(Writer_t* w, double value, int decimals);
+// Bytes as a base64 string
+void json_base64(Writer_t* w, const unsigned char* data, size_t length);
+
+// ================= CSV ==================
+
+// Fields are separated by commas; quoted only when they contain , " or a newline
+void csv_string(Writer_t* w, const char* value, bool first);
+void csv_uint(Writer_t* w, unsigned long long value, bool first);
+void csv_fixed(Writer_t* w, double value, int decimals, bool first);
+void csv_end_row(Writer_t* w);
+
+#endif // WRITER_H